@@ -281,7 +281,7 @@ export class RasterViewComponent extends React.Component<RasterViewComponentProp
         }
 
         if (rasterTile.data && !frame.isPreview) {
-            tileService.uploadTileToGPU(rasterTile);
+            tileService.uploadTileToGPU(rasterTile, TileCoordinate.AddFileId(TileCoordinate.EncodeCoordinate(tile), frame.frameInfo.fileId));
             delete rasterTile.data;
         }
 
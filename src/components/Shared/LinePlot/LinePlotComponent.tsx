@@ -699,7 +699,7 @@ export class LinePlotComponent extends React.Component<LinePlotComponentProps> {
             }
             rows.push(columnsHeader);
 
-            multiPlotProp.data.forEach(o => {
+            (multiPlotProp.fullResolutionData ?? multiPlotProp.data).forEach(o => {
                 let rowData = `${o.x}\t${toExponential(o.y, 10)}`;
                 // append following data
                 if (multiPlotProp.followingData) {
@@ -60,6 +60,8 @@ export class MultiPlotProps {
     imageName: string;
     plotName: string;
     data: {x: number; y: number}[];
+    // Undecimated data, exported instead of data if given
+    fullResolutionData?: {x: number; y: number}[];
     type: PlotType;
     borderColor?: string;
     borderWidth?: number;
@@ -144,8 +144,6 @@ export class SpatialProfilerComponent extends React.Component<WidgetProps> {
                 let xArray: number[] = new Array(N);
                 const numPixels = this.width;
                 const decimationFactor = Math.round(N / numPixels);
-                let startIndex: number;
-                let endIndex: number;
                 for (let i = 0; i < N; i++) {
                     const y = coordinateData.values[i];
                     const x = this.widgetStore.effectiveRegion?.regionType === CARTA.RegionType.LINE ? (i - coordinateData.lineAxis.crpix) * coordinateData.lineAxis.cdelt : i * coordinateData.lineAxis.cdelt;
@@ -155,10 +153,6 @@ export class SpatialProfilerComponent extends React.Component<WidgetProps> {
                         yCount++;
                         ySum += y;
                         ySum2 += y * y;
-                        if (startIndex === undefined) {
-                            startIndex = i;
-                        }
-                        endIndex = i;
                     }
                     xArray[i] = x;
                     if (decimationFactor <= 1) {
@@ -168,7 +162,7 @@ export class SpatialProfilerComponent extends React.Component<WidgetProps> {
                     }
                 }
                 if (decimationFactor > 1) {
-                    values = this.widgetStore.smoothingStore.getDecimatedPoint2DArray(xArray, coordinateData.values, decimationFactor, startIndex, endIndex);
+                    values = this.widgetStore.smoothingStore.getPixelDecimatedPoint2DArray(xArray, coordinateData.values, numPixels, xMin, xMax);
                 }
                 smoothingValues = this.widgetStore.smoothingStore.getSmoothingPoint2DArray(xArray, coordinateData.values);
             } else if (coordinateData.mip > 1 || coordinateData.start > 0 || coordinateData.end < xMax) {
@@ -226,7 +220,7 @@ export class SpatialProfilerComponent extends React.Component<WidgetProps> {
                             }
                             fullResolutionValues[i] = {x, y: val};
                         }
-                        values = this.widgetStore.smoothingStore.getDecimatedPoint2DArray(xArray, coordinateData.values, decimationFactor, xMin, xMax);
+                        values = this.widgetStore.smoothingStore.getPixelDecimatedPoint2DArray(xArray, coordinateData.values, numPixels, xMin, xMax);
                     }
                     smoothingValues = this.widgetStore.smoothingStore.getSmoothingPoint2DArray(xArray, coordinateData.values, xMin, xMax);
                 }
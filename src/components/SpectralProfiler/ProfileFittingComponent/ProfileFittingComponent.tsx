@@ -401,8 +401,12 @@ export class ProfileFittingComponent extends React.Component<ProfileFittingCompo
                             </FormGroup>
                         </div>
                         <div className="profile-fitting-footer">
-                            <AnchorButton text="Reset" intent={Intent.PRIMARY} onClick={this.reset} disabled={disabled} />
-                            <AnchorButton text="Fit" intent={Intent.PRIMARY} onClick={this.fitData} disabled={!fittingStore.readyToFit || disabled} />
+                            <AnchorButton text="Reset" intent={Intent.PRIMARY} onClick={this.reset} disabled={fittingStore.isFitting || disabled} />
+                            {fittingStore.isFitting ? (
+                                <AnchorButton text="Cancel" intent={Intent.WARNING} onClick={fittingStore.cancelFitting} />
+                            ) : (
+                                <AnchorButton text="Fit" intent={Intent.PRIMARY} onClick={this.fitData} disabled={!fittingStore.readyToFit || disabled} />
+                            )}
                             <Popover2
                                 isOpen={this.isShowingLog}
                                 onClose={this.handleLogClose}
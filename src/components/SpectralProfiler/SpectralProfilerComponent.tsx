@@ -62,6 +62,25 @@ export class SpectralProfilerComponent extends React.Component<WidgetProps> {
         return this.widgetStore.meanRmsVisible && this.plotData?.numProfiles === 1;
     }
 
+    // Profiles with more points than the plot has pixel columns are decimated to the first, min, max and last point of each column in the visible
+    // x range, which draws the same lines. The cursor info and exports still use the full resolution data
+    @computed get decimatedData(): Point2D[][] {
+        const plotData = this.plotData;
+        if (!plotData?.data || !(this.width > 0) || this.widgetStore.plotType === PlotType.POINTS) {
+            return plotData?.data;
+        }
+        const xMin = this.widgetStore.isAutoScaledX ? plotData.xMin : this.widgetStore.minX;
+        const xMax = this.widgetStore.isAutoScaledX ? plotData.xMax : this.widgetStore.maxX;
+        return plotData.data.map(data => {
+            if (!data || Math.round(data.length / this.width) <= 1) {
+                return data;
+            }
+            const x = data.map(point => point.x);
+            const y = Float64Array.from(data, point => point.y);
+            return this.widgetStore.smoothingStore.getPixelDecimatedPoint2DArray(x, y, this.width, xMin, xMax);
+        });
+    }
+
     constructor(props: WidgetProps) {
         super(props);
         makeObservable(this);
@@ -357,7 +376,8 @@ export class SpectralProfilerComponent extends React.Component<WidgetProps> {
                         linePlotProps.multiPlotPropsMap.set(`profile${i}`, {
                             imageName: imageName,
                             plotName: plotName,
-                            data: currentPlotData.data[i],
+                            data: this.decimatedData?.[i] ?? currentPlotData.data[i],
+                            fullResolutionData: currentPlotData.data[i],
                             type: this.widgetStore.plotType,
                             borderColor: currentPlotData.colors[i],
                             comments: currentPlotData.comments[i],
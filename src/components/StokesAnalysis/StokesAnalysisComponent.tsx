@@ -333,8 +333,7 @@ export class StokesAnalysisComponent extends React.Component<WidgetProps> {
             let uProfileOriginal = this.profileStore.getProfile(StokesCoordinate.LinearPolarizationU, statsType);
 
             if (qProfileOriginal && uProfileOriginal && qProfileOriginal.values && uProfileOriginal.values) {
-                let qProfileSmoothedValues = this.widgetStore.smoothingStore.getSmoothingValues(this.widgetStore.effectiveFrame.channelValues, qProfileOriginal.values);
-                let uProfileSmoothedValues = this.widgetStore.smoothingStore.getSmoothingValues(this.widgetStore.effectiveFrame.channelValues, uProfileOriginal.values);
+                let [qProfileSmoothedValues, uProfileSmoothedValues] = this.widgetStore.smoothingStore.getBatchSmoothingValues(this.widgetStore.effectiveFrame.channelValues, [qProfileOriginal.values, uProfileOriginal.values]);
                 let qProfile = [];
                 let uProfile = [];
                 let piProfile = [];
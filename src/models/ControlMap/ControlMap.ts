@@ -1,10 +1,51 @@
 import * as AST from "ast_wrapper";
+import LRUCacheWithDelete from "mnemonist/lru-cache-with-delete";
 
 import {Point2D} from "models";
 import {FrameStore} from "stores/Frame";
 import {GL2} from "utilities";
 
 export class ControlMap {
+    // Transform grids shared by control maps with the same source and destination WCS and extent. Grids are not modified once cached
+    private static readonly GridCacheCapacity = 16;
+    private static gridCache = new LRUCacheWithDelete<string, Float32Array>(ControlMap.GridCacheCapacity);
+    // Frames are numbered for the cache keys, as all PV preview frames share a file ID, and AST can reuse the WCS pointer of a closed frame
+    private static frameNumbers = new WeakMap<FrameStore, number>();
+    private static nextFrameNumber = 0;
+
+    // Key of the frame in the grid cache, which also changes with its WCS
+    private static FrameKey(frame: FrameStore): string {
+        let frameNumber = ControlMap.frameNumbers.get(frame);
+        if (frameNumber === undefined) {
+            frameNumber = ControlMap.nextFrameNumber++;
+            ControlMap.frameNumbers.set(frame, frameNumber);
+        }
+        return `${frameNumber}:${frame.wcsInfo}`;
+    }
+
+    // Removes the cached grids to or from the frame, when it or its preview is closed
+    static RemoveCachedGrids(frame: FrameStore | undefined) {
+        const frameNumber = frame ? ControlMap.frameNumbers.get(frame) : undefined;
+        if (frameNumber === undefined) {
+            return;
+        }
+        const keys: string[] = [];
+        const prefix = `${frameNumber}:`;
+        ControlMap.gridCache.forEach((_, key) => {
+            const [source, destination] = key.split("_");
+            if (source.startsWith(prefix) || destination.startsWith(prefix)) {
+                keys.push(key);
+            }
+        });
+        for (const key of keys) {
+            ControlMap.gridCache.delete(key);
+        }
+    }
+
+    static ClearCachedGrids() {
+        ControlMap.gridCache.clear();
+    }
+
     readonly source: FrameStore;
     readonly destination: FrameStore;
     readonly width: number;
@@ -35,8 +76,15 @@ export class ControlMap {
 
     setGrid = (astTransform?: AST.Mapping) => {
         let cleanUpTransform: boolean = false;
+        let cacheKey: string | null = null;
 
         if (!astTransform || astTransform < 0) {
+            cacheKey = `${ControlMap.FrameKey(this.source)}_${ControlMap.FrameKey(this.destination)}_${this.minPoint.x},${this.minPoint.y},${this.maxPoint.x},${this.maxPoint.y}_${this.width}x${this.height}`;
+            const cachedGrid = ControlMap.gridCache.get(cacheKey);
+            if (cachedGrid) {
+                this.grid = cachedGrid;
+                return;
+            }
             astTransform = AST.getSpatialMapping(this.source.wcsInfo, this.destination.wcsInfo);
             cleanUpTransform = true;
         }
@@ -46,6 +94,9 @@ export class ControlMap {
         if (cleanUpTransform) {
             AST.deleteObject(astTransform);
         }
+        if (cacheKey && this.grid) {
+            ControlMap.gridCache.set(cacheKey, this.grid);
+        }
     };
 
     getTextureX = (gl: WebGL2RenderingContext) => {
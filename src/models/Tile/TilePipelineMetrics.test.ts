@@ -0,0 +1,73 @@
+import {LatencyHistogram, TilePipelineMetrics, TilePipelineStage} from "./TilePipelineMetrics";
+
+describe("LatencyHistogram", () => {
+    test("ignores invalid latencies", () => {
+        const histogram = new LatencyHistogram();
+        histogram.add(NaN);
+        histogram.add(-1);
+        histogram.add(Infinity);
+        expect(histogram.count).toBe(0);
+        expect(histogram.percentile(50)).toBeNaN();
+    });
+
+    test("returns approximate percentiles within a factor of two", () => {
+        const histogram = new LatencyHistogram();
+        for (let i = 1; i <= 100; i++) {
+            histogram.add(i);
+        }
+        expect(histogram.count).toBe(100);
+        expect(histogram.mean).toBeCloseTo(50.5);
+        expect(histogram.percentile(50)).toBeGreaterThanOrEqual(50);
+        expect(histogram.percentile(50)).toBeLessThanOrEqual(100);
+        expect(histogram.percentile(100)).toBe(100);
+    });
+});
+
+describe("TilePipelineMetrics", () => {
+    test("aggregates segments once the texture is uploaded", () => {
+        const metrics = new TilePipelineMetrics(2);
+        metrics.mark(1, TilePipelineStage.RequestSent, 0);
+        metrics.mark(1, TilePipelineStage.BytesReceived, 40);
+        metrics.mark(1, TilePipelineStage.QueuedToWorker, 41);
+        metrics.mark(1, TilePipelineStage.DecompressStart, 42);
+        metrics.mark(1, TilePipelineStage.DecompressEnd, 46);
+        metrics.mark(1, TilePipelineStage.ReturnedToMain, 47);
+        metrics.mark(1, TilePipelineStage.UploadStart, 60);
+        expect(metrics.tileCount).toBe(0);
+        metrics.mark(1, TilePipelineStage.TextureUploaded, 61);
+        expect(metrics.tileCount).toBe(1);
+        expect(metrics.histograms.get("network").max).toBe(40);
+        expect(metrics.histograms.get("decompress").max).toBe(4);
+        expect(metrics.histograms.get("total").max).toBe(61);
+    });
+
+    test("skips segments with missing stages", () => {
+        const metrics = new TilePipelineMetrics();
+        metrics.mark(2, TilePipelineStage.QueuedToWorker, 0);
+        metrics.mark(2, TilePipelineStage.TextureUploaded, 10);
+        expect(metrics.histograms.get("network").count).toBe(0);
+        expect(metrics.histograms.get("total").count).toBe(0);
+    });
+
+    test("tracks worker throughput", () => {
+        const metrics = new TilePipelineMetrics(2);
+        metrics.addWorkerDecompression(1, 65536, 0, 2);
+        metrics.addWorkerDecompression(1, 65536, 10, 12);
+        metrics.addWorkerDecompression(5, 65536, 0, 2);
+        expect(metrics.workerThroughput[0].tiles).toBe(0);
+        expect(metrics.workerThroughput[1].tiles).toBe(2);
+        expect(metrics.summary().workers[1].mpixPerSecond).toBeCloseTo(32.77);
+        metrics.clear();
+        expect(metrics.workerThroughput[1].tiles).toBe(0);
+    });
+
+    test("describes the measured segments and workers", () => {
+        const metrics = new TilePipelineMetrics(2);
+        metrics.mark(3, TilePipelineStage.DecompressStart, 0);
+        metrics.mark(3, TilePipelineStage.DecompressEnd, 3);
+        metrics.mark(3, TilePipelineStage.UploadStart, 10);
+        metrics.mark(3, TilePipelineStage.TextureUploaded, 11);
+        metrics.addWorkerDecompression(0, 65536, 0, 2);
+        expect(TilePipelineMetrics.Describe(metrics.summary())).toBe("Tile pipeline (0 tiles), p50/p95 latency in ms: decompress 3/3, upload 1/1. Worker throughput in Mpix/s: 32.77, -");
+    });
+});
@@ -0,0 +1,188 @@
+// Stages of the tile pipeline, in the order in which a tile passes through them
+export enum TilePipelineStage {
+    RequestSent,
+    BytesReceived,
+    QueuedToWorker,
+    DecompressStart,
+    DecompressEnd,
+    ReturnedToMain,
+    UploadStart,
+    TextureUploaded
+}
+
+const NUM_STAGES = 8;
+
+// Pipeline segments, each measured between two stages. Tiles served from the compressed cache have no network segment
+export const TILE_PIPELINE_SEGMENTS: {name: string; start: TilePipelineStage; end: TilePipelineStage}[] = [
+    {name: "network", start: TilePipelineStage.RequestSent, end: TilePipelineStage.BytesReceived},
+    {name: "dispatch", start: TilePipelineStage.BytesReceived, end: TilePipelineStage.QueuedToWorker},
+    {name: "workerQueue", start: TilePipelineStage.QueuedToWorker, end: TilePipelineStage.DecompressStart},
+    {name: "decompress", start: TilePipelineStage.DecompressStart, end: TilePipelineStage.DecompressEnd},
+    {name: "workerReturn", start: TilePipelineStage.DecompressEnd, end: TilePipelineStage.ReturnedToMain},
+    {name: "renderWait", start: TilePipelineStage.ReturnedToMain, end: TilePipelineStage.UploadStart},
+    {name: "upload", start: TilePipelineStage.UploadStart, end: TilePipelineStage.TextureUploaded},
+    {name: "total", start: TilePipelineStage.RequestSent, end: TilePipelineStage.TextureUploaded}
+];
+
+// Latency histogram with logarithmic bins, from 1/16 ms up to about 30 s
+export class LatencyHistogram {
+    public static readonly MinLatency = 1 / 16;
+    public static readonly NumBins = 20;
+
+    readonly bins: Uint32Array;
+    count: number;
+    sum: number;
+    max: number;
+
+    constructor() {
+        this.bins = new Uint32Array(LatencyHistogram.NumBins);
+        this.count = 0;
+        this.sum = 0;
+        this.max = 0;
+    }
+
+    // Upper edge of the given bin, in ms
+    public static BinUpperEdge(bin: number) {
+        return LatencyHistogram.MinLatency * 2 ** bin;
+    }
+
+    add(latency: number) {
+        if (!isFinite(latency) || latency < 0) {
+            return;
+        }
+        const bin = latency <= LatencyHistogram.MinLatency ? 0 : Math.ceil(Math.log2(latency / LatencyHistogram.MinLatency));
+        this.bins[Math.min(bin, LatencyHistogram.NumBins - 1)]++;
+        this.count++;
+        this.sum += latency;
+        this.max = Math.max(this.max, latency);
+    }
+
+    get mean() {
+        return this.count ? this.sum / this.count : NaN;
+    }
+
+    // Approximate percentile (0 - 100), given as the upper edge of the bin it falls into
+    percentile(p: number) {
+        if (!this.count) {
+            return NaN;
+        }
+        const target = Math.max(1, Math.ceil((p / 100) * this.count));
+        let cumulative = 0;
+        for (let i = 0; i < this.bins.length; i++) {
+            cumulative += this.bins[i];
+            if (cumulative >= target) {
+                return Math.min(LatencyHistogram.BinUpperEdge(i), this.max);
+            }
+        }
+        return this.max;
+    }
+
+    clear() {
+        this.bins.fill(0);
+        this.count = 0;
+        this.sum = 0;
+        this.max = 0;
+    }
+}
+
+// Latencies are in ms, and worker throughput in megapixels per second. Values are null if nothing was measured
+export interface TilePipelineSummary {
+    latency: {[segment: string]: {count: number; mean: number | null; p50: number | null; p95: number | null}};
+    workers: {tiles: number; mpixPerSecond: number | null}[];
+}
+
+export interface WorkerThroughput {
+    tiles: number;
+    pixels: number;
+    // Total time spent decompressing, in ms
+    busyTime: number;
+}
+
+// Collects per-tile timestamps for each stage of the tile pipeline, and aggregates completed tiles into latency histograms per segment.
+// Timestamps are absolute (performance.timeOrigin + performance.now()), so that timestamps taken in workers can be compared with those of the main thread
+export class TilePipelineMetrics {
+    // Tiles that are never uploaded (e.g. evicted or no longer visible) are dropped once this limit is reached, oldest first
+    public static readonly MaxPendingTiles = 4096;
+
+    readonly histograms: Map<string, LatencyHistogram>;
+    readonly workerThroughput: WorkerThroughput[];
+    private readonly pendingTiles: Map<number, Float64Array>;
+
+    public static Now() {
+        return performance.timeOrigin + performance.now();
+    }
+
+    constructor(numWorkers: number = 0) {
+        this.histograms = new Map<string, LatencyHistogram>(TILE_PIPELINE_SEGMENTS.map(segment => [segment.name, new LatencyHistogram()]));
+        this.workerThroughput = Array.from({length: numWorkers}, () => ({tiles: 0, pixels: 0, busyTime: 0}));
+        this.pendingTiles = new Map<number, Float64Array>();
+    }
+
+    // Records the time at which the tile reached the given stage. Requesting a tile again restarts its timeline
+    mark(tileKey: number, stage: TilePipelineStage, time: number = TilePipelineMetrics.Now()) {
+        let timestamps = this.pendingTiles.get(tileKey);
+        if (!timestamps || stage === TilePipelineStage.RequestSent) {
+            if (!timestamps && this.pendingTiles.size >= TilePipelineMetrics.MaxPendingTiles) {
+                this.pendingTiles.delete(this.pendingTiles.keys().next().value);
+            }
+            timestamps = new Float64Array(NUM_STAGES).fill(NaN);
+            this.pendingTiles.set(tileKey, timestamps);
+        }
+        timestamps[stage] = time;
+
+        if (stage === TilePipelineStage.TextureUploaded) {
+            for (const segment of TILE_PIPELINE_SEGMENTS) {
+                const latency = timestamps[segment.end] - timestamps[segment.start];
+                if (isFinite(latency)) {
+                    this.histograms.get(segment.name)?.add(latency);
+                }
+            }
+            this.pendingTiles.delete(tileKey);
+        }
+    }
+
+    addWorkerDecompression(workerIndex: number, pixels: number, decompressStart: number, decompressEnd: number) {
+        const throughput = this.workerThroughput[workerIndex];
+        if (throughput && isFinite(decompressEnd - decompressStart)) {
+            throughput.tiles++;
+            throughput.pixels += pixels;
+            throughput.busyTime += decompressEnd - decompressStart;
+        }
+    }
+
+    get tileCount() {
+        return this.histograms.get("total")?.count ?? 0;
+    }
+
+    // One-line description of a summary for the log, with the median and 95th percentile latency of each measured segment
+    public static Describe(summary: TilePipelineSummary) {
+        const format = (val: number | null) => (val === null ? "-" : val.toString());
+        const segments = TILE_PIPELINE_SEGMENTS.filter(segment => summary.latency[segment.name]?.count).map(segment => {
+            const latency = summary.latency[segment.name];
+            return `${segment.name} ${format(latency.p50)}/${format(latency.p95)}`;
+        });
+        const workers = summary.workers.map(worker => format(worker.mpixPerSecond));
+        return `Tile pipeline (${summary.latency.total?.count ?? 0} tiles), p50/p95 latency in ms: ${segments.join(", ")}. Worker throughput in Mpix/s: ${workers.join(", ")}`;
+    }
+
+    // Summary of the mean, median and 95th percentile latency (in ms) of each segment, and of each worker's throughput (in megapixels per second)
+    summary(): TilePipelineSummary {
+        const round = (val: number) => (isFinite(val) ? Math.round(val * 100) / 100 : null);
+        const latency: TilePipelineSummary["latency"] = {};
+        this.histograms.forEach((histogram, name) => {
+            latency[name] = {count: histogram.count, mean: round(histogram.mean), p50: round(histogram.percentile(50)), p95: round(histogram.percentile(95))};
+        });
+        const workers = this.workerThroughput.map(worker => ({tiles: worker.tiles, mpixPerSecond: round(worker.busyTime > 0 ? worker.pixels / worker.busyTime / 1e3 : NaN)}));
+        return {latency, workers};
+    }
+
+    clear() {
+        this.histograms.forEach(histogram => histogram.clear());
+        for (const worker of this.workerThroughput) {
+            worker.tiles = 0;
+            worker.pixels = 0;
+            worker.busyTime = 0;
+        }
+        this.pendingTiles.clear();
+    }
+}
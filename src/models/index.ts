@@ -25,6 +25,7 @@ export * from "./StatisticsDefinition/StatisticsDefinition";
 export * from "./Theme/Theme";
 export * from "./Tile/TileCache";
 export * from "./Tile/TileCoordinate";
+export * from "./Tile/TilePipelineMetrics";
 export * from "./Transform2D/Transform2D";
 export * from "./TypeDefinition/TypeDefinition";
 export * from "./Wcs/WCSMatchingType";
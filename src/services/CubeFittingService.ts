@@ -0,0 +1,149 @@
+import GSLWorker from "!worker-loader!gsl_wrapper";
+
+import {BatchFittingResult, MergeBatchResults, PartitionRows, RowBlock} from "utilities";
+
+interface PendingCubeFit {
+    blocks: {block: RowBlock; result: BatchFittingResult | null}[];
+    remainingBlocks: number;
+    width: number;
+    height: number;
+    numComponents: number;
+    resolve: (result: BatchFittingResult) => void;
+    reject: (error: Error) => void;
+}
+
+// Fits a model to every pixel of a region of a cube, splitting the rows of the region across GSL workers. The caller supplies the spectra of the region;
+// the frontend does not hold cube data, so nothing in the UI calls this yet
+export class CubeFittingService {
+    private static staticInstance: CubeFittingService;
+
+    private static readonly MaxWorkers = 4;
+    // Workers that have not loaded the GSL module after this time, in ms, are considered failed
+    private static readonly ReadyTimeout = 10000;
+
+    private workers: Worker[];
+    private workersReady: Promise<void>[];
+    private requestCounter: number;
+    private readonly pendingFits: Map<number, PendingCubeFit>;
+
+    static get Instance() {
+        if (!CubeFittingService.staticInstance) {
+            CubeFittingService.staticInstance = new CubeFittingService();
+        }
+        return CubeFittingService.staticInstance;
+    }
+
+    private constructor() {
+        this.workers = [];
+        this.workersReady = [];
+        this.requestCounter = 0;
+        this.pendingFits = new Map<number, PendingCubeFit>();
+    }
+
+    // Workers are only started when the first cube fit is requested. Their ready promises are rejected if a worker fails to load the GSL module
+    private startWorkers() {
+        if (this.workers.length) {
+            return;
+        }
+        const numWorkers = Math.min(navigator.hardwareConcurrency || CubeFittingService.MaxWorkers, CubeFittingService.MaxWorkers);
+        for (let i = 0; i < numWorkers; i++) {
+            const worker: Worker = new GSLWorker();
+            this.workersReady.push(
+                new Promise<void>((resolve, reject) => {
+                    const timeout = setTimeout(() => reject(new Error("GSL worker did not start")), CubeFittingService.ReadyTimeout);
+                    worker.onmessage = (event: MessageEvent) => {
+                        if (event.data[0] === "ready") {
+                            clearTimeout(timeout);
+                            resolve();
+                        } else if (event.data[0] === "fit batch") {
+                            this.handleBlockResult(event.data[1], event.data[2]);
+                        }
+                    };
+                    worker.onerror = (event: ErrorEvent) => {
+                        clearTimeout(timeout);
+                        const error = new Error(`GSL worker failed: ${event.message}`);
+                        reject(error);
+                        // errors from workers that have already been replaced are ignored
+                        if (this.workers.includes(worker)) {
+                            this.stopWorkers(error);
+                        }
+                    };
+                })
+            );
+            this.workers.push(worker);
+        }
+    }
+
+    // Terminates the workers and rejects all pending fits, so that the next fit starts new workers
+    private stopWorkers(error: Error) {
+        this.workers.forEach(worker => worker.terminate());
+        this.workers = [];
+        this.workersReady = [];
+        this.pendingFits.forEach(pending => pending.reject(error));
+        this.pendingFits.clear();
+    }
+
+    // Fits spectra stored pixel by pixel (in raster order, with N = x.length channels per pixel) of a region of the given width and height.
+    // initialInputs and lockedInputs are [amp1, center1, fwhm1, amp2, ..., yIntercept, slope]. If seedFromNeighbour is set,
+    // each pixel starts from the fit of its left or upper neighbour in the same block of rows
+    fitCube = async (
+        functionType: number,
+        x: Float64Array | number[],
+        spectra: Float32Array | Float64Array,
+        width: number,
+        height: number,
+        initialInputs: number[],
+        lockedInputs: number[],
+        seedFromNeighbour: boolean = true
+    ): Promise<BatchFittingResult> => {
+        const numComponents = (initialInputs.length - 2) / 3;
+        const N = x.length;
+        this.startWorkers();
+        try {
+            await Promise.all(this.workersReady);
+        } catch (error) {
+            this.stopWorkers(error as Error);
+            throw error;
+        }
+
+        const rowBlocks = PartitionRows(height, this.workers.length);
+        const requestId = this.requestCounter++;
+        return new Promise<BatchFittingResult>((resolve, reject) => {
+            const pending: PendingCubeFit = {blocks: rowBlocks.map(block => ({block, result: null})), remainingBlocks: rowBlocks.length, width, height, numComponents, resolve, reject};
+            this.pendingFits.set(requestId, pending);
+            if (!rowBlocks.length) {
+                this.completeFit(requestId, pending);
+                return;
+            }
+
+            rowBlocks.forEach((block, blockIndex) => {
+                const blockSpectra = spectra.slice(block.rowStart * width * N, block.rowEnd * width * N);
+                this.workers[blockIndex % this.workers.length].postMessage(
+                    [
+                        "fit batch",
+                        blockSpectra.buffer,
+                        {requestId, blockIndex, functionType, x: Array.from(x), width, initialInputs, lockedInputs, seedFromNeighbour, isFloat32: blockSpectra instanceof Float32Array}
+                    ],
+                    [blockSpectra.buffer]
+                );
+            });
+        });
+    };
+
+    private handleBlockResult = (result: BatchFittingResult | null, args: {requestId: number; blockIndex: number}) => {
+        const pending = this.pendingFits.get(args.requestId);
+        if (!pending || !pending.blocks[args.blockIndex]) {
+            return;
+        }
+        pending.blocks[args.blockIndex].result = result;
+        pending.remainingBlocks--;
+        if (pending.remainingBlocks <= 0) {
+            this.completeFit(args.requestId, pending);
+        }
+    };
+
+    private completeFit(requestId: number, pending: PendingCubeFit) {
+        this.pendingFits.delete(requestId);
+        pending.resolve(MergeBatchResults(pending.blocks, pending.width, pending.height, pending.numComponents));
+    }
+}
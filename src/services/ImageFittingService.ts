@@ -0,0 +1,111 @@
+import GSLWorker from "!worker-loader!gsl_wrapper";
+
+import {Point2D} from "models";
+
+// Result of fitting 2D Gaussians to a block of image pixels, with parameters and errors laid out as [centerX1, centerY1, amp1, fwhmX1, fwhmY1, pa1,
+// centerX2, ..., offset], and the summary of the fit. A status of 0 means that the fit converged
+export interface ImageFittingResult {
+    parameters: Float64Array;
+    errors: Float64Array;
+    status: number;
+    stopReason: number;
+    iterations: number;
+    numData: number;
+    elapsedTime: number;
+}
+
+// Fits 2D Gaussians to small blocks of image pixels (e.g. from the cached tiles) in a GSL worker, as a quick preview of the image fit of the backend
+export class ImageFittingService {
+    private static staticInstance: ImageFittingService;
+
+    // Preview fits are stopped after this time, in ms
+    public static readonly TimeLimit = 2000;
+    // The worker is considered failed if it has not loaded the GSL module after this time, in ms
+    private static readonly ReadyTimeout = 10000;
+
+    private worker: Worker | null;
+    private workerReady: Promise<void> | null;
+    private requestCounter: number;
+    private readonly pendingFits: Map<number, {resolve: (result: ImageFittingResult | null) => void; reject: (error: Error) => void}>;
+
+    static get Instance() {
+        if (!ImageFittingService.staticInstance) {
+            ImageFittingService.staticInstance = new ImageFittingService();
+        }
+        return ImageFittingService.staticInstance;
+    }
+
+    private constructor() {
+        this.worker = null;
+        this.workerReady = null;
+        this.requestCounter = 0;
+        this.pendingFits = new Map<number, {resolve: (result: ImageFittingResult | null) => void; reject: (error: Error) => void}>();
+    }
+
+    // The worker is only started when the first preview fit is requested. The ready promise is rejected if the worker fails to load the GSL module
+    private startWorker(): Promise<void> {
+        if (!this.workerReady) {
+            const worker: Worker = new GSLWorker();
+            this.workerReady = new Promise<void>((resolve, reject) => {
+                const timeout = setTimeout(() => reject(new Error("GSL worker did not start")), ImageFittingService.ReadyTimeout);
+                worker.onmessage = (event: MessageEvent) => {
+                    if (event.data[0] === "ready") {
+                        clearTimeout(timeout);
+                        resolve();
+                    } else if (event.data[0] === "fit image") {
+                        this.handleResult(event.data[1], event.data[2]);
+                    }
+                };
+                worker.onerror = (event: ErrorEvent) => {
+                    clearTimeout(timeout);
+                    const error = new Error(`GSL worker failed: ${event.message}`);
+                    reject(error);
+                    // errors from a worker that has already been replaced are ignored
+                    if (this.worker === worker) {
+                        this.stopWorker(error);
+                    }
+                };
+            });
+            this.worker = worker;
+        }
+        return this.workerReady;
+    }
+
+    // Terminates the worker and rejects all pending fits, so that the next fit starts a new worker
+    private stopWorker(error: Error) {
+        this.worker?.terminate();
+        this.worker = null;
+        this.workerReady = null;
+        this.pendingFits.forEach(pending => pending.reject(error));
+        this.pendingFits.clear();
+    }
+
+    // Fits a width x height block of pixels in raster order, whose first pixel is at the given image coordinates. initialInputs and lockedInputs are
+    // [centerX1, centerY1, amp1, fwhmX1, fwhmY1, pa1, centerX2, ..., offset]. NaN pixels, and pixels where the mask is 0 if given, are left out.
+    // The pixel and mask buffers are transferred to the worker. Resolves to null if the inputs are invalid, and rejects if the worker fails
+    fitImage = async (data: Float32Array, width: number, height: number, origin: Point2D, initialInputs: number[], lockedInputs: number[], mask: Uint8Array | null = null): Promise<ImageFittingResult | null> => {
+        try {
+            await this.startWorker();
+        } catch (error) {
+            this.stopWorker(error as Error);
+            throw error;
+        }
+        const requestId = this.requestCounter++;
+        return new Promise<ImageFittingResult | null>((resolve, reject) => {
+            this.pendingFits.set(requestId, {resolve, reject});
+            const transfer = mask ? [data.buffer, mask.buffer] : [data.buffer];
+            this.worker?.postMessage(
+                ["fit image", data.buffer, {requestId, width, height, origin, initialInputs, lockedInputs, mask: mask?.buffer ?? null, timeLimit: ImageFittingService.TimeLimit}],
+                transfer
+            );
+        });
+    };
+
+    private handleResult = (result: ImageFittingResult | null, args: {requestId: number}) => {
+        const pending = this.pendingFits.get(args.requestId);
+        if (pending) {
+            this.pendingFits.delete(args.requestId);
+            pending.resolve(result);
+        }
+    };
+}
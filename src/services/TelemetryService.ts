@@ -26,7 +26,8 @@ export enum TelemetryAction {
     SpectralProfileGeneration = "spectralProfileGeneration",
     PvGeneration = "pvGeneration",
     MomentGeneration = "momentGeneration",
-    CatalogLoading = "catalogLoading"
+    CatalogLoading = "catalogLoading",
+    TilePipeline = "tilePipeline"
 }
 
 export interface TelemetryMessage {
@@ -267,6 +268,14 @@ export class TelemetryService {
         return this.addTelemetryEntry(TelemetryAction.FileClose, {id});
     }
 
+    // Tile pipeline latency and worker throughput summary, as returned by TileService.flushPipelineMetrics
+    addTilePipelineEntry(summary?: object) {
+        if (summary) {
+            return this.addTelemetryEntry(TelemetryAction.TilePipeline, summary);
+        }
+        return undefined;
+    }
+
     addSpectralProfileEntry(profileLength: number, regionType: CARTA.RegionType, regionId: number, width: number, height: number, depth: number) {
         switch (regionType) {
             case CARTA.RegionType.POINT:
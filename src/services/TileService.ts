@@ -3,10 +3,10 @@ import LRUCache from "mnemonist/lru-cache";
 import {action, computed, makeObservable, observable} from "mobx";
 import {Subject} from "rxjs";
 
-import {Point2D, TileCoordinate} from "models";
+import {FrameView, Point2D, TileCoordinate, TilePipelineMetrics, TilePipelineStage} from "models";
 import {BackendService, TileWebGLService} from "services";
 import {AppStore, PREVIEW_PV_FILEID} from "stores";
-import {copyToFP32Texture, createFP32Texture, GL2} from "utilities";
+import {copyToFP32Texture, createFP32Texture, GetPrefetchTiles, GL2} from "utilities";
 
 import ZFPWorker from "!worker-loader!zfp_wrapper";
 
@@ -15,13 +15,45 @@ export interface RasterTile {
     width: number | null | undefined;
     height: number | null | undefined;
     textureCoordinate: number | undefined;
+    // Set for low-precision placeholder tiles, which are refined in place once the full-precision tile arrives
+    coarse?: boolean;
 }
 
+// Tile codecs supported by the decompression workers (must match TileCodec in zfp_wrapper.c). Lossless Zstd tiles are not part of the
+// protocol's CompressionType enum yet, so streamed tiles are always decoded as ZFP until the backend can be asked for them
+export enum TileCodec {
+    ZFP = 0,
+    ZSTD = 1
+}
+
+// Delta filters for lossless tiles, which are Zstd-compressed and byte-shuffled (must match LosslessFilter in zfp_wrapper.c)
+export enum LosslessFilter {
+    NONE = 0,
+    XOR_DELTA = 1,
+    BYTE_DELTA = 2
+}
+
+// Compressed tiles are cached in the linear memory of the ZFP worker that first decoded them
 export interface CompressedTile {
-    tile: CARTA.ITileData;
+    workerIndex: number;
+    codec: TileCodec;
+    width: number | null | undefined;
+    height: number | null | undefined;
+    layer: number | null | undefined;
     compressionQuality: number | null | undefined;
 }
 
+// Only prefetched tiles are counted, so that the hit rate measures how many of them were actually required
+export interface PrefetchMetrics {
+    requested: number;
+    // Prefetched tiles that were later required
+    hits: number;
+    // Prefetched tiles that arrived, but were dropped without being required
+    misses: number;
+    // Prefetched tiles that were cancelled while still in flight
+    cancelled: number;
+}
+
 export interface TileStreamDetails {
     tileCount: number | undefined;
     fileId: number | null | undefined;
@@ -33,6 +65,23 @@ export interface TileStreamDetails {
 export const TEXTURE_SIZE = 4096;
 export const TILE_SIZE = 256;
 export const MAX_TEXTURES = 8;
+// Maximum number of texture slots reserved for the back buffer of synchronised channel updates (e.g. during animation)
+export const BACK_BUFFER_TILES = 256;
+// Minimum number of missing tiles in a single request before coarse parent tiles are requested first
+export const PROGRESSIVE_TILE_THRESHOLD = 8;
+export const COARSE_TILE_COMPRESSION_QUALITY = 6;
+// Compressed cache budget per tile of the system tile cache preference, assuming an average of one byte per pixel.
+// The budget is shared by all workers, and counts the compressed data and NaN encodings of each cached tile
+export const COMPRESSED_TILE_CACHE_BYTES_PER_TILE = TILE_SIZE * TILE_SIZE;
+// Default prefetch budget: maximum number of compressed bytes of prefetched tiles in flight, and the GPU tile cache memory that prefetched tiles
+// may occupy. Prefetched tiles never take up more than half of the GPU tile cache
+export const PREFETCH_BANDWIDTH_BYTES = 2 * 1024 * 1024;
+export const PREFETCH_CACHE_BYTES = 64 * 1024 * 1024;
+// GPU memory of each tile in the tile textures
+export const GPU_TILE_BYTES = TILE_SIZE * TILE_SIZE * 4;
+// Pan velocity is extrapolated over this period (in ms) to find the tiles required next
+export const PREFETCH_LOOKAHEAD_TIME = 500;
+const PAN_VELOCITY_TIMEOUT = 1000;
 
 interface TileMessageArgs {
     width: number | null | undefined;
@@ -47,6 +96,12 @@ interface TileMessageArgs {
     compression?: number | null;
     nanEncodings?: Int32Array;
     syncId?: number | null;
+    cache?: boolean;
+    codec?: TileCodec;
+    decompressStart?: number;
+    decompressEnd?: number;
+    // Set by the worker when asked to cache the tile: the number of bytes cached, or 0 if the tile could not be cached
+    cachedBytes?: number;
 }
 
 export class TileService {
@@ -60,16 +115,25 @@ export class TileService {
     }
 
     private readonly backendService: BackendService;
-    private readonly cacheMapCompressedTiles: Map<number, LRUCache<number, CompressedTile>>;
-    private readonly pendingRequests: Map<string, Map<number, boolean>>;
+    private readonly cacheMapCompressedTiles: Map<number, Map<number, CompressedTile>>;
+    // Size of each compressed tile in the worker caches by tile key (encoded coordinate including the file ID), from least to most recently used
+    private readonly compressedTileUsage: Map<number, number>;
+    // Compressed tiles sent to a worker to be cached, by tile key. They are only added to the cache map once the worker has stored them
+    private readonly pendingCacheStores: Map<number, {requestId: number; entry: CompressedTile}>;
+    private compressedCacheBudget: number;
+    private compressedCacheBytes: number;
+    // Pending tile requests, along with the compression quality at which they were requested
+    private readonly pendingRequests: Map<string, Map<number, number>>;
     private readonly pendingDecompressions: Map<string, Map<number, Map<number, boolean>>>;
     private readonly channelMap: Map<number, {channel: number | null | undefined; stokes: number | null | undefined}>;
     private readonly completedChannels: Map<string, boolean>;
+    private readonly fileCompressionQuality: Map<number, number>;
     readonly tileStream: Subject<TileStreamDetails>;
     private cachedTiles: LRUCache<number, RasterTile>;
-    private lruCapacitySystem: number;
     private textureArray: Array<WebGLTexture | null>;
     private textureCoordinateQueue: Array<number | undefined>;
+    // Texture slots reserved for synchronised tiles, which are uploaded as they arrive while the previous channel is still displayed
+    private backBufferQueue: Array<number | undefined>;
     private readonly workers: Worker[];
     private compressionRequestCounter: number;
     private pendingSynchronisedTiles: Map<string, Set<number>>;
@@ -78,6 +142,18 @@ export class TileService {
     private readonly gl: WebGL2RenderingContext | null;
     private syncIdMap: Map<number, boolean>;
     private syncIdTileCountMap: Map<number, number>;
+    // Prefetched tiles still in flight, along with their compression quality, and prefetched tiles that have arrived but not been displayed yet
+    private readonly pendingPrefetches: Map<string, Map<number, number>>;
+    private readonly prefetchedTiles: Map<string, Set<number>>;
+    // Pending reads of cached tiles back to the main thread, by request ID
+    private readonly pendingCacheReads: Map<number, (tile: RasterTile | null) => void>;
+    private readonly viewHistory: Map<number, {center: Point2D; mip: number; time: number; velocity: Point2D}>;
+    private prefetchBandwidthBytes: number;
+    private prefetchCacheBytes: number;
+    // Running average of the compressed size of received tiles, used to estimate the size of tiles in flight
+    private averageTileBytes: number;
+    readonly prefetchMetrics: PrefetchMetrics;
+    readonly pipelineMetrics: TilePipelineMetrics;
 
     @observable remainingTiles: number;
     @observable workersReady: boolean[];
@@ -130,26 +206,56 @@ export class TileService {
         this.textureArray = new Array<WebGLTexture>(numTextures);
         this.initTextures();
         this.resetCoordinateQueue();
-        this.cachedTiles = new LRUCache<number, RasterTile>(Float64Array, ArrayBuffer, lruCapacityGPU);
+        this.cachedTiles = new LRUCache<number, RasterTile>(Float64Array, ArrayBuffer, lruCapacityGPU - this.backBufferQueue.length);
+
+        // L2 cache: compressed tiles in the ZFP workers' memory. The budget is tracked globally, with least recently used tiles evicted from
+        // whichever worker holds them, so each worker may use all of it
+        this.compressedCacheBudget = lruCapacitySystem * COMPRESSED_TILE_CACHE_BYTES_PER_TILE;
+        for (const worker of this.workers) {
+            worker.postMessage(["cache budget", this.compressedCacheBudget]);
+        }
+        this.evictCompressedTiles();
+    };
 
-        // L2 cache: compressed tiles on system memory
-        this.lruCapacitySystem = lruCapacitySystem;
+    public setPrefetchBudget = (bandwidthBytes: number, cacheBytes: number) => {
+        this.prefetchBandwidthBytes = Math.max(0, bandwidthBytes);
+        this.prefetchCacheBytes = Math.max(0, cacheBytes);
     };
 
+    // Fraction of the prefetched tiles that were required, out of those that have been used, dropped or cancelled
+    get prefetchHitRate() {
+        const total = this.prefetchMetrics.hits + this.prefetchMetrics.misses + this.prefetchMetrics.cancelled;
+        return total ? this.prefetchMetrics.hits / total : 0;
+    }
+
     private constructor() {
         makeObservable(this);
         this.backendService = BackendService.Instance;
         this.gl = TileWebGLService.Instance.gl;
 
         this.channelMap = new Map<number, {channel: number; stokes: number}>();
-        this.pendingRequests = new Map<string, Map<number, boolean>>();
-        this.cacheMapCompressedTiles = new Map<number, LRUCache<number, CompressedTile>>();
+        this.pendingRequests = new Map<string, Map<number, number>>();
+        this.cacheMapCompressedTiles = new Map<number, Map<number, CompressedTile>>();
+        this.compressedTileUsage = new Map<number, number>();
+        this.pendingCacheStores = new Map<number, {requestId: number; entry: CompressedTile}>();
+        this.compressedCacheBudget = Infinity;
+        this.compressedCacheBytes = 0;
         this.pendingDecompressions = new Map<string, Map<number, Map<number, boolean>>>();
         this.completedChannels = new Map<string, boolean>();
+        this.fileCompressionQuality = new Map<number, number>();
         this.receivedSynchronisedTiles = new Map<string, Map<number, Map<number, RasterTile>>>();
         this.pendingSynchronisedTiles = new Map<string, Set<number>>();
         this.syncIdMap = new Map<number, boolean>();
         this.syncIdTileCountMap = new Map<number, number>();
+        this.backBufferQueue = [];
+        this.pendingPrefetches = new Map<string, Map<number, number>>();
+        this.prefetchedTiles = new Map<string, Set<number>>();
+        this.pendingCacheReads = new Map<number, (tile: RasterTile | null) => void>();
+        this.viewHistory = new Map<number, {center: Point2D; mip: number; time: number; velocity: Point2D}>();
+        this.prefetchBandwidthBytes = PREFETCH_BANDWIDTH_BYTES;
+        this.prefetchCacheBytes = PREFETCH_CACHE_BYTES;
+        this.averageTileBytes = COMPRESSED_TILE_CACHE_BYTES_PER_TILE;
+        this.prefetchMetrics = {requested: 0, hits: 0, misses: 0, cancelled: 0};
 
         this.compressionRequestCounter = 0;
         this.remainingTiles = 0;
@@ -160,6 +266,7 @@ export class TileService {
         this.backendService.rasterSyncStream.subscribe(this.handleStreamSync);
         this.workers = new Array<Worker>(Math.min(navigator.hardwareConcurrency || 4, 4));
         this.workersReady = new Array<boolean>(this.workers.length);
+        this.pipelineMetrics = new TilePipelineMetrics(this.workers.length);
 
         for (let i = 0; i < this.workers.length; i++) {
             this.workers[i] = new ZFPWorker();
@@ -171,7 +278,22 @@ export class TileService {
                     const eventArgs = event.data[2] as TileMessageArgs;
                     const length = (eventArgs.width ?? NaN) * (eventArgs.subsetHeight ?? NaN);
                     const resultArray = new Float32Array(buffer, 0, length);
-                    this.updateStream(eventArgs.fileId, eventArgs.channel, eventArgs.stokes, resultArray, eventArgs.width, eventArgs.subsetHeight, eventArgs.layer, eventArgs.tileCoordinate, eventArgs.syncId);
+                    const coarse = eventArgs.codec !== TileCodec.ZSTD && this.isCoarseQuality(eventArgs.fileId, eventArgs.compression);
+                    const tileKey = TileCoordinate.AddFileId(eventArgs.tileCoordinate, eventArgs.fileId);
+                    this.pipelineMetrics.mark(tileKey, TilePipelineStage.DecompressStart, eventArgs.decompressStart ?? NaN);
+                    this.pipelineMetrics.mark(tileKey, TilePipelineStage.DecompressEnd, eventArgs.decompressEnd ?? NaN);
+                    this.pipelineMetrics.mark(tileKey, TilePipelineStage.ReturnedToMain);
+                    this.pipelineMetrics.addWorkerDecompression(i, length, eventArgs.decompressStart ?? NaN, eventArgs.decompressEnd ?? NaN);
+                    if (eventArgs.cachedBytes !== undefined) {
+                        this.handleCacheStore(eventArgs);
+                    }
+                    this.updateStream(eventArgs.fileId, eventArgs.channel, eventArgs.stokes, resultArray, eventArgs.width, eventArgs.subsetHeight, eventArgs.layer, eventArgs.tileCoordinate, eventArgs.syncId, coarse);
+                } else if (event.data[0] === "evicted") {
+                    this.handleEvictedTiles(i, new Int32Array(event.data[1]));
+                } else if (event.data[0] === "cache miss") {
+                    this.handleCacheMiss(event.data[1] as TileMessageArgs);
+                } else if (event.data[0] === "read cached") {
+                    this.handleCacheRead(event.data[1] as ArrayBuffer | null, event.data[2] as TileMessageArgs);
                 } else if (event.data[0] === "preview decompress") {
                     const buffer = event.data[1];
                     const eventArgs = event.data[2];
@@ -193,6 +315,35 @@ export class TileService {
         for (let i = 0; i < totalTiles; i++) {
             this.textureCoordinateQueue[i] = totalTiles - 1 - i;
         }
+
+        // The back buffer is taken out of the GPU cache capacity, so that the cache never runs out of texture slots
+        const numBackBufferTiles = Math.min(BACK_BUFFER_TILES, Math.floor(totalTiles / 4));
+        this.backBufferQueue = this.textureCoordinateQueue.splice(totalTiles - numBackBufferTiles, numBackBufferTiles);
+    }
+
+    // Returns the back buffer slots of synchronised tiles that will not be displayed
+    private releaseSynchronisedTiles(tiles: Map<number, RasterTile> | undefined) {
+        tiles?.forEach(tile => {
+            if (tile.textureCoordinate !== undefined && tile.textureCoordinate >= 0) {
+                this.backBufferQueue.push(tile.textureCoordinate);
+                tile.textureCoordinate = -1;
+            }
+        });
+    }
+
+    // Drops incomplete synchronised updates of the file that are older than the given sync ID, as they have been superseded
+    private releaseStaleSynchronisedTiles(fileId: number | null | undefined, syncId: number = Infinity) {
+        const fileKey = `${fileId}_`;
+        this.receivedSynchronisedTiles.forEach((syncMap, key) => {
+            if (key.startsWith(fileKey)) {
+                syncMap.forEach((tiles, id) => {
+                    if (id < syncId) {
+                        this.releaseSynchronisedTiles(tiles);
+                        syncMap.delete(id);
+                    }
+                });
+            }
+        });
     }
 
     private getCompressedCache(fileId: number) {
@@ -200,12 +351,73 @@ export class TileService {
         if (cache) {
             return cache;
         } else {
-            const newCache = new LRUCache<number, CompressedTile>(Float64Array, ArrayBuffer, this.lruCapacitySystem);
+            const newCache = new Map<number, CompressedTile>();
             this.cacheMapCompressedTiles.set(fileId, newCache);
             return newCache;
         }
     }
 
+    // Compressed tiles still on their way to a worker cache count as cached, so that they are not requested again
+    private hasCompressedTile(fileId: number, encodedCoordinate: number) {
+        return this.getCompressedCache(fileId).has(encodedCoordinate) || this.pendingCacheStores.has(TileCoordinate.AddFileId(encodedCoordinate, fileId));
+    }
+
+    // Marks a compressed tile as the most recently used
+    private touchCompressedTile(fileId: number, encodedCoordinate: number) {
+        const tileKey = TileCoordinate.AddFileId(encodedCoordinate, fileId);
+        const numBytes = this.compressedTileUsage.get(tileKey);
+        if (numBytes !== undefined) {
+            this.compressedTileUsage.delete(tileKey);
+            this.compressedTileUsage.set(tileKey, numBytes);
+        }
+    }
+
+    // Removes a compressed tile from the cache map, e.g. once its worker has evicted it
+    private forgetCompressedTile(fileId: number, encodedCoordinate: number) {
+        const tileKey = TileCoordinate.AddFileId(encodedCoordinate, fileId);
+        this.compressedCacheBytes -= this.compressedTileUsage.get(tileKey) ?? 0;
+        this.compressedTileUsage.delete(tileKey);
+        this.cacheMapCompressedTiles.get(fileId)?.delete(encodedCoordinate);
+    }
+
+    // Evicts the least recently used compressed tiles, from any worker, until the cache is within the budget
+    private evictCompressedTiles() {
+        for (const tileKey of this.compressedTileUsage.keys()) {
+            if (this.compressedCacheBytes <= this.compressedCacheBudget) {
+                break;
+            }
+            const fileId = TileCoordinate.GetFileId(tileKey);
+            const encodedCoordinate = TileCoordinate.RemoveFileId(tileKey);
+            const workerIndex = this.cacheMapCompressedTiles.get(fileId)?.get(encodedCoordinate)?.workerIndex;
+            if (workerIndex !== undefined) {
+                this.workers[workerIndex].postMessage(["remove cached", fileId, encodedCoordinate]);
+            }
+            this.forgetCompressedTile(fileId, encodedCoordinate);
+        }
+    }
+
+    // The worker has stored (or failed to store) a compressed tile. Only the latest store of each tile is added to the cache map
+    private handleCacheStore(eventArgs: TileMessageArgs) {
+        const tileKey = TileCoordinate.AddFileId(eventArgs.tileCoordinate, eventArgs.fileId);
+        const pendingStore = this.pendingCacheStores.get(tileKey);
+        if (pendingStore?.requestId !== eventArgs.requestId) {
+            return;
+        }
+        this.pendingCacheStores.delete(tileKey);
+        if (eventArgs.cachedBytes) {
+            this.getCompressedCache(eventArgs.fileId).set(eventArgs.tileCoordinate, pendingStore.entry);
+            this.compressedTileUsage.set(tileKey, eventArgs.cachedBytes);
+            this.compressedCacheBytes += eventArgs.cachedBytes;
+            this.evictCompressedTiles();
+        }
+    }
+
+    // Tiles decoded at a lower precision than currently requested for the file are only placeholders
+    private isCoarseQuality(fileId: number | null | undefined, compressionQuality: number | null | undefined) {
+        const requiredQuality = this.fileCompressionQuality.get(fileId ?? NaN);
+        return requiredQuality !== undefined && compressionQuality !== null && compressionQuality !== undefined && compressionQuality < requiredQuality;
+    }
+
     getTile(tileCoordinateEncoded: number, fileId: number, channel: number, stokes: number, peek: boolean = false) {
         const gpuCacheCoordinate = TileCoordinate.AddFileId(tileCoordinateEncoded, fileId);
         if (peek) {
@@ -214,11 +426,47 @@ export class TileService {
         return this.cachedTiles.get(gpuCacheCoordinate);
     }
 
+    // Reads the full resolution data of a tile back from the compressed cache of the workers, e.g. once its data has been uploaded to the GPU and released.
+    // Resolves to null if the tile is not cached for the current channel of the file, or only at a lower quality than currently required
+    readCachedTile(tileCoordinateEncoded: number, fileId: number, channel: number, stokes: number): Promise<RasterTile | null> {
+        const currentChannels = this.channelMap.get(fileId);
+        const compressedTile = this.cacheMapCompressedTiles.get(fileId)?.get(tileCoordinateEncoded);
+        if (!compressedTile || currentChannels?.channel !== channel || currentChannels?.stokes !== stokes || !compressedTile.width || !compressedTile.height) {
+            return Promise.resolve(null);
+        }
+        if (compressedTile.codec === TileCodec.ZFP && this.isCoarseQuality(fileId, compressedTile.compressionQuality)) {
+            return Promise.resolve(null);
+        }
+
+        this.touchCompressedTile(fileId, tileCoordinateEncoded);
+        const requestId = this.compressionRequestCounter++;
+        const outputBuffer = new ArrayBuffer(compressedTile.width * compressedTile.height * 4);
+        const eventArgs: TileMessageArgs = {
+            fileId,
+            channel,
+            stokes,
+            width: compressedTile.width,
+            subsetHeight: compressedTile.height,
+            subsetLength: 0,
+            compression: compressedTile.compressionQuality,
+            codec: compressedTile.codec,
+            tileCoordinate: tileCoordinateEncoded,
+            layer: compressedTile.layer,
+            requestId
+        };
+        return new Promise<RasterTile | null>(resolve => {
+            this.pendingCacheReads.set(requestId, resolve);
+            this.workers[compressedTile.workerIndex].postMessage(["read cached", outputBuffer, eventArgs], [outputBuffer]);
+        });
+    }
+
     requestTiles(tiles: TileCoordinate[], fileId: number, channel: number, stokes: number, focusPoint: Point2D, compressionQuality: number, channelsChanged: boolean = false) {
         const key = `${fileId}_${stokes}_${channel}`;
+        this.fileCompressionQuality.set(fileId, compressionQuality);
 
         if (channelsChanged || !this.channelMap.has(fileId)) {
             this.pendingSynchronisedTiles.set(key, new Set(tiles.map(tile => tile.encode())));
+            this.receivedSynchronisedTiles.get(key)?.forEach(syncTiles => this.releaseSynchronisedTiles(syncTiles));
             this.receivedSynchronisedTiles.delete(key);
             this.clearRequestQueue(fileId);
             this.channelMap.set(fileId, {channel, stokes});
@@ -231,14 +479,23 @@ export class TileService {
                 continue;
             }
             const encodedCoordinate = tile.encode();
+            if (!channelsChanged) {
+                this.claimPrefetchedTile(key, encodedCoordinate);
+            }
             const pendingRequestsMap = this.pendingRequests?.get(key);
-            if (!(pendingRequestsMap && pendingRequestsMap.has(encodedCoordinate))) {
-                const compressedTile = this.getCompressedCache(fileId).get(encodedCoordinate);
+            const pendingQuality = pendingRequestsMap?.get(encodedCoordinate);
+            // Tiles only pending at a lower quality (i.e. coarse placeholders) are requested again
+            if (pendingQuality === undefined || pendingQuality < compressionQuality) {
+                let compressedTile = this.getCompressedCache(fileId).get(encodedCoordinate);
+                if (compressedTile && compressedTile.codec === TileCodec.ZFP && (compressedTile.compressionQuality ?? 0) < compressionQuality) {
+                    compressedTile = undefined;
+                }
                 const pendingCompressionMap = this.pendingDecompressions.get(key);
                 const tileIsQueuedForDecompression = pendingCompressionMap && pendingCompressionMap.has(encodedCoordinate);
 
                 const gpuCacheCoordinate = TileCoordinate.AddFileId(encodedCoordinate, fileId);
-                const tileCached = !channelsChanged && this.cachedTiles?.has(gpuCacheCoordinate);
+                const cachedTile = channelsChanged ? undefined : this.cachedTiles?.peek(gpuCacheCoordinate);
+                const tileCached = cachedTile !== undefined && !cachedTile.coarse;
 
                 if (!tileCached && compressedTile && !tileIsQueuedForDecompression) {
                     if (!pendingCompressionMap) {
@@ -247,33 +504,52 @@ export class TileService {
                         pendingCompressionMap.set(0, new Map<number, boolean>());
                     }
                     // Load from L2 cache instead
-                    this.asyncDecompressTile(fileId, channel, stokes, compressedTile.tile, compressedTile.compressionQuality, encodedCoordinate);
-                } else if (!compressedTile) {
+                    this.asyncDecompressCachedTile(fileId, channel, stokes, compressedTile, encodedCoordinate);
+                } else if (!compressedTile && !this.pendingCacheStores.has(TileCoordinate.AddFileId(encodedCoordinate, fileId))) {
                     // Request from backend
                     if (!pendingRequestsMap) {
-                        this.pendingRequests.set(key, new Map<number, boolean>());
+                        this.pendingRequests.set(key, new Map<number, number>());
                     }
-                    this.pendingRequests.get(key)?.set(encodedCoordinate, true);
+                    this.pendingRequests.get(key)?.set(encodedCoordinate, compressionQuality);
                     this.updateRemainingTileCount();
                     newRequests.push(tile);
                 }
             }
         }
 
+        // When many tiles are missing at once (e.g. after a fast pan or zoom), their parent tiles are first requested at low precision.
+        // These are much cheaper to stream and decode, and are rendered as low-resolution placeholders until the full tiles arrive
+        const coarseQuality = Math.min(COARSE_TILE_COMPRESSION_QUALITY, compressionQuality);
+        const coarseRequests = new Array<TileCoordinate>();
+        const pendingTileRequests = this.pendingRequests.get(key);
+        if (!channelsChanged && pendingTileRequests && coarseQuality < compressionQuality && newRequests.length >= PROGRESSIVE_TILE_THRESHOLD) {
+            for (const tile of newRequests) {
+                if (tile.layer < 1) {
+                    continue;
+                }
+                const parentTile = new TileCoordinate(Math.floor(tile.x / 2), Math.floor(tile.y / 2), tile.layer - 1);
+                const encodedParent = parentTile.encode();
+                if (pendingTileRequests.has(encodedParent) || this.hasCompressedTile(fileId, encodedParent) || this.cachedTiles?.has(TileCoordinate.AddFileId(encodedParent, fileId))) {
+                    continue;
+                }
+                pendingTileRequests.set(encodedParent, coarseQuality);
+                coarseRequests.push(parentTile);
+            }
+            this.updateRemainingTileCount();
+        }
+
         if (newRequests.length) {
-            // sort by distance to midpoint and encode
-            const sortedRequests = newRequests
-                .sort((a, b) => {
-                    const aX = focusPoint.x - a.x;
-                    const aY = focusPoint.y - a.y;
-                    const bX = focusPoint.x - b.x;
-                    const bY = focusPoint.y - b.y;
-                    return aX * aX + aY * aY - (bX * bX + bY * bY);
-                })
-                .map(tile => tile.encode());
+            const sortedRequests = TileService.SortByDistance(newRequests, focusPoint);
+            this.markTiles(fileId, sortedRequests, TilePipelineStage.RequestSent);
             if (channelsChanged) {
                 this.backendService.setChannels(fileId, channel, stokes, {fileId, compressionQuality, compressionType: CARTA.CompressionType.ZFP, tiles: sortedRequests});
             } else {
+                if (coarseRequests.length) {
+                    const coarseFocusPoint = {x: (focusPoint.x - 0.5) / 2, y: (focusPoint.y - 0.5) / 2};
+                    const sortedCoarseRequests = TileService.SortByDistance(coarseRequests, coarseFocusPoint);
+                    this.markTiles(fileId, sortedCoarseRequests, TilePipelineStage.RequestSent);
+                    this.backendService.addRequiredTiles(fileId, sortedCoarseRequests, coarseQuality);
+                }
                 this.backendService.addRequiredTiles(fileId, sortedRequests, compressionQuality);
             }
         } else {
@@ -282,6 +558,141 @@ export class TileService {
         }
     }
 
+    // Visible tiles that were prefetched count as hits. Prefetches still in flight become regular pending requests
+    private claimPrefetchedTile(key: string, encodedCoordinate: number) {
+        const prefetchQuality = this.pendingPrefetches.get(key)?.get(encodedCoordinate);
+        if (prefetchQuality !== undefined) {
+            this.pendingPrefetches.get(key)?.delete(encodedCoordinate);
+            if (!this.pendingRequests.has(key)) {
+                this.pendingRequests.set(key, new Map<number, number>());
+            }
+            this.pendingRequests.get(key)?.set(encodedCoordinate, prefetchQuality);
+            this.updateRemainingTileCount();
+            this.prefetchMetrics.hits++;
+        } else if (this.prefetchedTiles.get(key)?.delete(encodedCoordinate)) {
+            this.prefetchMetrics.hits++;
+        }
+    }
+
+    // Requests the tiles most likely to be required next at low priority (i.e. after the visible tiles), within the prefetch budget.
+    // Prefetches that are no longer likely to be required are cancelled
+    prefetchTiles(frameView: FrameView, imageSize: Point2D, fileId: number, channel: number, stokes: number, compressionQuality: number) {
+        const key = `${fileId}_${stokes}_${channel}`;
+        const panOffset = this.updatePanOffset(fileId, frameView);
+        const currentChannels = this.channelMap.get(fileId);
+        if (!this.cachedTiles || this.animationEnabled || this.pendingSynchronisedTiles.get(key)?.size || currentChannels?.channel !== channel || currentChannels?.stokes !== stokes) {
+            return;
+        }
+
+        // The byte budgets are converted to tile counts, using the average compressed size of the tiles received so far
+        const tileLimit = Math.floor(this.prefetchBandwidthBytes / this.averageTileBytes);
+        const cacheBudget = Math.min(Math.floor(this.prefetchCacheBytes / GPU_TILE_BYTES), Math.floor(this.cachedTiles.capacity / 2));
+        const candidates = GetPrefetchTiles(frameView, imageSize, {x: TILE_SIZE, y: TILE_SIZE}, panOffset, Math.min(tileLimit, cacheBudget));
+        const candidateSet = new Set(candidates.map(tile => tile.encode()));
+
+        if (!this.pendingPrefetches.has(key)) {
+            this.pendingPrefetches.set(key, new Map<number, number>());
+        }
+        if (!this.prefetchedTiles.has(key)) {
+            this.prefetchedTiles.set(key, new Set<number>());
+        }
+        const pendingPrefetchMap = this.pendingPrefetches.get(key) ?? new Map<number, number>();
+        const prefetchedSet = this.prefetchedTiles.get(key) ?? new Set<number>();
+
+        const staleTiles = new Array<number>();
+        pendingPrefetchMap.forEach((_quality, encodedCoordinate) => {
+            if (!candidateSet.has(encodedCoordinate)) {
+                staleTiles.push(encodedCoordinate);
+            }
+        });
+        if (staleTiles.length) {
+            for (const encodedCoordinate of staleTiles) {
+                pendingPrefetchMap.delete(encodedCoordinate);
+            }
+            this.backendService.removeRequiredTiles(fileId, staleTiles);
+            this.prefetchMetrics.cancelled += staleTiles.length;
+        }
+        prefetchedSet.forEach(encodedCoordinate => {
+            if (!candidateSet.has(encodedCoordinate)) {
+                prefetchedSet.delete(encodedCoordinate);
+                this.prefetchMetrics.misses++;
+            }
+        });
+
+        const allowance = Math.min(tileLimit - pendingPrefetchMap.size, cacheBudget - pendingPrefetchMap.size - prefetchedSet.size);
+        const pendingRequestsMap = this.pendingRequests.get(key);
+        const prefetchRequests = new Array<number>();
+        for (const tile of candidates) {
+            if (prefetchRequests.length >= allowance) {
+                break;
+            }
+            const encodedCoordinate = tile.encode();
+            if (pendingPrefetchMap.has(encodedCoordinate) || prefetchedSet.has(encodedCoordinate) || pendingRequestsMap?.has(encodedCoordinate) || this.hasCompressedTile(fileId, encodedCoordinate)) {
+                continue;
+            }
+            const cachedTile = this.cachedTiles.peek(TileCoordinate.AddFileId(encodedCoordinate, fileId));
+            if (cachedTile && !cachedTile.coarse) {
+                continue;
+            }
+            pendingPrefetchMap.set(encodedCoordinate, compressionQuality);
+            prefetchRequests.push(encodedCoordinate);
+        }
+
+        if (prefetchRequests.length) {
+            this.prefetchMetrics.requested += prefetchRequests.length;
+            this.markTiles(fileId, prefetchRequests, TilePipelineStage.RequestSent);
+            this.backendService.addRequiredTiles(fileId, prefetchRequests, compressionQuality);
+        }
+    }
+
+    // Estimates the pan velocity from successive views of the file, and returns the expected offset (in image pixels) over the lookahead period
+    private updatePanOffset(fileId: number, frameView: FrameView): Point2D {
+        const time = performance.now();
+        const center = {x: (frameView.xMin + frameView.xMax) / 2, y: (frameView.yMin + frameView.yMax) / 2};
+        const previous = this.viewHistory.get(fileId);
+        let velocity = {x: 0, y: 0};
+        if (previous && previous.mip === frameView.mip && time - previous.time < PAN_VELOCITY_TIMEOUT) {
+            const dt = Math.max(time - previous.time, 1);
+            // Smooth out the velocity, as view updates are throttled
+            velocity = {
+                x: 0.5 * previous.velocity.x + (0.5 * (center.x - previous.center.x)) / dt,
+                y: 0.5 * previous.velocity.y + (0.5 * (center.y - previous.center.y)) / dt
+            };
+        }
+        this.viewHistory.set(fileId, {center, mip: frameView.mip, time, velocity});
+        return {x: velocity.x * PREFETCH_LOOKAHEAD_TIME, y: velocity.y * PREFETCH_LOOKAHEAD_TIME};
+    }
+
+    private markTiles(fileId: number, encodedCoordinates: number[], stage: TilePipelineStage) {
+        const time = TilePipelineMetrics.Now();
+        for (const encodedCoordinate of encodedCoordinates) {
+            this.pipelineMetrics.mark(TileCoordinate.AddFileId(encodedCoordinate, fileId), stage, time);
+        }
+    }
+
+    // Returns a summary of the tile pipeline metrics collected since the last call, if any tiles have been completed
+    flushPipelineMetrics() {
+        if (!this.pipelineMetrics.tileCount) {
+            return undefined;
+        }
+        const summary = this.pipelineMetrics.summary();
+        this.pipelineMetrics.clear();
+        return summary;
+    }
+
+    // Sort by distance to the focus point and encode
+    private static SortByDistance(tiles: TileCoordinate[], focusPoint: Point2D) {
+        return tiles
+            .sort((a, b) => {
+                const aX = focusPoint.x - a.x;
+                const aY = focusPoint.y - a.y;
+                const bX = focusPoint.x - b.x;
+                const bY = focusPoint.y - b.y;
+                return aX * aX + aY * aY - (bX * bX + bY * bY);
+            })
+            .map(tile => tile.encode());
+    }
+
     updateHiddenFileChannels(fileId: number, channel: number, stokes: number) {
         this.clearCompressedCache(fileId);
         this.clearGPUCache(fileId);
@@ -314,9 +725,62 @@ export class TileService {
     clearCompressedCache(fileId: number) {
         if (fileId === -1) {
             this.cacheMapCompressedTiles.clear();
+            this.compressedTileUsage.clear();
+            this.pendingCacheStores.clear();
+            this.compressedCacheBytes = 0;
         } else {
+            this.cacheMapCompressedTiles.get(fileId)?.forEach((_tile, encodedCoordinate) => this.forgetCompressedTile(fileId, encodedCoordinate));
             this.cacheMapCompressedTiles.delete(fileId);
+            this.pendingCacheStores.forEach((_store, tileKey) => {
+                if (TileCoordinate.GetFileId(tileKey) === fileId) {
+                    this.pendingCacheStores.delete(tileKey);
+                }
+            });
+        }
+        for (const worker of this.workers) {
+            worker.postMessage(["clear cache", fileId]);
+        }
+    }
+
+    private handleEvictedTiles(workerIndex: number, evicted: Int32Array) {
+        for (let i = 0; i + 1 < evicted.length; i += 2) {
+            const compressedCache = this.cacheMapCompressedTiles.get(evicted[i]);
+            // The tile may since have been cached again by a different worker
+            if (compressedCache?.get(evicted[i + 1])?.workerIndex === workerIndex) {
+                this.forgetCompressedTile(evicted[i], evicted[i + 1]);
+            }
+        }
+    }
+
+    // The worker evicted the tile before the decompression request reached it, so it is requested from the backend again
+    private handleCacheMiss(eventArgs: TileMessageArgs) {
+        const {fileId, channel, stokes, tileCoordinate} = eventArgs;
+        const key = `${fileId}_${stokes}_${channel}`;
+        this.forgetCompressedTile(fileId, tileCoordinate);
+        this.pendingDecompressions.get(key)?.get(eventArgs.syncId || 0)?.delete(tileCoordinate);
+
+        const currentChannels = this.channelMap.get(fileId);
+        if (this.animationEnabled || currentChannels?.channel !== channel || currentChannels?.stokes !== stokes) {
+            return;
+        }
+        const compressionQuality = this.fileCompressionQuality.get(fileId) ?? eventArgs.compression ?? 0;
+        if (!this.pendingRequests.has(key)) {
+            this.pendingRequests.set(key, new Map<number, number>());
+        }
+        this.pendingRequests.get(key)?.set(tileCoordinate, compressionQuality);
+        this.updateRemainingTileCount();
+        this.markTiles(fileId, [tileCoordinate], TilePipelineStage.RequestSent);
+        this.backendService.addRequiredTiles(fileId, [tileCoordinate], compressionQuality);
+    }
+
+    private handleCacheRead(buffer: ArrayBuffer | null, eventArgs: TileMessageArgs) {
+        const resolve = this.pendingCacheReads.get(eventArgs.requestId);
+        if (!resolve) {
+            return;
         }
+        this.pendingCacheReads.delete(eventArgs.requestId);
+        const length = (eventArgs.width ?? NaN) * (eventArgs.subsetHeight ?? NaN);
+        resolve(buffer && length > 0 ? {width: eventArgs.width, height: eventArgs.subsetHeight, textureCoordinate: undefined, data: new Float32Array(buffer, 0, length)} : null);
     }
 
     clearRequestQueue(fileId?: number) {
@@ -328,9 +792,21 @@ export class TileService {
                     value.clear();
                 }
             });
+            this.pendingPrefetches.forEach((value, key) => {
+                if (key.startsWith(fileKey)) {
+                    value.clear();
+                }
+            });
+            this.prefetchedTiles.forEach((value, key) => {
+                if (key.startsWith(fileKey)) {
+                    value.clear();
+                }
+            });
         } else {
             // Clear all requests
             this.pendingRequests.clear();
+            this.pendingPrefetches.clear();
+            this.prefetchedTiles.clear();
         }
 
         this.updateRemainingTileCount();
@@ -340,6 +816,8 @@ export class TileService {
         this.clearCompressedCache(fileId);
         this.clearGPUCache(fileId);
         this.channelMap.delete(fileId);
+        this.fileCompressionQuality.delete(fileId);
+        this.viewHistory.delete(fileId);
         const fileKey = `${fileId}`;
         // remove all entries from the map with fileId in the key
         this.completedChannels.forEach((value, key) => {
@@ -353,6 +831,20 @@ export class TileService {
                 this.pendingDecompressions.delete(key);
             }
         });
+
+        this.pendingPrefetches.forEach((value, key) => {
+            if (key.startsWith(fileKey)) {
+                this.pendingPrefetches.delete(key);
+            }
+        });
+
+        this.prefetchedTiles.forEach((value, key) => {
+            if (key.startsWith(fileKey)) {
+                this.prefetchedTiles.delete(key);
+            }
+        });
+
+        this.releaseStaleSynchronisedTiles(fileId);
     }
 
     private initTextures() {
@@ -363,11 +855,21 @@ export class TileService {
         }
     }
 
-    uploadTileToGPU(tile: RasterTile) {
+    // The tile key (encoded coordinate including the file ID) is used to record the upload in the pipeline metrics.
+    // Returns false if the tile could not be uploaded (e.g. before the WebGL context has been set)
+    uploadTileToGPU(tile: RasterTile, tileKey?: number) {
         const textureParameters = this.getTileTextureParameters(tile);
         if (textureParameters.texture && tile.width && tile.height && tile.data) {
+            if (tileKey !== undefined) {
+                this.pipelineMetrics.mark(tileKey, TilePipelineStage.UploadStart);
+            }
             copyToFP32Texture(this.gl, textureParameters.texture, tile.data, GL2.TEXTURE0, tile.width, tile.height, textureParameters.offset.x, textureParameters.offset.y);
+            if (tileKey !== undefined) {
+                this.pipelineMetrics.mark(tileKey, TilePipelineStage.TextureUploaded);
+            }
+            return true;
         }
+        return false;
     }
 
     getTileTextureParameters(tile: RasterTile) {
@@ -424,6 +926,8 @@ export class TileService {
             // mark the channel as complete
             this.completedChannels.set(key, true);
             this.syncIdMap.set(syncMessage.syncId, true);
+            // Tiles that are not decompressed in the workers may all have arrived before the end of the stream
+            this.completeSynchronisedTiles(syncMessage.fileId, syncMessage.channel, syncMessage.stokes, syncMessage.syncId);
         }
     };
 
@@ -463,8 +967,22 @@ export class TileService {
             const encodedCoordinate = TileCoordinate.Encode(tile.x ?? NaN, tile.y ?? NaN, tile.layer ?? NaN);
             // Remove from the requested tile map. If in animation mode, don't check if we're still requesting tiles
             const pendingRequestsMap = this.pendingRequests.get(key);
-            if (pendingRequestsMap?.has(encodedCoordinate) || this.animationEnabled) {
-                if (pendingRequestsMap) {
+            const prefetchQuality = this.pendingPrefetches.get(key)?.get(encodedCoordinate);
+            const pendingQuality = pendingRequestsMap?.get(encodedCoordinate) ?? prefetchQuality;
+            if (pendingQuality !== undefined || this.animationEnabled) {
+                if (prefetchQuality !== undefined) {
+                    this.pendingPrefetches.get(key)?.delete(encodedCoordinate);
+                    this.prefetchedTiles.get(key)?.add(encodedCoordinate);
+                }
+                if (tileMessage.fileId !== null && tileMessage.fileId !== undefined) {
+                    this.pipelineMetrics.mark(TileCoordinate.AddFileId(encodedCoordinate, tileMessage.fileId), TilePipelineStage.BytesReceived);
+                }
+                if (tile.imageData?.byteLength) {
+                    this.averageTileBytes = 0.9 * this.averageTileBytes + 0.1 * tile.imageData.byteLength;
+                }
+                // A coarse tile arriving while the full-precision request is still pending is used as a placeholder, but does not complete the request
+                const supersededCoarseTile = tileMessage.compressionType === CARTA.CompressionType.ZFP && pendingQuality !== undefined && (tileMessage.compressionQuality ?? 0) < pendingQuality;
+                if (pendingRequestsMap && !supersededCoarseTile) {
                     pendingRequestsMap.delete(encodedCoordinate);
                 }
                 this.updateRemainingTileCount();
@@ -474,8 +992,7 @@ export class TileService {
                     this.updateStream(tileMessage.fileId, tileMessage.channel, tileMessage.stokes, decompressedData, tile.width, tile.height, tile.layer, encodedCoordinate, tileMessage.syncId);
                 } else {
                     if (tileMessage.fileId !== null && tileMessage.fileId !== undefined) {
-                        this.getCompressedCache(tileMessage.fileId).set(encodedCoordinate, {tile, compressionQuality: tileMessage.compressionQuality});
-                        this.asyncDecompressTile(tileMessage.fileId, tileMessage.channel, tileMessage.stokes, tile, tileMessage.compressionQuality, encodedCoordinate, tileMessage.syncId);
+                        this.asyncDecompressTile(tileMessage.fileId, tileMessage.channel, tileMessage.stokes, tile, tileMessage.compressionQuality, encodedCoordinate, tileMessage.syncId, true);
                     }
                 }
             } else {
@@ -491,7 +1008,9 @@ export class TileService {
         tile: CARTA.ITileData,
         precision: number | null | undefined,
         tileCoordinate: number,
-        syncId?: number | null | undefined
+        syncId?: number | null | undefined,
+        cache: boolean = false,
+        codec: TileCodec = TileCodec.ZFP
     ) {
         const compressedArray = tile.imageData;
         const workerIndex = this.compressionRequestCounter % this.workers.length;
@@ -519,13 +1038,58 @@ export class TileService {
             tileCoordinate,
             layer: tile.layer,
             requestId: this.compressionRequestCounter,
-            syncId
+            syncId,
+            cache,
+            codec
         };
 
+        if (cache) {
+            const previousEntry = this.getCompressedCache(fileId).get(tileCoordinate);
+            // Drop any stale copy held by another worker, so that it doesn't take up cache budget
+            if (previousEntry && previousEntry.workerIndex !== workerIndex) {
+                this.workers[previousEntry.workerIndex].postMessage(["remove cached", fileId, tileCoordinate]);
+            }
+            this.forgetCompressedTile(fileId, tileCoordinate);
+            const entry = {workerIndex, codec, width: tile.width, height: tile.height, layer: tile.layer, compressionQuality: precision};
+            this.pendingCacheStores.set(TileCoordinate.AddFileId(tileCoordinate, fileId), {requestId: this.compressionRequestCounter, entry});
+        }
+
+        this.pipelineMetrics.mark(TileCoordinate.AddFileId(tileCoordinate, fileId), TilePipelineStage.QueuedToWorker);
         this.workers[workerIndex].postMessage(["decompress", compressedView.buffer, eventArgs], [compressedView.buffer, nanEncodings32.buffer]);
         this.compressionRequestCounter++;
     }
 
+    private asyncDecompressCachedTile(fileId: number, channel: number | null | undefined, stokes: number | null | undefined, compressedTile: CompressedTile, tileCoordinate: number) {
+        const key = `${fileId}_${stokes}_${channel}`;
+        const pendingCompressionMap = this.pendingDecompressions.get(key);
+        if (!pendingCompressionMap) {
+            console.warn("Problem decompressing tile!");
+            return;
+        }
+        pendingCompressionMap.get(0)?.set(tileCoordinate, true);
+        this.touchCompressedTile(fileId, tileCoordinate);
+
+        // Only the output buffer is sent, as the worker decodes directly from its cached copy
+        const outputBuffer = new ArrayBuffer((compressedTile.width ?? NaN) * (compressedTile.height ?? NaN) * 4);
+        const eventArgs: TileMessageArgs = {
+            fileId,
+            channel,
+            stokes,
+            width: compressedTile.width,
+            subsetHeight: compressedTile.height,
+            subsetLength: 0,
+            compression: compressedTile.compressionQuality,
+            codec: compressedTile.codec,
+            tileCoordinate,
+            layer: compressedTile.layer,
+            requestId: this.compressionRequestCounter
+        };
+
+        this.pipelineMetrics.mark(TileCoordinate.AddFileId(tileCoordinate, fileId), TilePipelineStage.QueuedToWorker);
+        this.workers[compressedTile.workerIndex].postMessage(["decompress cached", outputBuffer, eventArgs], [outputBuffer]);
+        this.compressionRequestCounter++;
+    }
+
     private updateStream(
         fileId: number | null | undefined,
         channel: number | null | undefined,
@@ -535,7 +1099,8 @@ export class TileService {
         height: number | null | undefined,
         _layer: number | null | undefined,
         encodedCoordinate: number,
-        syncId: number | null | undefined
+        syncId: number | null | undefined,
+        coarse: boolean = false
     ) {
         const key = `${fileId}_${stokes}_${channel}`;
         const pendingCompressionMap = this.pendingDecompressions.get(key)?.get(syncId || 0);
@@ -565,48 +1130,95 @@ export class TileService {
                 this.receivedSynchronisedTiles.get(key)?.set(syncId, new Map<number, RasterTile>());
                 receivedTiles = this.receivedSynchronisedTiles.get(key)?.get(syncId);
             }
-            receivedTiles?.set(encodedCoordinate, nextTile);
-            // If all tiles are in place, add them to the LRU and fire the stream observable
-            if (this.syncIdMap.get(syncId) && this.syncIdTileCountMap.get(syncId) === receivedTiles?.size) {
-                this.completedChannels.delete(key);
-                this.pendingDecompressions.get(key)?.delete(syncId);
-                this.syncIdMap.delete(syncId);
-                this.syncIdTileCountMap.delete(syncId);
-                const tileCount = receivedTiles?.size;
-                this.clearGPUCache(fileId);
-                if (this.animationEnabled) {
-                    this.clearCompressedCache(fileId ?? NaN);
+            // Upload the tile to a back buffer slot straight away, so that uploads overlap with displaying the previous channel.
+            // If the back buffer is full, the tile is uploaded when it is first rendered instead
+            const backBufferSlot = this.backBufferQueue.pop();
+            if (backBufferSlot !== undefined) {
+                nextTile.textureCoordinate = backBufferSlot;
+                if (this.uploadTileToGPU(nextTile, TileCoordinate.AddFileId(encodedCoordinate, fileId ?? NaN))) {
+                    delete nextTile.data;
+                } else {
+                    this.backBufferQueue.push(backBufferSlot);
+                    nextTile.textureCoordinate = -1;
                 }
-
-                receivedTiles?.forEach((tile, coordinate) => {
-                    tile.textureCoordinate = this.textureCoordinateQueue.pop();
-                    const gpuCacheCoordinate = TileCoordinate.AddFileId(coordinate, fileId ?? NaN);
-                    const oldValue = this.cachedTiles.setpop(gpuCacheCoordinate, tile);
-                    if (oldValue) {
-                        this.clearTile(oldValue.value, oldValue.key);
-                    }
-                });
-                this.pendingSynchronisedTiles.delete(key);
-                this.receivedSynchronisedTiles.delete(key);
-                this.tileStream.next({tileCount, fileId, channel, stokes, flush: true});
             }
+            const replacedTile = receivedTiles?.get(encodedCoordinate);
+            if (replacedTile) {
+                this.releaseSynchronisedTiles(new Map([[encodedCoordinate, replacedTile]]));
+            }
+            receivedTiles?.set(encodedCoordinate, nextTile);
+            this.completeSynchronisedTiles(fileId, channel, stokes, syncId);
         } else {
             // Handle single tile, no sync required
-            const rasterTile: RasterTile = {
-                width,
-                height,
-                textureCoordinate: 0,
-                data: decompressedData
-            };
             const gpuCacheCoordinate = TileCoordinate.AddFileId(encodedCoordinate, fileId ?? NaN);
-            const oldValue = this.cachedTiles.setpop(gpuCacheCoordinate, rasterTile);
-            if (oldValue) {
-                this.clearTile(oldValue.value, oldValue.key);
+            const existingTile = this.cachedTiles.peek(gpuCacheCoordinate);
+            if (existingTile && coarse && !existingTile.coarse) {
+                // Never replace a full-precision tile with a coarse one
+                pendingCompressionMap.delete(encodedCoordinate);
+                return;
+            } else if (existingTile?.coarse) {
+                // Refine the coarse tile in place, re-using its texture slot. The new data is uploaded on the next render
+                existingTile.data = decompressedData;
+                existingTile.width = width;
+                existingTile.height = height;
+                existingTile.coarse = coarse;
+                this.cachedTiles.get(gpuCacheCoordinate);
+            } else {
+                const rasterTile: RasterTile = {
+                    width,
+                    height,
+                    textureCoordinate: 0,
+                    data: decompressedData,
+                    coarse
+                };
+                const oldValue = this.cachedTiles.setpop(gpuCacheCoordinate, rasterTile);
+                if (oldValue) {
+                    this.clearTile(oldValue.value, oldValue.key);
+                }
+                rasterTile.textureCoordinate = this.textureCoordinateQueue.pop();
             }
-            rasterTile.textureCoordinate = this.textureCoordinateQueue.pop();
 
             pendingCompressionMap.delete(encodedCoordinate);
             this.tileStream.next({tileCount: 1, fileId, channel, stokes, flush: false});
         }
     }
+
+    // If all tiles of a synchronised stream are in place and its end has been received, swap them into the LRU and fire the stream observable
+    private completeSynchronisedTiles(fileId: number | null | undefined, channel: number | null | undefined, stokes: number | null | undefined, syncId: number) {
+        const key = `${fileId}_${stokes}_${channel}`;
+        const receivedTiles = this.receivedSynchronisedTiles.get(key)?.get(syncId);
+        if (!receivedTiles || !this.syncIdMap.get(syncId) || this.syncIdTileCountMap.get(syncId) !== receivedTiles.size) {
+            return;
+        }
+
+        this.completedChannels.delete(key);
+        this.pendingDecompressions.get(key)?.delete(syncId);
+        this.syncIdMap.delete(syncId);
+        this.syncIdTileCountMap.delete(syncId);
+        const tileCount = receivedTiles.size;
+        this.clearGPUCache(fileId);
+        if (this.animationEnabled) {
+            this.clearCompressedCache(fileId ?? NaN);
+        }
+
+        receivedTiles.forEach((tile, coordinate) => {
+            const gpuCacheCoordinate = TileCoordinate.AddFileId(coordinate, fileId ?? NaN);
+            const oldValue = this.cachedTiles.setpop(gpuCacheCoordinate, tile);
+            if (oldValue) {
+                this.clearTile(oldValue.value, oldValue.key);
+            }
+            if (tile.textureCoordinate !== undefined && tile.textureCoordinate >= 0) {
+                // The tile keeps its back buffer slot, which is replaced with a free slot from the cache
+                this.backBufferQueue.push(this.textureCoordinateQueue.pop());
+            } else {
+                tile.textureCoordinate = this.textureCoordinateQueue.pop();
+            }
+        });
+        this.receivedSynchronisedTiles.get(key)?.delete(syncId);
+        this.receivedSynchronisedTiles.get(key)?.forEach(syncTiles => this.releaseSynchronisedTiles(syncTiles));
+        this.releaseStaleSynchronisedTiles(fileId, syncId);
+        this.pendingSynchronisedTiles.delete(key);
+        this.receivedSynchronisedTiles.delete(key);
+        this.tileStream.next({tileCount, fileId, channel, stokes, flush: true});
+    }
 }
@@ -3,6 +3,8 @@ export * from "./BackendService";
 export * from "./CatalogApiService";
 export * from "./CatalogWebGLService";
 export * from "./ContourWebGLService";
+export * from "./CubeFittingService";
+export * from "./ImageFittingService";
 export * from "./ScriptingService";
 export * from "./SplatalogueService";
 export * from "./TelemetryService";
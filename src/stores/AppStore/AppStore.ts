@@ -17,6 +17,7 @@ import {
     CatalogInfo,
     CatalogType,
     COMPUTED_POLARIZATIONS,
+    ControlMap,
     FileId,
     FloatingObjzIndexManager,
     FrameView,
@@ -27,6 +28,7 @@ import {
     SpectralType,
     Theme,
     TileCoordinate,
+    TilePipelineMetrics,
     ToFileListFilterMode,
     WCSMatchingType,
     Workspace,
@@ -70,6 +72,8 @@ interface FrameOption extends IOptionProps {
 
 interface ViewUpdate {
     tiles: TileCoordinate[];
+    frameView?: FrameView;
+    imageSize?: Point2D;
     fileId: number;
     channel: number;
     stokes: number;
@@ -156,6 +160,8 @@ export class AppStore {
     private fileCounter = 0;
     private previousConnectionStatus: ConnectionStatus;
     private canvasUpdatedTimer;
+    // Number of uploaded tiles in the tile pipeline metrics when they were last logged
+    private loggedTileCount = 0;
 
     public getAppContainer = (): HTMLElement => {
         return this.appContainer;
@@ -843,6 +849,7 @@ export class AppStore {
 
             // adjust requirements for stores
             this.widgetsStore.removeFrameFromRegionWidgets(fileId);
+            this.widgetsStore.clearStreamingSmoothers();
 
             // clear pv preview frames
             const previewFrame = this.previewFrames.get(fileId);
@@ -856,6 +863,8 @@ export class AppStore {
 
             this.widgetsStore.pvGeneratorWidgets.get(pvGeneratorWidgetId)?.removePreviewFrame(parseInt(pvGeneratorWidgetId.split("-")[2]));
             this.widgetsStore.removeFloatingWidget(pvGeneratorWidgetId);
+            ControlMap.RemoveCachedGrids(previewFrame);
+            previewFrame?.clearSpectralTransformCache();
             this.previewFrames.delete(fileId);
 
             // clear existing requirements for the frame
@@ -865,12 +874,15 @@ export class AppStore {
             this.histogramRequirements.delete(fileId);
 
             this.tileService.handleFileClosed(fileId);
+            ControlMap.RemoveCachedGrids(frame);
             this.telemetryService.addFileCloseEntry(fileId);
+            this.telemetryService.addTilePipelineEntry(this.tileService.flushPipelineMetrics());
 
             if (this.backendService.closeFile(fileId)) {
                 frame.clearSpatialReference();
                 frame.clearSpectralReference();
                 frame.clearContours(false);
+                frame.clearSpectralTransformCache();
                 this.frames = this.frames.filter(f => f.frameInfo.fileId !== fileId);
                 const firstFrame = this.frames.length ? this.frames[0] : null;
                 // Clean up if frame is active
@@ -938,6 +950,8 @@ export class AppStore {
         if (this.backendService.closeFile(-1)) {
             this.activeFrame = null;
             this.tileService.clearCompressedCache(-1);
+            this.widgetsStore.clearStreamingSmoothers();
+            ControlMap.ClearCachedGrids();
             this.previewFrames.forEach((previewFrameStore, previewFrameId) => {
                 this.removePreviewFrame(previewFrameId);
             });
@@ -946,9 +960,11 @@ export class AppStore {
             });
             this.frames.forEach(frame => {
                 frame.clearContours(false);
+                frame.clearSpectralTransformCache();
                 const fileId = frame.frameInfo.fileId;
                 this.telemetryService.addFileCloseEntry(fileId);
                 this.tileService.handleFileClosed(fileId);
+                this.telemetryService.addTilePipelineEntry(this.tileService.flushPipelineMetrics());
                 if (this.catalogNum) {
                     CatalogStore.Instance.closeAssociatedCatalog(fileId);
                 }
@@ -960,6 +976,9 @@ export class AppStore {
     };
 
     @action removePreviewFrame = (previewId: number) => {
+        const previewFrame = this.previewFrames.get(previewId);
+        ControlMap.RemoveCachedGrids(previewFrame);
+        previewFrame?.clearSpectralTransformCache();
         if (this.previewFrames.delete(previewId)) {
             this.backendService.closePvPreview(previewId);
             this.activeFrame = this.visibleFrames[0];
@@ -1548,6 +1567,7 @@ export class AppStore {
     private static readonly ImageThrottleTime = 50;
     private static readonly ImageChannelThrottleTime = 500;
     private static readonly RequirementsCheckInterval = 200;
+    private static readonly TilePipelineLogInterval = 30000;
 
     private spectralRequirements: Map<number, Map<number, CARTA.SetSpectralRequirements>>;
     private spatialRequirements: Map<number, Map<number, CARTA.SetSpatialRequirements>>;
@@ -1622,13 +1642,24 @@ export class AppStore {
         }
     };
 
+    // Tile pipeline latencies and worker throughput since the last telemetry entry are logged at debug level, if any tiles have been uploaded since
+    // the previous log entry
+    private logTilePipelineMetrics = () => {
+        const metrics = this.tileService.pipelineMetrics;
+        if (metrics.tileCount && metrics.tileCount !== this.loggedTileCount) {
+            const prefetchHitRate = Math.round(this.tileService.prefetchHitRate * 100);
+            this.logStore.addDebug(`${TilePipelineMetrics.Describe(metrics.summary())}. Prefetch hit rate: ${prefetchHitRate}%`, ["tiles"]);
+        }
+        this.loggedTileCount = metrics.tileCount;
+    };
+
     private updateViews = (updates: ViewUpdate[]) => {
         for (const update of updates) {
-            this.updateView(update.tiles, update.fileId, update.channel, update.stokes, update.focusPoint, update.headerUnit);
+            this.updateView(update.tiles, update.fileId, update.channel, update.stokes, update.focusPoint, update.headerUnit, update.frameView, update.imageSize);
         }
     };
 
-    private updateView = (tiles: TileCoordinate[], fileId: number, channel: number, stokes: number, focusPoint: Point2D, headerUnit: string) => {
+    private updateView = (tiles: TileCoordinate[], fileId: number, channel: number, stokes: number, focusPoint: Point2D, headerUnit: string, frameView?: FrameView, imageSize?: Point2D) => {
         const isAnimating = this.animatorStore.serverAnimationActive;
         if (isAnimating) {
             this.backendService.addRequiredTiles(
@@ -1641,6 +1672,9 @@ export class AppStore {
             const bunitVariant = ["km/s", "km s-1", "km s^-1", "km.s-1"];
             const compressionQuality = bunitVariant.includes(headerUnit) ? Math.max(this.preferenceStore.imageCompressionQuality, 32) : this.preferenceStore.imageCompressionQuality;
             this.tileService.requestTiles(tiles, fileId, channel, stokes, focusPoint, compressionQuality);
+            if (frameView && imageSize) {
+                this.tileService.prefetchTiles(frameView, imageSize, fileId, channel, stokes, compressionQuality);
+            }
         }
     };
 
@@ -1833,7 +1867,7 @@ export class AppStore {
                     const tileSizeFullRes = reqView.mip * 256;
                     const midPointTileCoords = {x: midPointImageCoords.x / tileSizeFullRes - 0.5, y: midPointImageCoords.y / tileSizeFullRes - 0.5};
                     if (tiles.length) {
-                        viewUpdates.push({tiles, fileId: frame.frameInfo.fileId, channel: frame.channel, stokes: frame.stokes, focusPoint: midPointTileCoords, headerUnit: frame.headerUnit});
+                        viewUpdates.push({tiles, frameView: croppedReq, imageSize, fileId: frame.frameInfo.fileId, channel: frame.channel, stokes: frame.stokes, focusPoint: midPointTileCoords, headerUnit: frame.headerUnit});
                     }
                 }
 
@@ -1910,6 +1944,7 @@ export class AppStore {
 
         // Update requirements every 200 ms
         setInterval(this.recalculateRequirements, AppStore.RequirementsCheckInterval);
+        setInterval(this.logTilePipelineMetrics, AppStore.TilePipelineLogInterval);
 
         // Subscribe to frontend streams
         this.backendService.spatialProfileStream.subscribe(this.handleSpatialProfileStream);
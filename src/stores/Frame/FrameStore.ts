@@ -1410,6 +1410,7 @@ export class FrameStore {
                 }
                 if (this.spectralFrame) {
                     AST.set(this.spectralFrame, `RestFreq=${restFreq} Hz`);
+                    AST.clearSpectralTransformCache(this.spectralFrame);
                 }
 
                 if (this.spectralReference) {
@@ -2740,6 +2741,13 @@ export class FrameStore {
         return true;
     };
 
+    // Frees the spectral conversions cached for the frame, once it is closed
+    public clearSpectralTransformCache = () => {
+        if (this.spectralFrame) {
+            AST.clearSpectralTransformCache(this.spectralFrame);
+        }
+    };
+
     @action clearSpatialReference = () => {
         // Adjust center and zoom based on existing spatial reference
         if (this.spatialReference) {
@@ -3028,6 +3036,9 @@ export class FrameStore {
         // Update wcsInfo
         const astFrameSet = this.initPVFrame();
         if (astFrameSet) {
+            if (this.spectralFrame) {
+                AST.clearSpectralTransformCache(this.spectralFrame);
+            }
             this.spectralFrame = AST.getSpectralFrame(astFrameSet);
             this.wcsInfo = AST.copy(astFrameSet);
             AST.deleteObject(astFrameSet);
@@ -1,15 +1,36 @@
 import {CARTA} from "carta-protobuf";
 import {action, computed, makeObservable, observable, reaction} from "mobx";
 
-import {AppToaster, SuccessToast} from "components/Shared";
+import {AppToaster, SuccessToast, WarningToast} from "components/Shared";
 import {AngularSize, AngularSizeUnit, Point2D, WCSPoint2D} from "models";
+import {ImageFittingResult, ImageFittingService, TILE_SIZE, TileService} from "services";
 import {AppStore, NumberFormatType} from "stores";
 import {FrameStore, RegionStore, WCS_PRECISION} from "stores/Frame";
 import {ACTIVE_FILE_ID} from "stores/Widgets";
-import {angle2D, formattedArcsec, getFormattedWCSPoint, getPixelValueFromWCS, getValueFromArcsecString, isWCSStringFormatValid, pointDistance, rotate2D, scale2D, subtract2D, toExponential} from "utilities";
+import {
+    angle2D,
+    formattedArcsec,
+    getFormattedWCSPoint,
+    getPixelValueFromWCS,
+    GetRegionPixelBounds,
+    GetRegionPixelMask,
+    getValueFromArcsecString,
+    ImageFittingParameter,
+    isWCSStringFormatValid,
+    LoadTilePixels,
+    NUM_IMAGE_COMPONENT_PARAMETERS,
+    PixelBounds,
+    pointDistance,
+    rotate2D,
+    scale2D,
+    subtract2D,
+    toExponential
+} from "utilities";
 
 const FOV_REGION_ID = 0;
 const IMAGE_REGION_ID = -1;
+// Preview fits are limited to regions with at most this many pixels
+const MAX_PREVIEW_PIXELS = 512 * 512;
 
 export class ImageFittingStore {
     private static staticInstance: ImageFittingStore;
@@ -33,6 +54,7 @@ export class ImageFittingStore {
     @observable isFitting: boolean = false;
     @observable progress: number = 0;
     @observable isCancelling: boolean = false;
+    @observable isPreviewFitting: boolean = false;
 
     @action setSelectedFileId = (id: number) => {
         this.selectedFileId = id;
@@ -112,6 +134,10 @@ export class ImageFittingStore {
         this.isCancelling = isCancelling;
     };
 
+    @action setIsPreviewFitting = (isPreviewFitting: boolean) => {
+        this.isPreviewFitting = isPreviewFitting;
+    };
+
     @action resetFittingState = () => {
         this.isFitting = false;
         this.progress = 0;
@@ -155,6 +181,10 @@ export class ImageFittingStore {
         return !validFileId || allFixed || !validParams || this.isFitting;
     }
 
+    @computed get previewDisabled() {
+        return this.fitDisabled || this.isPreviewFitting;
+    }
+
     constructor() {
         makeObservable(this);
         this.clearComponents();
@@ -209,6 +239,101 @@ export class ImageFittingStore {
         AppStore.Instance.requestFitting(message);
     };
 
+    // Fits the components to the full resolution tiles of the region cached in the tile service, in a GSL worker, without a request to the backend.
+    // The result is only a quick preview: integrated fluxes and model or residual images are not computed, and the fitting request remains authoritative
+    fitImagePreview = async () => {
+        const frame = this.effectiveFrame;
+        if (this.previewDisabled || !frame) {
+            return;
+        }
+        const imageWidth = frame.frameInfo?.fileInfoExtended?.width;
+        const imageHeight = frame.frameInfo?.fileInfoExtended?.height;
+
+        let fovInfo: CARTA.IRegionInfo | null = null;
+        let regionId = this.selectedRegionId;
+        if (regionId === FOV_REGION_ID) {
+            fovInfo = this.getFovInfo();
+            regionId = fovInfo ? FOV_REGION_ID : IMAGE_REGION_ID;
+        }
+        let bounds: PixelBounds | null = null;
+        let mask: Uint8Array | null = null;
+        if (regionId === IMAGE_REGION_ID) {
+            bounds = {xMin: 0, yMin: 0, xMax: imageWidth, yMax: imageHeight};
+        } else {
+            const region = regionId === FOV_REGION_ID ? fovInfo : frame.getRegion(regionId);
+            const controlPoints = region?.controlPoints as Point2D[];
+            bounds = GetRegionPixelBounds(region?.regionType, controlPoints, region?.rotation, imageWidth, imageHeight);
+            mask = bounds ? GetRegionPixelMask(region.regionType, controlPoints, region.rotation, bounds) : null;
+        }
+        if (!bounds) {
+            AppToaster.show(WarningToast("No image pixels in the selected region to fit."));
+            return;
+        }
+        if ((bounds.xMax - bounds.xMin) * (bounds.yMax - bounds.yMin) > MAX_PREVIEW_PIXELS) {
+            AppToaster.show(WarningToast("The selected region is too large for a preview fit."));
+            return;
+        }
+
+        const fileId = frame.frameInfo.fileId;
+        // Tiles already uploaded to the GPU no longer hold their data, so it is read back from the compressed tile cache
+        const pixels = await LoadTilePixels(
+            bounds,
+            imageWidth,
+            imageHeight,
+            {x: TILE_SIZE, y: TILE_SIZE},
+            encodedCoordinate => TileService.Instance.getTile(encodedCoordinate, fileId, frame.channel, frame.stokes, true),
+            encodedCoordinate => TileService.Instance.readCachedTile(encodedCoordinate, fileId, frame.channel, frame.stokes)
+        );
+        if (!pixels) {
+            AppToaster.show(WarningToast("The selected region is not fully loaded at full resolution. Zoom in on the region to preview the fit."));
+            return;
+        }
+
+        const initialInputs: number[] = [];
+        const fixedParams: boolean[] = [];
+        for (const c of this.components) {
+            initialInputs.push(c.center.x, c.center.y, c.amplitude, c.fwhm.x, c.fwhm.y, c.pa);
+            fixedParams.push(...c.fixedParams);
+        }
+        initialInputs.push(this.backgroundOffset);
+        fixedParams.push(this.backgroundOffsetFixed);
+
+        this.setIsPreviewFitting(true);
+        const origin = {x: bounds.xMin, y: bounds.yMin};
+        let result: ImageFittingResult | null = null;
+        try {
+            result = await ImageFittingService.Instance.fitImage(pixels, bounds.xMax - bounds.xMin, bounds.yMax - bounds.yMin, origin, initialInputs, fixedParams.map(Number), mask);
+        } catch (error) {
+            console.error(error);
+        } finally {
+            this.setIsPreviewFitting(false);
+        }
+        if (!result) {
+            AppToaster.show(WarningToast("Preview fit failed."));
+            return;
+        }
+
+        const toComponent = (params: Float64Array, i: number): CARTA.IGaussianComponent => {
+            const offset = i * NUM_IMAGE_COMPONENT_PARAMETERS;
+            return {
+                center: {x: params[offset + ImageFittingParameter.CENTER_X], y: params[offset + ImageFittingParameter.CENTER_Y]},
+                amp: params[offset + ImageFittingParameter.AMP],
+                fwhm: {x: params[offset + ImageFittingParameter.FWHM_X], y: params[offset + ImageFittingParameter.FWHM_Y]},
+                pa: params[offset + ImageFittingParameter.PA]
+            };
+        };
+        const values = this.components.map((_, i) => toComponent(result.parameters, i));
+        const errors = this.components.map((_, i) => toComponent(result.errors, i));
+        const offsetIndex = this.components.length * NUM_IMAGE_COMPONENT_PARAMETERS;
+
+        let fittingLog = "Preview fit of the cached full resolution tiles\n";
+        fittingLog += `Status: ${result.status === 0 ? "converged" : `not converged (status ${result.status})`}\n`;
+        fittingLog += `Iterations: ${result.iterations}\n`;
+        fittingLog += `Pixels fitted: ${result.numData}\n`;
+        fittingLog += `Elapsed time: ${result.elapsedTime.toFixed(1)} ms\n`;
+        this.setResultString(regionId, fovInfo, fixedParams, values, errors, result.parameters[offsetIndex], result.errors[offsetIndex], [], [], fittingLog);
+    };
+
     cancelFitting = () => {
         this.setIsCancelling(true);
         if (this.progress < 1.0 && this.isFitting) {
@@ -17,6 +17,9 @@ export enum FittingContinuum {
     FIRST_ORDER = 1
 }
 
+// Iterations of a fit run between yields to the browser, so that the fit can be cancelled from the UI
+const FITTING_STEPS_PER_CHUNK = 10;
+
 export class ProfileFittingStore {
     @observable function: FittingFunction;
     @observable components: ProfileFittingIndividualStore[];
@@ -42,11 +45,21 @@ export class ProfileFittingStore {
     @observable detectedComponentN: number;
     @observable enableResidual: boolean;
     @observable originData: {x: number[]; y: Float32Array | Float64Array};
+    @observable isFitting: boolean;
 
     private readonly widgetStore: SpectralProfileWidgetStore;
+    // Fitting session kept between fits of the widget, reusing the solver workspace. Refits of a model with the same function and number of components
+    // start from the previous solution
+    private fittingSession: {ptr: number} = null;
+    private previousFitModel: string = null;
+    private fittingHandle: NodeJS.Timeout = null;
 
     @action setComponents(length: number, reset?: boolean) {
         this.setSelectedIndex(length - 1);
+        // new components start the next fit from their own initial guesses
+        if (reset) {
+            this.previousFitModel = null;
+        }
         const newComponents = [];
         for (let i = 0; i < length; i++) {
             if (reset) {
@@ -335,7 +348,56 @@ export class ProfileFittingStore {
             lockedOrderInputData.push(this.lockedSlope ? 1 : 0);
         }
 
-        const fittingResult = GSL.fitting(this.function, x, y, inputData, lockedInputData, orderInputData, lockedOrderInputData);
+        if (!this.fittingSession) {
+            this.fittingSession = GSL.createFittingSession();
+        }
+        // the module only warm-starts if the free parameters are also the same, e.g. the baseline has not been locked since
+        const fitModel = `${this.function}_${this.components.length}`;
+        const warmStart = fitModel === this.previousFitModel;
+        this.previousFitModel = fitModel;
+        this.clearFittingHandle();
+        if (GSL.startFitting(this.fittingSession, this.function, x, y, inputData, lockedInputData, orderInputData, lockedOrderInputData, true, warmStart)) {
+            this.setIsFitting(true);
+            this.continueFitting();
+        }
+    };
+
+    // Runs the fit in chunks of iterations, yielding between them so that cancelFitting can stop it
+    private continueFitting = () => {
+        this.fittingHandle = null;
+        if (!this.fittingSession) {
+            this.setIsFitting(false);
+            return;
+        }
+        const fittingResult = GSL.continueFitting(this.fittingSession, FITTING_STEPS_PER_CHUNK, true);
+        if (!fittingResult) {
+            this.fittingHandle = setTimeout(this.continueFitting, 0);
+            return;
+        }
+        this.setIsFitting(false);
+        if (fittingResult.stopReason === GSL.FittingStopReason.CANCELLED) {
+            // a cancelled fit keeps the previous result, and is not a solution to warm-start from
+            this.previousFitModel = null;
+            return;
+        }
+        this.setFittingResult(fittingResult);
+    };
+
+    // Stops the running fit after its current chunk of iterations
+    cancelFitting = () => {
+        if (this.isFitting) {
+            GSL.cancelFitting(this.fittingSession);
+        }
+    };
+
+    private clearFittingHandle = () => {
+        if (this.fittingHandle) {
+            clearTimeout(this.fittingHandle);
+            this.fittingHandle = null;
+        }
+    };
+
+    private setFittingResult = (fittingResult: any) => {
         this.setResultYIntercept(fittingResult.yIntercept);
         this.setResultYInterceptError(fittingResult.yInterceptError);
         this.setResultSlope(fittingResult.slope);
@@ -363,6 +425,14 @@ export class ProfileFittingStore {
         this.setHasResult(true);
     };
 
+    freeFittingSession = () => {
+        this.clearFittingHandle();
+        this.setIsFitting(false);
+        GSL.freeFittingSession(this.fittingSession);
+        this.fittingSession = null;
+        this.previousFitModel = null;
+    };
+
     constructor(widgetStore: SpectralProfileWidgetStore) {
         makeObservable(this);
         this.widgetStore = widgetStore;
@@ -375,6 +445,7 @@ export class ProfileFittingStore {
         this.isAutoDetectWithCont = false;
         this.isAutoDetectWithFitting = false;
         this.enableResidual = true;
+        this.isFitting = false;
     }
 
     @action setFunction = (val: FittingFunction) => {
@@ -421,6 +492,10 @@ export class ProfileFittingStore {
         this.selectedIndex = val;
     };
 
+    @action setIsFitting = (val: boolean) => {
+        this.isFitting = val;
+    };
+
     @action setHasResult = (val: boolean) => {
         this.hasResult = val;
     };
@@ -4,6 +4,11 @@ import {action, computed, makeObservable, observable} from "mobx";
 import {LineSettings, PlotType, SmoothingType} from "components/Shared";
 import {Point2D} from "models";
 
+type SmoothingFilterParameters = {filter: number; kernelSize: number; param?: number; xIn?: number[]};
+
+// Smoothers of streamed profiles kept per store, least recently used first
+const MAX_STREAMING_SMOOTHERS = 16;
+
 export class ProfileSmoothingStore {
     @observable type: SmoothingType;
     @observable lineColor: string;
@@ -21,6 +26,10 @@ export class ProfileSmoothingStore {
     @observable savitzkyGolayOrder: number;
     @observable colorMap: Map<string, string>;
 
+    private streamingSmoothers: Map<string, {ptr: number; filter: number; kernelSize: number; param: number}>;
+    // Kernel weights of batch smoothing, kept between batches with the same filter
+    private smoothingContext: {ptr: number} | undefined;
+
     constructor() {
         makeObservable(this);
         this.type = SmoothingType.NONE;
@@ -37,9 +46,13 @@ export class ProfileSmoothingStore {
         this.savitzkyGolaySize = 5;
         this.savitzkyGolayOrder = 0;
         this.colorMap = new Map();
+        this.streamingSmoothers = new Map();
     }
 
     @action setType = (val: SmoothingType) => {
+        if (val !== this.type) {
+            this.clearStreamingSmoothers();
+        }
         this.type = val;
     };
 
@@ -239,11 +252,81 @@ export class ProfileSmoothingStore {
         return {x: smoothingXs, y: smoothingYs};
     }
 
-    getSmoothingPoint2DArray(x: number[], y: Float32Array | Float64Array, xMinIndex?: number, xMaxIndex?: number): Point2D[] {
+    // Parameters of the convolution-type smoothing filters, or undefined for other types
+    private getFilterParameters(x: number[]): SmoothingFilterParameters | undefined {
+        if (this.type === SmoothingType.BOXCAR) {
+            return {filter: GSL.SmoothingFilter.BOXCAR, kernelSize: this.boxcarSize};
+        } else if (this.type === SmoothingType.GAUSSIAN && this.gaussianSigma && this.gaussianSigma >= 1) {
+            return {filter: GSL.SmoothingFilter.GAUSSIAN, kernelSize: this.gaussianKernel, param: this.gaussianAlpha};
+        } else if (this.type === SmoothingType.HANNING) {
+            return {filter: GSL.SmoothingFilter.HANNING, kernelSize: this.hanningSize};
+        } else if (this.type === SmoothingType.SAVITZKY_GOLAY && this.savitzkyGolayOrder < this.savitzkyGolaySize) {
+            return {filter: GSL.SmoothingFilter.SAVITZKY_GOLAY, kernelSize: this.savitzkyGolaySize, param: this.savitzkyGolayOrder, xIn: x};
+        }
+        return undefined;
+    }
+
+    // Smooths several profiles sharing the same x values in a single call. Types without a batched implementation are smoothed one by one
+    getBatchSmoothingValues(x: number[], ys: (Float32Array | Float64Array)[]): {x: number[]; y: Float32Array | Float64Array}[] {
+        const batch = this.getFilterParameters(x);
+        if (!batch || ys.some(y => !y || y.length !== ys[0].length)) {
+            return ys.map(y => this.getSmoothingValues(x, y));
+        }
+        if (!this.smoothingContext) {
+            this.smoothingContext = GSL.createSmoothingContext();
+        }
+        const smoothedYs: Float64Array[] = GSL.smoothBatch(batch.filter, ys, batch.kernelSize, batch.param, batch.xIn, this.smoothingContext);
+        return smoothedYs.map(y => ({x, y}));
+    }
+
+    // Smooths a profile which is updated progressively, such as a streamed spectral profile. The profile is identified by the key, and only the output
+    // around values that changed since the last call with the same key is recomputed. Types other than the convolution-type filters are smoothed as usual
+    getStreamingSmoothingValues(key: string, x: number[], y: Float32Array | Float64Array, xMinIndex?: number, xMaxIndex?: number): {x: number[]; y: Float32Array | Float64Array} {
+        const parameters = this.getFilterParameters(x);
+        if (!parameters || !x || !y || x.length !== y.length) {
+            return this.getSmoothingValues(x, y, xMinIndex, xMaxIndex);
+        }
+
+        const param = parameters.param ?? 0;
+        let smoother = this.streamingSmoothers.get(key);
+        if (smoother && (smoother.filter !== parameters.filter || smoother.kernelSize !== parameters.kernelSize || smoother.param !== param)) {
+            GSL.freeStreamingSmoother(smoother);
+            smoother = undefined;
+        }
+        if (!smoother) {
+            smoother = GSL.createStreamingSmoother(parameters.filter, parameters.kernelSize, param);
+        }
+        // move the smoother to the most recently used end, and evict the least recently used ones
+        this.streamingSmoothers.delete(key);
+        this.streamingSmoothers.set(key, smoother);
+        while (this.streamingSmoothers.size > MAX_STREAMING_SMOOTHERS) {
+            const oldestKey = this.streamingSmoothers.keys().next().value;
+            GSL.freeStreamingSmoother(this.streamingSmoothers.get(oldestKey));
+            this.streamingSmoothers.delete(oldestKey);
+        }
+
+        const smoothedYs: Float64Array = GSL.streamingSmooth(smoother, y, parameters.xIn);
+        if ((xMinIndex || xMaxIndex === 0) && xMaxIndex) {
+            return {x: x.slice(xMinIndex, xMaxIndex + 1), y: smoothedYs.subarray(xMinIndex, xMaxIndex + 1)};
+        }
+        return {x, y: smoothedYs};
+    }
+
+    // Frees the WASM smoothers of streamed profiles and the batch smoothing context. Must be called before the store is dropped
+    clearStreamingSmoothers = () => {
+        this.streamingSmoothers.forEach(smoother => GSL.freeStreamingSmoother(smoother));
+        this.streamingSmoothers.clear();
+        if (this.smoothingContext) {
+            GSL.freeSmoothingContext(this.smoothingContext);
+            this.smoothingContext = undefined;
+        }
+    };
+
+    getSmoothingPoint2DArray(x: number[], y: Float32Array | Float64Array, xMinIndex?: number, xMaxIndex?: number, streamKey?: string): Point2D[] {
         if (this.type === SmoothingType.NONE) {
             return [];
         }
-        const smoothingValues = this.getSmoothingValues(x, y, xMinIndex, xMaxIndex);
+        const smoothingValues = streamKey === undefined ? this.getSmoothingValues(x, y, xMinIndex, xMaxIndex) : this.getStreamingSmoothingValues(streamKey, x, y, xMinIndex, xMaxIndex);
         let smoothingArray: Point2D[] = new Array(smoothingValues.x.length);
 
         for (let i = 0; i < smoothingValues.x.length; i++) {
@@ -253,6 +336,43 @@ export class ProfileSmoothingStore {
         return smoothingArray;
     }
 
+    // Smooths several profiles in batches of profiles sharing the same x values, and returns the smoothed points of each profile between xMinIndex
+    // and xMaxIndex. Types without a batched implementation are smoothed one by one
+    getBatchSmoothingPoint2DArrays(profiles: {x: number[]; y: Float32Array | Float64Array; xMinIndex: number; xMaxIndex: number}[]): Point2D[][] {
+        if (this.type === SmoothingType.NONE) {
+            return profiles.map(() => []);
+        }
+        const groups = new Map<number[], number[]>();
+        profiles.forEach((profile, i) => {
+            const group = groups.get(profile.x);
+            if (group) {
+                group.push(i);
+            } else {
+                groups.set(profile.x, [i]);
+            }
+        });
+
+        const points: Point2D[][] = new Array(profiles.length);
+        groups.forEach((indexes, x) => {
+            if (!x || !this.getFilterParameters(x) || indexes.some(i => profiles[i].y?.length !== x.length)) {
+                indexes.forEach(i => (points[i] = this.getSmoothingPoint2DArray(x, profiles[i].y, profiles[i].xMinIndex, profiles[i].xMaxIndex)));
+                return;
+            }
+            const smoothingValues = this.getBatchSmoothingValues(x, indexes.map(i => profiles[i].y));
+            indexes.forEach((profileIndex, j) => {
+                const start = isFinite(profiles[profileIndex].xMinIndex) ? profiles[profileIndex].xMinIndex : 0;
+                const end = isFinite(profiles[profileIndex].xMaxIndex) ? profiles[profileIndex].xMaxIndex : x.length - 1;
+                const smoothedYs = smoothingValues[j].y;
+                const profilePoints: Point2D[] = new Array(Math.max(end - start + 1, 0));
+                for (let i = start; i <= end; i++) {
+                    profilePoints[i - start] = {x: x[i], y: smoothedYs[i]};
+                }
+                points[profileIndex] = profilePoints;
+            });
+        });
+        return points;
+    }
+
     getDecimatedPoint2DArray(x: number[], y: Float32Array | Float64Array, decimationWidth: number, xMinIndex?: number, xMaxIndex?: number): Point2D[] {
         if (!x || !y || x.length !== y.length) {
             return [];
@@ -273,4 +393,23 @@ export class ProfileSmoothingStore {
         }
         return decimatedArray;
     }
+
+    // Decimates the points for a plot numPixels wide covering xMin to xMax (the full x range by default), keeping the first, min, max and last point of each pixel column.
+    // Points outside the range are merged into a single column on either side, so that lines leaving the plot are still drawn
+    getPixelDecimatedPoint2DArray(x: number[], y: Float32Array | Float64Array, numPixels: number, xMin?: number, xMax?: number): Point2D[] {
+        if (!x || !y || x.length !== y.length || !x.length) {
+            return [];
+        }
+        if (!isFinite(xMin) || !isFinite(xMax) || xMin === xMax) {
+            xMin = Math.min(x[0], x[x.length - 1]);
+            xMax = Math.max(x[0], x[x.length - 1]);
+        }
+
+        const decimatedValues = GSL.m4Decimation(x, y, numPixels, xMin, xMax);
+        let decimatedArray: Point2D[] = new Array(decimatedValues.x.length);
+        for (let i = 0; i < decimatedValues.x.length; i++) {
+            decimatedArray[i] = {x: decimatedValues.x[i], y: decimatedValues.y[i]};
+        }
+        return decimatedArray;
+    }
 }
@@ -465,6 +465,10 @@ export class SpectralProfileWidgetStore extends RegionWidgetStore {
         const wantMeanRms = profiles.length === 1;
         const profileColorMap = this.lineColorMap;
         const isMultiProfileActive = this.profileSelectionStore.activeProfileCategory === MultiProfileCategory.IMAGE;
+        // Complete profiles are smoothed together after the loop when there are several. Profiles still streaming in are smoothed incrementally
+        const batchSmoothing = profiles.length > 1 && this.smoothingStore.type !== SmoothingType.NONE;
+        const batchProfiles: {x: number[]; y: Float32Array | Float64Array; xMinIndex: number; xMaxIndex: number}[] = [];
+        const batchIndexes: number[] = [];
 
         profiles.forEach(profile => {
             if (profile?.data) {
@@ -475,10 +479,15 @@ export class SpectralProfileWidgetStore extends RegionWidgetStore {
 
                 const intensityConversion: IntensityConversion = GetIntensityConversion(profile.intensityConfig, isMultiProfileActive ? this.intensityUnit : profile.intensityUnit);
                 const intensityValues = intensityConversion ? intensityConversion(profile.data.values) : profile.data.values;
-                const pointsAndProperties = this.getDataPointsAndProperties(profile.channelValues, intensityValues, wantMeanRms);
+                const smoothLater = batchSmoothing && profile.data.progress >= 1;
+                const pointsAndProperties = this.getDataPointsAndProperties(profile.channelValues, intensityValues, wantMeanRms, !smoothLater, String(profile.colorKey));
 
                 data.push(pointsAndProperties?.points ?? []);
                 smoothedData.push(pointsAndProperties?.smoothedPoints ?? []);
+                if (smoothLater && pointsAndProperties) {
+                    batchIndexes.push(smoothedData.length - 1);
+                    batchProfiles.push({x: profile.channelValues, y: intensityValues, xMinIndex: pointsAndProperties.startIndex, xMaxIndex: pointsAndProperties.endIndex});
+                }
                 secondaryXData.push(profile.channelSecondaryValues?.slice(pointsAndProperties?.startIndex, pointsAndProperties?.endIndex + 1) ?? []);
 
                 if (pointsAndProperties) {
@@ -509,6 +518,10 @@ export class SpectralProfileWidgetStore extends RegionWidgetStore {
             }
         });
 
+        if (batchProfiles.length) {
+            this.smoothingStore.getBatchSmoothingPoint2DArrays(batchProfiles).forEach((points, i) => (smoothedData[batchIndexes[i]] = points));
+        }
+
         let fittingData: {x: number[]; y: Float32Array | Float64Array};
         if (profiles.length === 1 && dataIndexes.length === 1) {
             let x = profiles[0].channelValues.slice(dataIndexes[0].startIndex, dataIndexes[0].endIndex + 1);
@@ -934,7 +947,9 @@ export class SpectralProfileWidgetStore extends RegionWidgetStore {
     private getDataPointsAndProperties = (
         frameChannelValues: number[],
         intensityValues: Float32Array | Float64Array,
-        wantMeanRms: boolean
+        wantMeanRms: boolean,
+        wantSmoothing: boolean,
+        streamKey?: string
     ): {
         points: Point2D[];
         smoothedPoints: Point2D[];
@@ -993,7 +1008,9 @@ export class SpectralProfileWidgetStore extends RegionWidgetStore {
                     }
                 }
             }
-            smoothedPoints = smoothedPoints.concat(this.smoothingStore.getSmoothingPoint2DArray(frameChannelValues, intensityValues, startIndex, endIndex));
+            if (wantSmoothing) {
+                smoothedPoints = smoothedPoints.concat(this.smoothingStore.getSmoothingPoint2DArray(frameChannelValues, intensityValues, startIndex, endIndex, streamKey));
+            }
 
             if (wantMeanRms && yCount > 0) {
                 yMean = ySum / yCount;
@@ -310,6 +310,11 @@ export class WidgetsStore {
         });
     }
 
+    // Streamed profiles of closed files are not updated again, so their smoothers are freed
+    public clearStreamingSmoothers = () => {
+        this.spectralProfileWidgets.forEach(widgetStore => widgetStore.smoothingStore.clearStreamingSmoothers());
+    };
+
     @action public removeRegionFromRegionWidgets = (fileId: number, regionId: number) => {
         this.widgetsMap.forEach(widgets => {
             widgets.forEach(widgetStore => {
@@ -527,6 +532,11 @@ export class WidgetsStore {
         if (widgets) {
             // remove associated floating settings according current widgetId
             this.removeAssociatedFloatingSetting(widgetId);
+            const widgetStore = widgets.get(widgetId);
+            if (widgetStore instanceof SpectralProfileWidgetStore) {
+                widgetStore.smoothingStore.clearStreamingSmoothers();
+                widgetStore.fittingStore.freeFittingSession();
+            }
             widgets.delete(widgetId);
         }
         // remove floating settings according floating settings Id
@@ -0,0 +1,116 @@
+import {BatchFittingResult, CubeFittingParameter, GetIntegralMap, GetParameterMap, MergeBatchResults, NumBatchFittingParameters, PartitionRows, RowBlock} from "./cube_fitting";
+
+// Synthetic region with a single component whose center changes along x (a velocity gradient) and FWHM along y
+const Width = 7;
+const Height = 5;
+const NumComponents = 1;
+const Truth = (x: number, y: number) => ({amp: 2, center: -10 + 3 * x, fwhm: 4 + y, yIntercept: 0.5, slope: 0});
+
+// Result of a block, as returned by a worker, with every pixel converged except those in the given set
+function syntheticBlockResult(block: RowBlock, failed: Set<number> = new Set()): BatchFittingResult {
+    const P = NumBatchFittingParameters(NumComponents);
+    const numPixels = (block.rowEnd - block.rowStart) * Width;
+    const result: BatchFittingResult = {
+        parameters: new Float64Array(numPixels * P),
+        errors: new Float64Array(numPixels * P),
+        integrals: new Float64Array(numPixels * NumComponents * 2),
+        converged: new Uint8Array(numPixels),
+        numConverged: 0
+    };
+    for (let i = 0; i < numPixels; i++) {
+        const x = i % Width;
+        const y = block.rowStart + Math.floor(i / Width);
+        const truth = Truth(x, y);
+        // FWHM can come out of the fit with either sign
+        result.parameters.set([truth.amp, truth.center, (x % 2 ? -1 : 1) * truth.fwhm, truth.yIntercept, truth.slope], i * P);
+        result.errors.set([0.1, 0.01 * x, 0.02, 0.01, NaN], i * P);
+        result.integrals.set([truth.amp * truth.fwhm, 0.5], i * 2);
+        if (!failed.has(y * Width + x)) {
+            result.converged[i] = 1;
+            result.numConverged++;
+        }
+    }
+    return result;
+}
+
+describe("PartitionRows", () => {
+    test("covers all rows with contiguous blocks", () => {
+        for (const numBlocks of [1, 2, 3, 4, 5]) {
+            const blocks = PartitionRows(Height, numBlocks);
+            expect(blocks.length).toEqual(Math.min(numBlocks, Height));
+            expect(blocks[0].rowStart).toEqual(0);
+            expect(blocks[blocks.length - 1].rowEnd).toEqual(Height);
+            for (let i = 1; i < blocks.length; i++) {
+                expect(blocks[i].rowStart).toEqual(blocks[i - 1].rowEnd);
+            }
+            blocks.forEach(block => expect(block.rowEnd).toBeGreaterThan(block.rowStart));
+        }
+    });
+
+    test("never creates more blocks than rows", () => {
+        expect(PartitionRows(2, 8)).toEqual([
+            {rowStart: 0, rowEnd: 1},
+            {rowStart: 1, rowEnd: 2}
+        ]);
+    });
+
+    test("returns no blocks for empty regions", () => {
+        expect(PartitionRows(0, 4)).toEqual([]);
+        expect(PartitionRows(10, 0)).toEqual([]);
+    });
+});
+
+describe("MergeBatchResults", () => {
+    test("places block results at their rows", () => {
+        const blocks = PartitionRows(Height, 3);
+        const failed = new Set([3, 17]);
+        const merged = MergeBatchResults(
+            blocks.map(block => ({block, result: syntheticBlockResult(block, failed)})),
+            Width,
+            Height,
+            NumComponents
+        );
+        expect(merged.numConverged).toEqual(Width * Height - failed.size);
+
+        const centerMap = GetParameterMap(merged, NumComponents, 0, CubeFittingParameter.CENTER);
+        const fwhmMap = GetParameterMap(merged, NumComponents, 0, CubeFittingParameter.FWHM);
+        for (let y = 0; y < Height; y++) {
+            for (let x = 0; x < Width; x++) {
+                const i = y * Width + x;
+                if (failed.has(i)) {
+                    expect(centerMap[i]).toBeNaN();
+                    expect(fwhmMap[i]).toBeNaN();
+                } else {
+                    expect(centerMap[i]).toEqual(Truth(x, y).center);
+                    expect(fwhmMap[i]).toEqual(Truth(x, y).fwhm);
+                }
+            }
+        }
+    });
+
+    test("leaves missing blocks unconverged", () => {
+        const blocks = PartitionRows(Height, 2);
+        const merged = MergeBatchResults([{block: blocks[0], result: syntheticBlockResult(blocks[0])}, {block: blocks[1], result: null}], Width, Height, NumComponents);
+        expect(merged.numConverged).toEqual((blocks[0].rowEnd - blocks[0].rowStart) * Width);
+        const ampMap = GetParameterMap(merged, NumComponents, 0, CubeFittingParameter.AMP);
+        expect(ampMap[0]).toEqual(2);
+        expect(ampMap[Width * Height - 1]).toBeNaN();
+    });
+});
+
+describe("parameter maps", () => {
+    const block = {rowStart: 0, rowEnd: Height};
+    const result = syntheticBlockResult(block);
+
+    test("returns errors when requested", () => {
+        const centerErrorMap = GetParameterMap(result, NumComponents, 0, CubeFittingParameter.CENTER, true);
+        expect(centerErrorMap[Width + 3]).toBeCloseTo(0.03);
+    });
+
+    test("returns integrals and their errors", () => {
+        const integralMap = GetIntegralMap(result, NumComponents, 0);
+        const integralErrorMap = GetIntegralMap(result, NumComponents, 0, true);
+        expect(integralMap[2 * Width + 1]).toEqual(2 * Truth(1, 2).fwhm);
+        expect(integralErrorMap[2 * Width + 1]).toEqual(0.5);
+    });
+});
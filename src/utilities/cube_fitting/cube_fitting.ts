@@ -0,0 +1,90 @@
+// Parameters of each fitted component, in the order used by the batch fitting API
+export enum CubeFittingParameter {
+    AMP = 0,
+    CENTER = 1,
+    FWHM = 2
+}
+
+// Results of fitting a block of pixels, or a whole region, in raster order. Each pixel has P = 3 * numComponents + 2 parameters and errors,
+// laid out as [amp1, center1, fwhm1, amp2, ..., yIntercept, slope], and [integral1, integral1Error, integral2, ...] integrals
+export interface BatchFittingResult {
+    parameters: Float64Array;
+    errors: Float64Array;
+    integrals: Float64Array;
+    converged: Uint8Array;
+    numConverged: number;
+}
+
+export interface RowBlock {
+    rowStart: number;
+    rowEnd: number;
+}
+
+export function NumBatchFittingParameters(numComponents: number) {
+    return 3 * numComponents + 2;
+}
+
+// Splits the rows of a region into at most numBlocks contiguous blocks of similar height, so that neighbour seeding stays within a block
+export function PartitionRows(height: number, numBlocks: number): RowBlock[] {
+    const blocks: RowBlock[] = [];
+    if (!(height > 0) || !(numBlocks > 0)) {
+        return blocks;
+    }
+    const count = Math.min(Math.floor(numBlocks), height);
+    for (let i = 0; i < count; i++) {
+        const rowStart = Math.floor((i * height) / count);
+        const rowEnd = Math.floor(((i + 1) * height) / count);
+        blocks.push({rowStart, rowEnd});
+    }
+    return blocks;
+}
+
+// Assembles the results of row blocks into the result of the whole region. Missing blocks are left as NaN and not converged
+export function MergeBatchResults(blocks: {block: RowBlock; result: BatchFittingResult | null}[], width: number, height: number, numComponents: number): BatchFittingResult {
+    const P = NumBatchFittingParameters(numComponents);
+    const numPixels = width * height;
+    const merged: BatchFittingResult = {
+        parameters: new Float64Array(numPixels * P).fill(NaN),
+        errors: new Float64Array(numPixels * P).fill(NaN),
+        integrals: new Float64Array(numPixels * numComponents * 2).fill(NaN),
+        converged: new Uint8Array(numPixels),
+        numConverged: 0
+    };
+
+    for (const {block, result} of blocks) {
+        if (!result) {
+            continue;
+        }
+        const pixelOffset = block.rowStart * width;
+        merged.parameters.set(result.parameters, pixelOffset * P);
+        merged.errors.set(result.errors, pixelOffset * P);
+        merged.integrals.set(result.integrals, pixelOffset * numComponents * 2);
+        merged.converged.set(result.converged, pixelOffset);
+        merged.numConverged += result.numConverged;
+    }
+    return merged;
+}
+
+// Map of a fitted parameter of a component (or its error), e.g. the center for a velocity map or the FWHM for a linewidth map. Pixels that did not converge are NaN
+export function GetParameterMap(result: BatchFittingResult, numComponents: number, component: number, parameter: CubeFittingParameter, error: boolean = false): Float64Array {
+    const P = NumBatchFittingParameters(numComponents);
+    const numPixels = result.converged.length;
+    const values = error ? result.errors : result.parameters;
+    const map = new Float64Array(numPixels);
+    for (let i = 0; i < numPixels; i++) {
+        const value = values[i * P + 3 * component + parameter];
+        // FWHM is only defined up to its sign
+        map[i] = result.converged[i] ? (parameter === CubeFittingParameter.FWHM ? Math.abs(value) : value) : NaN;
+    }
+    return map;
+}
+
+// Map of the integral of a component (or its error). Pixels that did not converge are NaN
+export function GetIntegralMap(result: BatchFittingResult, numComponents: number, component: number, error: boolean = false): Float64Array {
+    const numPixels = result.converged.length;
+    const map = new Float64Array(numPixels);
+    for (let i = 0; i < numPixels; i++) {
+        map[i] = result.converged[i] ? result.integrals[(i * numComponents + component) * 2 + (error ? 1 : 0)] : NaN;
+    }
+    return map;
+}
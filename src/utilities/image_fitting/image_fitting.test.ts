@@ -0,0 +1,167 @@
+import {CARTA} from "carta-protobuf";
+
+import {TileCoordinate} from "models/Tile/TileCoordinate";
+
+import {AssembleTilePixels, CachedTile, GetRegionPixelBounds, GetRegionPixelMask, LoadTilePixels} from "./image_fitting";
+
+const ImageWidth = 600;
+const ImageHeight = 300;
+const TileSize = {x: 256, y: 256};
+
+// Full resolution tiles (layer 2 for a 3 x 2 tile image) with each pixel set to x + 1000 * y
+function syntheticTiles(): Map<number, CachedTile> {
+    const tiles = new Map<number, CachedTile>();
+    for (let tileY = 0; tileY < 2; tileY++) {
+        for (let tileX = 0; tileX < 3; tileX++) {
+            const width = Math.min(TileSize.x, ImageWidth - tileX * TileSize.x);
+            const height = Math.min(TileSize.y, ImageHeight - tileY * TileSize.y);
+            const data = new Float32Array(width * height);
+            for (let j = 0; j < height; j++) {
+                for (let i = 0; i < width; i++) {
+                    data[j * width + i] = tileX * TileSize.x + i + 1000 * (tileY * TileSize.y + j);
+                }
+            }
+            tiles.set(TileCoordinate.Encode(tileX, tileY, 2), {data, width, height});
+        }
+    }
+    return tiles;
+}
+
+describe("GetRegionPixelBounds", () => {
+    test("returns the pixels within a rectangle", () => {
+        expect(GetRegionPixelBounds(CARTA.RegionType.RECTANGLE, [{x: 10, y: 20}, {x: 4, y: 6}], 0, ImageWidth, ImageHeight)).toEqual({xMin: 8, yMin: 17, xMax: 13, yMax: 24});
+    });
+
+    test("includes the corners of rotated regions", () => {
+        const bounds = GetRegionPixelBounds(CARTA.RegionType.RECTANGLE, [{x: 100, y: 100}, {x: 20, y: 10}], 90, ImageWidth, ImageHeight);
+        expect(bounds).toEqual({xMin: 95, yMin: 90, xMax: 106, yMax: 111});
+        // the major axis of an unrotated ellipse is along y
+        expect(GetRegionPixelBounds(CARTA.RegionType.ELLIPSE, [{x: 100, y: 100}, {x: 20, y: 10}], 0, ImageWidth, ImageHeight)).toEqual({xMin: 90, yMin: 80, xMax: 111, yMax: 121});
+    });
+
+    test("clips to the image", () => {
+        expect(GetRegionPixelBounds(CARTA.RegionType.POLYGON, [{x: -5, y: -5}, {x: 10, y: 2}, {x: 3, y: 700}], 0, ImageWidth, ImageHeight)).toEqual({xMin: 0, yMin: 0, xMax: 11, yMax: ImageHeight});
+        expect(GetRegionPixelBounds(CARTA.RegionType.RECTANGLE, [{x: -50, y: 10}, {x: 4, y: 4}], 0, ImageWidth, ImageHeight)).toBeNull();
+    });
+
+    test("ignores other region types", () => {
+        expect(GetRegionPixelBounds(CARTA.RegionType.POINT, [{x: 10, y: 10}], 0, ImageWidth, ImageHeight)).toBeNull();
+    });
+});
+
+describe("GetRegionPixelMask", () => {
+    test("needs no mask for unrotated rectangles", () => {
+        const bounds = GetRegionPixelBounds(CARTA.RegionType.RECTANGLE, [{x: 10, y: 20}, {x: 4, y: 6}], 0, ImageWidth, ImageHeight);
+        expect(GetRegionPixelMask(CARTA.RegionType.RECTANGLE, [{x: 10, y: 20}, {x: 4, y: 6}], 0, bounds)).toBeNull();
+    });
+
+    test("masks the pixels outside an ellipse", () => {
+        const controlPoints = [
+            {x: 100, y: 100},
+            {x: 20, y: 10}
+        ];
+        const bounds = GetRegionPixelBounds(CARTA.RegionType.ELLIPSE, controlPoints, 30, ImageWidth, ImageHeight);
+        const mask = GetRegionPixelMask(CARTA.RegionType.ELLIPSE, controlPoints, 30, bounds);
+        const count = mask.reduce((sum, value) => sum + value, 0);
+        expect(Math.abs(count - Math.PI * 20 * 10)).toBeLessThan(0.03 * Math.PI * 20 * 10);
+        const width = bounds.xMax - bounds.xMin;
+        expect(mask[(100 - bounds.yMin) * width + 100 - bounds.xMin]).toEqual(1);
+        expect(mask[0]).toEqual(0);
+    });
+
+    test("masks the pixels outside a polygon", () => {
+        const controlPoints = [
+            {x: 0, y: 0},
+            {x: 10, y: 0},
+            {x: 0, y: 10}
+        ];
+        const bounds = GetRegionPixelBounds(CARTA.RegionType.POLYGON, controlPoints, 0, ImageWidth, ImageHeight);
+        const mask = GetRegionPixelMask(CARTA.RegionType.POLYGON, controlPoints, 0, bounds);
+        const width = bounds.xMax - bounds.xMin;
+        expect(mask[2 * width + 2]).toEqual(1);
+        expect(mask[9 * width + 9]).toEqual(0);
+    });
+});
+
+describe("AssembleTilePixels", () => {
+    const tiles = syntheticTiles();
+
+    test("copies pixels across tile boundaries", () => {
+        const bounds = {xMin: 250, yMin: 250, xMax: 520, yMax: 300};
+        const pixels = AssembleTilePixels(bounds, ImageWidth, ImageHeight, TileSize, coordinate => tiles.get(coordinate));
+        const width = bounds.xMax - bounds.xMin;
+        expect(pixels.length).toEqual(width * (bounds.yMax - bounds.yMin));
+        for (const [x, y] of [
+            [250, 250],
+            [255, 255],
+            [256, 256],
+            [300, 299],
+            [519, 270]
+        ]) {
+            expect(pixels[(y - bounds.yMin) * width + x - bounds.xMin]).toEqual(x + 1000 * y);
+        }
+    });
+
+    test("converts blank pixels to NaN", () => {
+        const blankTile = tiles.get(TileCoordinate.Encode(0, 0, 2));
+        const data = blankTile.data.slice();
+        data[10 * blankTile.width + 20] = -3.402823466e38;
+        const bounds = {xMin: 0, yMin: 0, xMax: 40, yMax: 20};
+        const pixels = AssembleTilePixels(bounds, ImageWidth, ImageHeight, TileSize, coordinate => ({...tiles.get(coordinate), data}));
+        expect(pixels[10 * 40 + 20]).toBeNaN();
+        expect(pixels[10 * 40 + 21]).toEqual(21 + 1000 * 10);
+        expect(pixels.filter(pixel => isNaN(pixel)).length).toEqual(1);
+    });
+
+    test("returns null if a tile is missing or coarse", () => {
+        const bounds = {xMin: 0, yMin: 0, xMax: 300, yMax: 10};
+        expect(AssembleTilePixels(bounds, ImageWidth, ImageHeight, TileSize, coordinate => (coordinate === TileCoordinate.Encode(1, 0, 2) ? undefined : tiles.get(coordinate)))).toBeNull();
+        expect(AssembleTilePixels(bounds, ImageWidth, ImageHeight, TileSize, coordinate => ({...tiles.get(coordinate), coarse: true}))).toBeNull();
+    });
+});
+
+describe("LoadTilePixels", () => {
+    const tiles = syntheticTiles();
+    // Tiles drawn on the GPU keep their size but no longer hold their data, which is only available from the compressed tile cache
+    const uploadedTiles = new Map<number, CachedTile>();
+    tiles.forEach((tile, coordinate) => uploadedTiles.set(coordinate, {width: tile.width, height: tile.height}));
+
+    test("reads back the data of tiles that have been uploaded", async () => {
+        const bounds = {xMin: 250, yMin: 250, xMax: 520, yMax: 300};
+        const readCoordinates: number[] = [];
+        const readTile = (coordinate: number) => {
+            readCoordinates.push(coordinate);
+            return Promise.resolve(tiles.get(coordinate) ?? null);
+        };
+        const pixels = await LoadTilePixels(bounds, ImageWidth, ImageHeight, TileSize, coordinate => uploadedTiles.get(coordinate), readTile);
+        const width = bounds.xMax - bounds.xMin;
+        expect(pixels).not.toBeNull();
+        for (const [x, y] of [
+            [250, 250],
+            [256, 256],
+            [519, 270]
+        ]) {
+            expect(pixels?.[(y - bounds.yMin) * width + x - bounds.xMin]).toEqual(x + 1000 * y);
+        }
+        expect(readCoordinates.length).toEqual(6);
+    });
+
+    test("only reads back tiles without data", async () => {
+        const bounds = {xMin: 0, yMin: 0, xMax: 300, yMax: 10};
+        const readCoordinates: number[] = [];
+        const getTile = (coordinate: number) => (coordinate === TileCoordinate.Encode(1, 0, 2) ? uploadedTiles.get(coordinate) : tiles.get(coordinate));
+        const readTile = (coordinate: number) => {
+            readCoordinates.push(coordinate);
+            return Promise.resolve(tiles.get(coordinate) ?? null);
+        };
+        const pixels = await LoadTilePixels(bounds, ImageWidth, ImageHeight, TileSize, getTile, readTile);
+        expect(pixels?.[5 * 300 + 299]).toEqual(299 + 5000);
+        expect(readCoordinates).toEqual([TileCoordinate.Encode(1, 0, 2)]);
+    });
+
+    test("resolves to null if an uploaded tile is not cached", async () => {
+        const bounds = {xMin: 0, yMin: 0, xMax: 300, yMax: 10};
+        const readTile = (coordinate: number) => Promise.resolve(coordinate === TileCoordinate.Encode(1, 0, 2) ? null : tiles.get(coordinate) ?? null);
+        expect(await LoadTilePixels(bounds, ImageWidth, ImageHeight, TileSize, coordinate => uploadedTiles.get(coordinate), readTile)).toBeNull();
+    });
+});
@@ -0,0 +1,206 @@
+import {CARTA} from "carta-protobuf";
+
+import {Point2D} from "models/Point2D/Point2D";
+import {TileCoordinate} from "models/Tile/TileCoordinate";
+
+import {MipToLayer} from "../tiling/tiling";
+
+// Parameters of each 2D Gaussian component, in the order used by the image fitting requests and the GSL image fitter
+export enum ImageFittingParameter {
+    CENTER_X = 0,
+    CENTER_Y = 1,
+    AMP = 2,
+    FWHM_X = 3,
+    FWHM_Y = 4,
+    PA = 5
+}
+
+export const NUM_IMAGE_COMPONENT_PARAMETERS = 6;
+
+// Value of blank (NaN) pixels in decompressed tiles, which the ZFP workers fill with -FLT_MAX for the raster shaders
+const BLANK_TILE_PIXEL = Math.fround(-3.402823466e38);
+
+// Block of image pixels, from (xMin, yMin) up to but excluding (xMax, yMax)
+export interface PixelBounds {
+    xMin: number;
+    yMin: number;
+    xMax: number;
+    yMax: number;
+}
+
+export interface CachedTile {
+    data?: Float32Array;
+    width: number | null | undefined;
+    height: number | null | undefined;
+    coarse?: boolean;
+}
+
+// Position of the point in the frame of a rectangle or ellipse region, with the region rotated back to zero rotation
+function regionLocalPoint(point: Point2D, center: Point2D, rotation: number): Point2D {
+    const theta = (-rotation * Math.PI) / 180;
+    const dx = point.x - center.x;
+    const dy = point.y - center.y;
+    return {x: dx * Math.cos(theta) - dy * Math.sin(theta), y: dx * Math.sin(theta) + dy * Math.cos(theta)};
+}
+
+// Half extents of the axis-aligned box around a rectangle or ellipse region. Rectangles are [center, size] and ellipses [center, semi-axes],
+// with the first semi-axis along the y axis before rotation
+function regionHalfExtents(regionType: CARTA.RegionType, size: Point2D, rotation: number): Point2D {
+    const theta = (rotation * Math.PI) / 180;
+    const cos = Math.abs(Math.cos(theta));
+    const sin = Math.abs(Math.sin(theta));
+    if (regionType === CARTA.RegionType.ELLIPSE) {
+        return {x: Math.hypot(size.y * cos, size.x * sin), y: Math.hypot(size.y * sin, size.x * cos)};
+    }
+    return {x: 0.5 * (size.x * cos + size.y * sin), y: 0.5 * (size.x * sin + size.y * cos)};
+}
+
+// Pixels whose centers are within the rectangle, ellipse or polygon region (with its rotation in degrees), clipped to the image.
+// Null for other region types, or if there are no such pixels
+export function GetRegionPixelBounds(regionType: CARTA.RegionType, controlPoints: Point2D[], rotation: number, imageWidth: number, imageHeight: number): PixelBounds | null {
+    let min: Point2D;
+    let max: Point2D;
+    if ((regionType === CARTA.RegionType.RECTANGLE || regionType === CARTA.RegionType.ELLIPSE) && controlPoints?.length === 2) {
+        const halfExtents = regionHalfExtents(regionType, controlPoints[1], rotation ?? 0);
+        min = {x: controlPoints[0].x - halfExtents.x, y: controlPoints[0].y - halfExtents.y};
+        max = {x: controlPoints[0].x + halfExtents.x, y: controlPoints[0].y + halfExtents.y};
+    } else if (regionType === CARTA.RegionType.POLYGON && controlPoints?.length >= 3) {
+        min = {x: Math.min(...controlPoints.map(p => p.x)), y: Math.min(...controlPoints.map(p => p.y))};
+        max = {x: Math.max(...controlPoints.map(p => p.x)), y: Math.max(...controlPoints.map(p => p.y))};
+    } else {
+        return null;
+    }
+
+    const bounds = {
+        xMin: Math.max(0, Math.ceil(min.x)),
+        yMin: Math.max(0, Math.ceil(min.y)),
+        xMax: Math.min(imageWidth, Math.floor(max.x) + 1),
+        yMax: Math.min(imageHeight, Math.floor(max.y) + 1)
+    };
+    if (!(bounds.xMax > bounds.xMin && bounds.yMax > bounds.yMin)) {
+        return null;
+    }
+    return bounds;
+}
+
+// Mask of the pixels within the bounds whose centers are inside the region, in raster order. Null if all of them are inside, e.g. for
+// unrotated rectangles. Polygons use the even-odd rule
+export function GetRegionPixelMask(regionType: CARTA.RegionType, controlPoints: Point2D[], rotation: number, bounds: PixelBounds): Uint8Array | null {
+    const width = bounds.xMax - bounds.xMin;
+    const height = bounds.yMax - bounds.yMin;
+    let isInside: (point: Point2D) => boolean;
+    if (regionType === CARTA.RegionType.RECTANGLE) {
+        if (!rotation) {
+            return null;
+        }
+        const halfSize = {x: controlPoints[1].x / 2, y: controlPoints[1].y / 2};
+        isInside = point => {
+            const local = regionLocalPoint(point, controlPoints[0], rotation);
+            return Math.abs(local.x) <= halfSize.x && Math.abs(local.y) <= halfSize.y;
+        };
+    } else if (regionType === CARTA.RegionType.ELLIPSE) {
+        const semiAxes = controlPoints[1];
+        isInside = point => {
+            const local = regionLocalPoint(point, controlPoints[0], rotation ?? 0);
+            return (local.x / semiAxes.y) ** 2 + (local.y / semiAxes.x) ** 2 <= 1;
+        };
+    } else if (regionType === CARTA.RegionType.POLYGON) {
+        isInside = point => {
+            let inside = false;
+            for (let i = 0, j = controlPoints.length - 1; i < controlPoints.length; j = i++) {
+                const a = controlPoints[i];
+                const b = controlPoints[j];
+                if (a.y > point.y !== b.y > point.y && point.x < ((b.x - a.x) * (point.y - a.y)) / (b.y - a.y) + a.x) {
+                    inside = !inside;
+                }
+            }
+            return inside;
+        };
+    } else {
+        return null;
+    }
+
+    const mask = new Uint8Array(width * height);
+    let allInside = true;
+    for (let j = 0; j < height; j++) {
+        for (let i = 0; i < width; i++) {
+            const inside = isInside({x: bounds.xMin + i, y: bounds.yMin + j});
+            mask[j * width + i] = inside ? 1 : 0;
+            allInside = allInside && inside;
+        }
+    }
+    return allInside ? null : mask;
+}
+
+// Encoded coordinates (without the file ID) of the full resolution tiles covering the bounds, with the position of each tile in tiles
+function coveringTiles(bounds: PixelBounds, imageWidth: number, imageHeight: number, tileSize: Point2D): {encodedCoordinate: number; tileX: number; tileY: number}[] {
+    const layer = MipToLayer(1, {x: imageWidth, y: imageHeight}, tileSize);
+    const tiles: {encodedCoordinate: number; tileX: number; tileY: number}[] = [];
+    for (let tileY = Math.floor(bounds.yMin / tileSize.y); tileY * tileSize.y < bounds.yMax; tileY++) {
+        for (let tileX = Math.floor(bounds.xMin / tileSize.x); tileX * tileSize.x < bounds.xMax; tileX++) {
+            tiles.push({encodedCoordinate: TileCoordinate.Encode(tileX, tileY, layer), tileX, tileY});
+        }
+    }
+    return tiles;
+}
+
+// Copies the pixels within the bounds from the full resolution tiles of the image, in raster order. Returns null if any of the tiles
+// is not cached, or is only a coarse placeholder. getTile is given the encoded tile coordinate (without the file ID)
+export function AssembleTilePixels(bounds: PixelBounds, imageWidth: number, imageHeight: number, tileSize: Point2D, getTile: (encodedCoordinate: number) => CachedTile | undefined): Float32Array | null {
+    const width = bounds.xMax - bounds.xMin;
+    const height = bounds.yMax - bounds.yMin;
+    if (!(width > 0 && height > 0)) {
+        return null;
+    }
+    const pixels = new Float32Array(width * height);
+
+    for (const {encodedCoordinate, tileX, tileY} of coveringTiles(bounds, imageWidth, imageHeight, tileSize)) {
+        const tile = getTile(encodedCoordinate);
+        if (!tile?.data || tile.coarse || !tile.width || !tile.height) {
+            return null;
+        }
+        const tileOrigin = {x: tileX * tileSize.x, y: tileY * tileSize.y};
+        const xStart = Math.max(bounds.xMin, tileOrigin.x);
+        const xEnd = Math.min(bounds.xMax, tileOrigin.x + tile.width);
+        const yEnd = Math.min(bounds.yMax, tileOrigin.y + tile.height);
+        for (let y = Math.max(bounds.yMin, tileOrigin.y); y < yEnd; y++) {
+            const offset = (y - tileOrigin.y) * tile.width + xStart - tileOrigin.x;
+            pixels.set(tile.data.subarray(offset, offset + xEnd - xStart), (y - bounds.yMin) * width + xStart - bounds.xMin);
+        }
+    }
+    // blank pixels are left out of fits as NaN, rather than fitted as finite values
+    for (let i = 0; i < pixels.length; i++) {
+        if (pixels[i] === BLANK_TILE_PIXEL) {
+            pixels[i] = NaN;
+        }
+    }
+    return pixels;
+}
+
+// As AssembleTilePixels, but tiles whose data is no longer held by getTile (e.g. released once uploaded to the GPU, or evicted) are read back
+// with readTile, such as from the compressed tile cache. Resolves to null if any of the tiles can't be read at full resolution
+export async function LoadTilePixels(
+    bounds: PixelBounds,
+    imageWidth: number,
+    imageHeight: number,
+    tileSize: Point2D,
+    getTile: (encodedCoordinate: number) => CachedTile | undefined,
+    readTile: (encodedCoordinate: number) => Promise<CachedTile | null>
+): Promise<Float32Array | null> {
+    const tiles = new Map<number, CachedTile | null | undefined>();
+    const reads: Promise<void>[] = [];
+    for (const {encodedCoordinate} of coveringTiles(bounds, imageWidth, imageHeight, tileSize)) {
+        const tile = getTile(encodedCoordinate);
+        if (tile?.data && !tile.coarse) {
+            tiles.set(encodedCoordinate, tile);
+        } else {
+            reads.push(
+                readTile(encodedCoordinate).then(readBack => {
+                    tiles.set(encodedCoordinate, readBack);
+                })
+            );
+        }
+    }
+    await Promise.all(reads);
+    return AssembleTilePixels(bounds, imageWidth, imageHeight, tileSize, encodedCoordinate => tiles.get(encodedCoordinate) ?? undefined);
+}
@@ -1,8 +1,10 @@
 export * from "./array/array";
 export * from "./CatalogApiProcessed/CatalogApiProcessed";
 export * from "./color/color";
+export * from "./cube_fitting/cube_fitting";
 export * from "./export/export";
 export * from "./fitting_heuristics/fitting_heuristics";
+export * from "./image_fitting/image_fitting";
 export * from "./math/math";
 export * from "./math2d/math2d";
 export * from "./parsing/parsing";
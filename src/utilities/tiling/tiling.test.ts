@@ -1,6 +1,6 @@
 import {FrameView, Point2D, TileCoordinate} from "models";
 
-import {GetRequiredTiles, LayerToMip, MipToLayer, TileSortEncoded} from "./tiling";
+import {GetPrefetchTiles, GetRequiredTiles, LayerToMip, MipToLayer, TileSortEncoded} from "./tiling";
 
 // Some default tile/image sizes
 const Tile256: Point2D = {x: 256, y: 256};
@@ -314,3 +314,43 @@ test("round trip layer -> mip -> layer", () => {
     expect(MipToLayer(LayerToMip(3, Tile4096, Tile256), Tile4096, Tile256)).toBe(3);
     expect(MipToLayer(LayerToMip(4, Tile4096, Tile256), Tile4096, Tile256)).toBe(4);
 });
+
+const PrefetchImage: Point2D = {x: 8192, y: 8192};
+const PrefetchView: FrameView = {xMin: 2048, xMax: 3072, yMin: 2048, yMax: 3072, mip: 1};
+
+test("returns no prefetch tiles if FrameView is invalid or no tiles are allowed", () => {
+    expect(GetPrefetchTiles(null, PrefetchImage, Tile256, {x: 0, y: 0}, 16)).toEqual([]);
+    expect(GetPrefetchTiles(PrefetchView, PrefetchImage, Tile256, {x: 0, y: 0}, 0)).toEqual([]);
+});
+
+test("returns unique prefetch tiles that are not already visible", () => {
+    const visibleTiles = new Set(GetRequiredTiles(PrefetchView, PrefetchImage, Tile256).map(tile => tile.encode()));
+    const prefetchTiles = GetPrefetchTiles(PrefetchView, PrefetchImage, Tile256, {x: 0, y: 0}, 64).map(tile => tile.encode());
+    expect(prefetchTiles.length).toBeGreaterThan(0);
+    expect(new Set(prefetchTiles).size).toBe(prefetchTiles.length);
+    expect(prefetchTiles.some(tile => visibleTiles.has(tile))).toBe(false);
+});
+
+test("returns no more than the requested number of prefetch tiles", () => {
+    expect(GetPrefetchTiles(PrefetchView, PrefetchImage, Tile256, {x: 0, y: 0}, 5).length).toBe(5);
+});
+
+test("prioritizes coarser layer prefetch tiles when the view is stationary", () => {
+    const prefetchTiles = GetPrefetchTiles(PrefetchView, PrefetchImage, Tile256, {x: 0, y: 0}, 4);
+    const layer = MipToLayer(PrefetchView.mip, PrefetchImage, Tile256);
+    expect(prefetchTiles.every(tile => tile.layer === layer - 1)).toBe(true);
+});
+
+test("prioritizes prefetch tiles in the pan direction", () => {
+    const prefetchTiles = GetPrefetchTiles(PrefetchView, PrefetchImage, Tile256, {x: 600, y: 0}, 8);
+    const maxVisibleX = PrefetchView.xMax / Tile256.x - 1;
+    expect(prefetchTiles.every(tile => tile.x > maxVisibleX)).toBe(true);
+});
+
+test("includes finer layer prefetch tiles when zoomed out", () => {
+    const view: FrameView = {xMin: 2048, xMax: 6144, yMin: 2048, yMax: 6144, mip: 4};
+    const layer = MipToLayer(view.mip, PrefetchImage, Tile256);
+    const prefetchTiles = GetPrefetchTiles(view, PrefetchImage, Tile256, {x: 0, y: 0}, 200);
+    expect(prefetchTiles.some(tile => tile.layer === layer + 1)).toBe(true);
+    expect(prefetchTiles.some(tile => tile.layer === layer - 1)).toBe(true);
+});
@@ -95,3 +95,66 @@ export function GetRequiredTiles(frameView: FrameView, imageSize: Point2D, tileS
     }
     return tileSet;
 }
+
+// Returns the tiles most likely to be required after the given view, in order of priority, excluding the currently visible tiles.
+// Candidates are the ring of tiles around the view (extended by the expected pan offset in image pixels, and favouring tiles in the pan direction),
+// the coarser layer of the view (required when zooming out) and the central tiles of the finer layer (required when zooming in)
+export function GetPrefetchTiles(frameView: FrameView, imageSize: Point2D, tileSize: Point2D, panOffset: Point2D, maxTiles: number): TileCoordinate[] {
+    const visibleTiles = GetRequiredTiles(frameView, imageSize, tileSize);
+    if (!visibleTiles.length || !(maxTiles > 0)) {
+        return [];
+    }
+
+    const visibleSet = new Set(visibleTiles.map(tile => tile.encode()));
+    const candidates = new Map<number, {tile: TileCoordinate; score: number}>();
+    const addCandidate = (tile: TileCoordinate, score: number) => {
+        const encodedCoordinate = tile.encode();
+        const existing = candidates.get(encodedCoordinate);
+        if (!visibleSet.has(encodedCoordinate) && (!existing || existing.score > score)) {
+            candidates.set(encodedCoordinate, {tile, score});
+        }
+    };
+
+    const adjustedTileSize: Point2D = {x: frameView.mip * tileSize.x, y: frameView.mip * tileSize.y};
+    const center: Point2D = {x: (frameView.xMin + frameView.xMax) / 2, y: (frameView.yMin + frameView.yMax) / 2};
+    const offset: Point2D = {x: isFinite(panOffset?.x) ? panOffset.x : 0, y: isFinite(panOffset?.y) ? panOffset.y : 0};
+    const speed = Math.hypot(offset.x, offset.y);
+    // Distance (in tiles) from the center of the view to its edge
+    const viewRadius = Math.max(frameView.xMax - frameView.xMin, frameView.yMax - frameView.yMin) / 2 / Math.max(adjustedTileSize.x, adjustedTileSize.y);
+
+    const expandedView: FrameView = {
+        xMin: frameView.xMin - adjustedTileSize.x + Math.min(offset.x, 0),
+        xMax: frameView.xMax + adjustedTileSize.x + Math.max(offset.x, 0),
+        yMin: frameView.yMin - adjustedTileSize.y + Math.min(offset.y, 0),
+        yMax: frameView.yMax + adjustedTileSize.y + Math.max(offset.y, 0),
+        mip: frameView.mip
+    };
+    for (const tile of GetRequiredTiles(expandedView, imageSize, tileSize)) {
+        const dx = (tile.x + 0.5) * adjustedTileSize.x - center.x;
+        const dy = (tile.y + 0.5) * adjustedTileSize.y - center.y;
+        const distance = Math.hypot(dx / adjustedTileSize.x, dy / adjustedTileSize.y);
+        // Tiles ahead of the pan are favoured over those behind it
+        const alignment = speed > 0 && distance > 0 ? (dx * offset.x + dy * offset.y) / (Math.hypot(dx, dy) * speed) : 0;
+        addCandidate(tile, distance * (1 - 0.75 * alignment));
+    }
+
+    for (const tile of GetRequiredTiles({...frameView, mip: frameView.mip * 2}, imageSize, tileSize)) {
+        addCandidate(tile, viewRadius);
+    }
+
+    if (frameView.mip >= 2) {
+        const quarterWidth = (frameView.xMax - frameView.xMin) / 4;
+        const quarterHeight = (frameView.yMax - frameView.yMin) / 4;
+        const centralView: FrameView = {xMin: center.x - quarterWidth, xMax: center.x + quarterWidth, yMin: center.y - quarterHeight, yMax: center.y + quarterHeight, mip: frameView.mip / 2};
+        for (const tile of GetRequiredTiles(centralView, imageSize, tileSize)) {
+            const dx = ((tile.x + 0.5) * adjustedTileSize.x) / 2 - center.x;
+            const dy = ((tile.y + 0.5) * adjustedTileSize.y) / 2 - center.y;
+            addCandidate(tile, 2 * viewRadius + Math.hypot(dx / adjustedTileSize.x, dy / adjustedTileSize.y));
+        }
+    }
+
+    return Array.from(candidates.values())
+        .sort((a, b) => a.score - b.score)
+        .slice(0, maxTiles)
+        .map(candidate => candidate.tile);
+}
@@ -26,6 +26,11 @@ void astPutErr_(int status_value, const char* message)
 
 #include <iostream>
 #include <string.h>
+#include <vector>
+#include <map>
+#include <string>
+#include <tuple>
+#include <algorithm>
 #include <emscripten.h>
 
 using namespace std;
@@ -564,18 +569,65 @@ EMSCRIPTEN_KEEPALIVE int transform3DArray(AstFrameSet* wcsinfo, int npoint, doub
     return 0;
 }
 
-EMSCRIPTEN_KEEPALIVE int spectralTransform(AstSpecFrame* specFrameFrom, const char* specTypeTo, const char* specUnitTo, const char* specSysTo, const int npoint, const double zIn[], const int forward, double zOut[])
+// Target settings of a spectral conversion. Settings that are not given (null) are left as in the source frame
+struct SpectralConversionKey
 {
-    if (!specFrameFrom)
+    AstSpecFrame* specFrameFrom;
+    bool hasType, hasUnit, hasSys;
+    string specType, specUnit, specSys;
+
+    SpectralConversionKey(AstSpecFrame* specFrameFrom, const char* specTypeTo, const char* specUnitTo, const char* specSysTo)
+        : specFrameFrom(specFrameFrom),
+          hasType(specTypeTo),
+          hasUnit(specUnitTo),
+          hasSys(specSysTo),
+          specType(specTypeTo ? specTypeTo : ""),
+          specUnit(specUnitTo ? specUnitTo : ""),
+          specSys(specSysTo ? specSysTo : "")
     {
-        return 1;
     }
 
-    AstSpecFrame* specFrameTo = nullptr;
-    specFrameTo = static_cast<AstSpecFrame*> astCopy(specFrameFrom);
+    bool operator<(const SpectralConversionKey& other) const
+    {
+        return tie(specFrameFrom, hasType, hasUnit, hasSys, specType, specUnit, specSys) <
+               tie(other.specFrameFrom, other.hasType, other.hasUnit, other.hasSys, other.specType, other.specUnit, other.specSys);
+    }
+};
+
+// Conversion framesets created by spectralTransform. They stay valid until the source frame is changed or deleted, which must be
+// followed by clearSpectralTransformCache (deleteObject does this itself)
+map<SpectralConversionKey, AstFrameSet*> spectralConversions;
+
+// Frees the cached conversions from the spectral frame, or all of them if it is null
+EMSCRIPTEN_KEEPALIVE void clearSpectralTransformCache(AstSpecFrame* specFrameFrom)
+{
+    for (auto it = spectralConversions.begin(); it != spectralConversions.end();)
+    {
+        if (!specFrameFrom || it->first.specFrameFrom == specFrameFrom)
+        {
+            astAnnul(it->second);
+            it = spectralConversions.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+AstFrameSet* getSpectralConversion(AstSpecFrame* specFrameFrom, const char* specTypeTo, const char* specUnitTo, const char* specSysTo)
+{
+    SpectralConversionKey key(specFrameFrom, specTypeTo, specUnitTo, specSysTo);
+    auto cached = spectralConversions.find(key);
+    if (cached != spectralConversions.end())
+    {
+        return cached->second;
+    }
+
+    AstSpecFrame* specFrameTo = static_cast<AstSpecFrame*> astCopy(specFrameFrom);
     if (!specFrameTo)
     {
-        return 1;
+        return nullptr;
     }
 
     char buffer[128];
@@ -592,8 +644,184 @@ EMSCRIPTEN_KEEPALIVE int spectralTransform(AstSpecFrame* specFrameFrom, const ch
         astSet(specFrameTo, buffer);
     }
 
-    AstFrameSet *cvt;
-    cvt = static_cast<AstFrameSet*> astConvert(specFrameFrom, specFrameTo, "");
+    AstFrameSet* cvt = static_cast<AstFrameSet*> astConvert(specFrameFrom, specFrameTo, "");
+    astAnnul(specFrameTo);
+    if (!astOK || !cvt)
+    {
+        if (cvt)
+        {
+            astAnnul(cvt);
+        }
+        astClearStatus;
+        return nullptr;
+    }
+    spectralConversions[key] = cvt;
+    return cvt;
+}
+
+// Bulk spectral conversions of at least this many values are approximated by a Chebyshev series, if the conversion is smooth and monotonic
+const int SPECTRAL_APPROXIMATION_MIN_POINTS = 4096;
+const int SPECTRAL_APPROXIMATION_MIN_DEGREE = 16;
+const int SPECTRAL_APPROXIMATION_MAX_DEGREE = 128;
+// Maximum error of the approximation, relative to the largest converted value
+const double SPECTRAL_APPROXIMATION_TOLERANCE = 1e-12;
+// Number of values evaluated together, so that the loops over them can be vectorised
+const int SPECTRAL_APPROXIMATION_BLOCK = 16;
+
+// Sum of the Chebyshev series c[0..degree] at u in [-1, 1] (Clenshaw recurrence)
+double chebyshevSum(const double* c, int degree, double u)
+{
+    double b1 = 0;
+    double b2 = 0;
+    for (auto j = degree; j > 0; j--)
+    {
+        double b0 = c[j] + 2 * u * b1 - b2;
+        b2 = b1;
+        b1 = b0;
+    }
+    return c[0] + u * b1 - b2;
+}
+
+// Converts zIn with a Chebyshev approximation of the conversion over the range of zIn. The series is fitted at Chebyshev-Lobatto points,
+// with the degree doubled until its trailing coefficients and the error at the points halfway between the nodes (checked against the exact
+// conversion) are within the tolerance, and the exact values are strictly monotonic. Returns false, without writing zOut, if there is no
+// such approximation up to the maximum degree, or if any value is bad; the caller then converts exactly
+bool approximateSpectralTransform(AstFrameSet* cvt, const int npoint, const double zIn[], const int forward, double zOut[])
+{
+    double zMin = INFINITY;
+    double zMax = -INFINITY;
+    for (auto i = 0; i < npoint; i++)
+    {
+        if (!isfinite(zIn[i]) || zIn[i] == AST__BAD)
+        {
+            return false;
+        }
+        zMin = min(zMin, zIn[i]);
+        zMax = max(zMax, zIn[i]);
+    }
+    if (!(zMax > zMin))
+    {
+        return false;
+    }
+    double center = 0.5 * (zMax + zMin);
+    double halfWidth = 0.5 * (zMax - zMin);
+
+    vector<double> samples, exact, coefficients;
+    for (auto degree = SPECTRAL_APPROXIMATION_MIN_DEGREE; degree <= SPECTRAL_APPROXIMATION_MAX_DEGREE; degree *= 2)
+    {
+        // Nodes at even indexes, and the check points halfway (in angle) between them at odd indexes, in decreasing order
+        int numSamples = 2 * degree + 1;
+        samples.resize(numSamples);
+        exact.resize(numSamples);
+        for (auto k = 0; k < numSamples; k++)
+        {
+            samples[k] = center + halfWidth * cos(M_PI * k / (2 * degree));
+        }
+        samples[0] = zMax;
+        samples[numSamples - 1] = zMin;
+        astTran1(cvt, numSamples, samples.data(), forward, exact.data());
+        if (!astOK)
+        {
+            astClearStatus;
+            return false;
+        }
+
+        double scale = 0;
+        for (auto k = 0; k < numSamples; k++)
+        {
+            if (!isfinite(exact[k]) || exact[k] == AST__BAD)
+            {
+                return false;
+            }
+            scale = max(scale, fabs(exact[k]));
+        }
+        double direction = exact[numSamples - 1] > exact[0] ? 1 : -1;
+        for (auto k = 1; k < numSamples; k++)
+        {
+            if (!(direction * (exact[k] - exact[k - 1]) > 0))
+            {
+                return false;
+            }
+        }
+        double tolerance = SPECTRAL_APPROXIMATION_TOLERANCE * (scale > 0 ? scale : 1);
+
+        // Coefficients of the interpolant at the nodes (type I DCT), with the first and last ones halved
+        coefficients.assign(degree + 1, 0);
+        for (auto j = 0; j <= degree; j++)
+        {
+            double sum = 0;
+            for (auto k = 0; k <= degree; k++)
+            {
+                double weight = (k == 0 || k == degree) ? 0.5 : 1;
+                sum += weight * exact[2 * k] * cos(M_PI * j * k / degree);
+            }
+            coefficients[j] = sum * 2 / degree;
+        }
+        coefficients[0] *= 0.5;
+        coefficients[degree] *= 0.5;
+        if (fabs(coefficients[degree]) + fabs(coefficients[degree - 1]) > tolerance)
+        {
+            continue;
+        }
+
+        bool accurate = true;
+        for (auto k = 1; k < numSamples && accurate; k += 2)
+        {
+            accurate = fabs(chebyshevSum(coefficients.data(), degree, (samples[k] - center) / halfWidth) - exact[k]) <= tolerance;
+        }
+        if (!accurate)
+        {
+            continue;
+        }
+
+        // Evaluate the series in blocks, with the recurrence running over each block
+        const double* c = coefficients.data();
+        for (auto start = 0; start < npoint; start += SPECTRAL_APPROXIMATION_BLOCK)
+        {
+            int blockSize = min(SPECTRAL_APPROXIMATION_BLOCK, npoint - start);
+            double u[SPECTRAL_APPROXIMATION_BLOCK];
+            double b1[SPECTRAL_APPROXIMATION_BLOCK] = {0};
+            double b2[SPECTRAL_APPROXIMATION_BLOCK] = {0};
+            for (auto i = 0; i < blockSize; i++)
+            {
+                u[i] = (zIn[start + i] - center) / halfWidth;
+            }
+            for (auto j = degree; j > 0; j--)
+            {
+                for (auto i = 0; i < blockSize; i++)
+                {
+                    double b0 = c[j] + 2 * u[i] * b1[i] - b2[i];
+                    b2[i] = b1[i];
+                    b1[i] = b0;
+                }
+            }
+            for (auto i = 0; i < blockSize; i++)
+            {
+                zOut[start + i] = c[0] + u[i] * b1[i] - b2[i];
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+EMSCRIPTEN_KEEPALIVE int spectralTransform(AstSpecFrame* specFrameFrom, const char* specTypeTo, const char* specUnitTo, const char* specSysTo, const int npoint, const double zIn[], const int forward, double zOut[])
+{
+    if (!specFrameFrom)
+    {
+        return 1;
+    }
+
+    AstFrameSet* cvt = getSpectralConversion(specFrameFrom, specTypeTo, specUnitTo, specSysTo);
+    if (!cvt)
+    {
+        return 1;
+    }
+
+    if (npoint >= SPECTRAL_APPROXIMATION_MIN_POINTS && approximateSpectralTransform(cvt, npoint, zIn, forward, zOut))
+    {
+        return 0;
+    }
 
     astTran1(cvt, npoint, zIn, forward, zOut);
     if (!astOK)
@@ -606,6 +834,7 @@ EMSCRIPTEN_KEEPALIVE int spectralTransform(AstSpecFrame* specFrameFrom, const ch
 
 EMSCRIPTEN_KEEPALIVE void deleteObject(AstFrameSet* src)
 {
+    clearSpectralTransformCache(reinterpret_cast<AstSpecFrame*>(src));
     astDelete(src);
 }
 
@@ -664,55 +893,211 @@ EMSCRIPTEN_KEEPALIVE AstMatrixMap* scaleMap2D(double sx, double sy)
     return astMatrixMap(2, 2, 1, diags, "");
 }
 
-EMSCRIPTEN_KEEPALIVE float* fillTransformGrid(AstFrameSet* wcsInfo, double xMin, double xMax, int nx, double yMin, double yMax, int ny, int forward)
+// Spacing of the coarse lattice of grid points that fillTransformGrid always transforms exactly
+const int TRANSFORM_GRID_CELL_SIZE = 16;
+
+struct TransformGridCell
 {
-    if (!wcsInfo)
+    int i0, j0, i1, j1;
+};
+
+// Buffers used by fillTransformGrid, kept between calls. They only grow
+struct TransformGridWorkspace
+{
+    vector<double> xIn, yIn, xOut, yOut;
+    vector<int> pointIndexes;
+    vector<unsigned char> exact;
+    vector<TransformGridCell> cells, nextCells;
+};
+
+TransformGridWorkspace transformGridWorkspace;
+
+// Fills out with the nx * ny grid of transformed points (as interleaved x, y pairs) sampled from [xMin, xMax) and [yMin, yMax).
+// With a positive tolerance, the grid is refined adaptively: starting from a coarse lattice, each cell is checked at its edge midpoints
+// and center, and if bilinear interpolation from its corners is within the tolerance there (in output units), the rest of the cell is
+// interpolated. Otherwise the cell is split in four. Returns the number of points transformed exactly, or -1 if the inputs are invalid
+EMSCRIPTEN_KEEPALIVE int fillTransformGrid(AstFrameSet* wcsInfo, double xMin, double xMax, int nx, double yMin, double yMax, int ny, int forward, double tolerance, float* out)
+{
+    if (!wcsInfo || !out || nx < 1 || ny < 1)
     {
-        return nullptr;
+        return -1;
     }
-    
+
     int N = nx * ny;
     double deltaX = (xMax - xMin) / nx;
     double deltaY = (yMax - yMin) / ny;
-    double* pixAx = new double[N];
-    double* pixAy = new double[N];
-    double* pixBx = new double[N];
-    double* pixBy = new double[N];
-    float* out = new float[N * 2];
+    TransformGridWorkspace& ws = transformGridWorkspace;
+    ws.exact.assign(N, 0);
+    ws.pointIndexes.clear();
+    ws.xIn.clear();
+    ws.yIn.clear();
+    int numTransformed = 0;
+
+    auto queuePoint = [&](int i, int j) {
+        int index = j * nx + i;
+        if (!ws.exact[index])
+        {
+            ws.exact[index] = 1;
+            ws.pointIndexes.push_back(index);
+            ws.xIn.push_back(xMin + i * deltaX);
+            ws.yIn.push_back(yMin + j * deltaY);
+        }
+    };
 
-    // Fill input array
-    for (auto i = 0; i < nx; i++) {
-        for (auto j = 0; j < ny; j++) {
-            pixAx[j * nx + i] = xMin + i * deltaX;
-            pixAy[j * nx + i] = yMin + j * deltaY;
+    // Transforms all queued points in a single call
+    auto transformQueued = [&]() {
+        int numPoints = ws.pointIndexes.size();
+        if (!numPoints)
+        {
+            return;
         }
-    }
+        ws.xOut.resize(numPoints);
+        ws.yOut.resize(numPoints);
+        // Debug: pass-through
+        if (forward < 0)
+        {
+            ws.xOut = ws.xIn;
+            ws.yOut = ws.yIn;
+        }
+        else
+        {
+            astTran2(wcsInfo, numPoints, ws.xIn.data(), ws.yIn.data(), forward, ws.xOut.data(), ws.yOut.data());
+        }
+        for (auto k = 0; k < numPoints; k++)
+        {
+            out[2 * ws.pointIndexes[k]] = ws.xOut[k];
+            out[2 * ws.pointIndexes[k] + 1] = ws.yOut[k];
+        }
+        numTransformed += numPoints;
+        ws.pointIndexes.clear();
+        ws.xIn.clear();
+        ws.yIn.clear();
+    };
 
-    // Debug: pass-through
-    if (forward < 0)
+    if (tolerance <= 0 || nx < 2 || ny < 2)
     {
-        memcpy(pixBx, pixAx, N * sizeof(double));
-        memcpy(pixBy, pixAy, N * sizeof(double));
+        for (auto j = 0; j < ny; j++)
+        {
+            for (auto i = 0; i < nx; i++)
+            {
+                queuePoint(i, j);
+            }
+        }
+        transformQueued();
+        return numTransformed;
     }
-    else
+
+    // Coarse lattice, including the last row and column
+    ws.cells.clear();
+    for (auto j0 = 0; j0 < ny - 1; j0 += TRANSFORM_GRID_CELL_SIZE)
     {
-        astTran2(wcsInfo, N, pixAx, pixAy, forward, pixBx, pixBy);
+        for (auto i0 = 0; i0 < nx - 1; i0 += TRANSFORM_GRID_CELL_SIZE)
+        {
+            TransformGridCell cell = {i0, j0, min(i0 + TRANSFORM_GRID_CELL_SIZE, nx - 1), min(j0 + TRANSFORM_GRID_CELL_SIZE, ny - 1)};
+            queuePoint(cell.i0, cell.j0);
+            queuePoint(cell.i1, cell.j0);
+            queuePoint(cell.i0, cell.j1);
+            queuePoint(cell.i1, cell.j1);
+            ws.cells.push_back(cell);
+        }
     }
+    transformQueued();
+
+    // Bilinear interpolation of one output component (0 for x, 1 for y) from the corners of the cell
+    auto interpolate = [&](const TransformGridCell& cell, int i, int j, int component) {
+        double t = double(i - cell.i0) / (cell.i1 - cell.i0);
+        double u = double(j - cell.j0) / (cell.j1 - cell.j0);
+        double v00 = out[2 * (cell.j0 * nx + cell.i0) + component];
+        double v10 = out[2 * (cell.j0 * nx + cell.i1) + component];
+        double v01 = out[2 * (cell.j1 * nx + cell.i0) + component];
+        double v11 = out[2 * (cell.j1 * nx + cell.i1) + component];
+        return (1 - u) * ((1 - t) * v00 + t * v10) + u * ((1 - t) * v01 + t * v11);
+    };
 
-    // Convert to float and fill output array
-    for (auto i = 0; i < N; i++)
+    while (!ws.cells.empty())
     {
-        out[2* i] = pixBx[i];
-        out[2 * i + 1] = pixBy[i];
-    }
+        // Transform the test points of all cells with points left to fill in one batch
+        for (const auto& cell : ws.cells)
+        {
+            int im = (cell.i0 + cell.i1) / 2;
+            int jm = (cell.j0 + cell.j1) / 2;
+            queuePoint(im, cell.j0);
+            queuePoint(im, cell.j1);
+            queuePoint(cell.i0, jm);
+            queuePoint(cell.i1, jm);
+            queuePoint(im, jm);
+        }
+        transformQueued();
 
-    // Clean up temp double precision pixels
-    delete[] pixAx;
-    delete[] pixAy;
-    delete[] pixBx;
-    delete[] pixBy;
+        ws.nextCells.clear();
+        for (const auto& cell : ws.cells)
+        {
+            int im = (cell.i0 + cell.i1) / 2;
+            int jm = (cell.j0 + cell.j1) / 2;
+            const int testPoints[5][2] = {{im, cell.j0}, {im, cell.j1}, {cell.i0, jm}, {cell.i1, jm}, {im, jm}};
+            bool accurate = true;
+            for (const auto& point : testPoints)
+            {
+                int index = point[1] * nx + point[0];
+                double errorX = out[2 * index] - interpolate(cell, point[0], point[1], 0);
+                double errorY = out[2 * index + 1] - interpolate(cell, point[0], point[1], 1);
+                // Also fails for bad (infinite) transformed values
+                if (!(hypot(errorX, errorY) <= tolerance))
+                {
+                    accurate = false;
+                    break;
+                }
+            }
+
+            if (accurate)
+            {
+                for (auto j = cell.j0; j <= cell.j1; j++)
+                {
+                    for (auto i = cell.i0; i <= cell.i1; i++)
+                    {
+                        int index = j * nx + i;
+                        if (!ws.exact[index])
+                        {
+                            out[2 * index] = interpolate(cell, i, j, 0);
+                            out[2 * index + 1] = interpolate(cell, i, j, 1);
+                        }
+                    }
+                }
+                continue;
+            }
+
+            // Split into up to four cells, keeping only those with points that are not yet transformed. Cells only one sample
+            // wide (or high) are not split along that axis, which would give cells of zero width
+            int xSplits[3] = {cell.i0, im, cell.i1};
+            int ySplits[3] = {cell.j0, jm, cell.j1};
+            int numX = 2;
+            int numY = 2;
+            if (cell.i1 - cell.i0 < 2)
+            {
+                xSplits[1] = cell.i1;
+                numX = 1;
+            }
+            if (cell.j1 - cell.j0 < 2)
+            {
+                ySplits[1] = cell.j1;
+                numY = 1;
+            }
+            for (auto b = 0; b < numY; b++)
+            {
+                for (auto a = 0; a < numX; a++)
+                {
+                    TransformGridCell child = {xSplits[a], ySplits[b], xSplits[a + 1], ySplits[b + 1]};
+                    if (child.i1 - child.i0 > 1 || child.j1 - child.j0 > 1)
+                    {
+                        ws.nextCells.push_back(child);
+                    }
+                }
+            }
+        }
+        swap(ws.cells, ws.nextCells);
+    }
 
-    return out;
+    return numTransformed;
 }
 
 EMSCRIPTEN_KEEPALIVE AstFrameSet* makeSwappedFrameSet(AstFrameSet* originFrameSet, int dirAxis, int spectralAxis, int pixelZ, int nsample)
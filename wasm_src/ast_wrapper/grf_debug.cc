@@ -2,6 +2,10 @@
 #include <string.h>
 #include <emscripten.h>
 #include <math.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
 
 extern "C" {
 #include "grf.h"
@@ -38,30 +42,118 @@ void rot2D(float* x, float* y, float cx, float cy, float angle)
     *y = rotatedY + cy;
 }
 
+// Drawing commands recorded by the GRF functions, as 32-bit words (integers, or floats stored bitwise). They are replayed on the grid
+// canvas by Module.drawGridCommands with a single call when AST flushes or ends the plot. The values must match GridCommand in post.ts
+enum GridCommand
+{
+    GRID_BEGIN = 0,      // line width: clears the canvas and resets the line width and font
+    GRID_LINE_WIDTH = 1, // line width
+    GRID_COLOR = 2,      // color index
+    GRID_FONT = 3,       // font index, size
+    GRID_POLYLINE = 4,   // number of points, snap to pixel centers, x and y of each point
+    GRID_MARKS = 5,      // shape index, number of points, x and y of each point
+    GRID_TEXT = 6        // offset of the text in gridStrings, x, y, angle, horizontal and vertical alignment (0 to keep the current one)
+};
+
+std::vector<int32_t> gridCommands;
+std::vector<char> gridStrings;
+int appliedFontVal = -1;
+double appliedFontSize = -1;
+double pixelRatio = 1;
+
+// Measured text widths, keyed by font, size, device pixel ratio and text. Cleared by clearGridTextCache when the fonts change
+std::map<std::string, float> textWidths;
+const size_t MAX_CACHED_TEXT_WIDTHS = 4096;
+
+EMSCRIPTEN_KEEPALIVE void clearGridTextCache()
+{
+    textWidths.clear();
+}
+
+void pushCommand(int32_t value)
+{
+    gridCommands.push_back(value);
+}
+
+void pushCommandFloat(float value)
+{
+    int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    gridCommands.push_back(bits);
+}
+
+void flushGridCommands()
+{
+    if (gridCommands.empty())
+    {
+        return;
+    }
+    EM_ASM_({Module.drawGridCommands($0, $1, $2);}, gridCommands.data(), gridCommands.size(), gridStrings.data());
+    gridCommands.clear();
+    gridStrings.clear();
+    // Measuring text changes the font of the canvas, so the state is set again by the next commands
+    appliedColorVal = -1;
+    appliedFontVal = -1;
+    appliedFontSize = -1;
+}
+
 void applyColor(int primType)
 {
     int index = ((int) colorVals[primType]) % numColors;
-    EM_ASM_({
-        Module.gridContext.strokeStyle = Module.colors[$0];
-        Module.gridContext.fillStyle = Module.colors[$0];
-    }, index);
-    appliedColorVal = index;
+    if (index != appliedColorVal)
+    {
+        pushCommand(GRID_COLOR);
+        pushCommand(index);
+        appliedColorVal = index;
+    }
 }
 
 void applyFont(int primType)
 {
     double height = fontSizeVals[primType];
     int index = ((int) fontVals[primType]) % numFonts;
+    if (index != appliedFontVal || height != appliedFontSize)
+    {
+        pushCommand(GRID_FONT);
+        pushCommand(index);
+        pushCommandFloat(height);
+        appliedFontVal = index;
+        appliedFontSize = height;
+    }
+}
+
+// Width of the text in the font of the primitive type
+float measureText(int primType, const char* text)
+{
+    double height = fontSizeVals[primType];
+    int index = ((int) fontVals[primType]) % numFonts;
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%d:%g:%g:", index, height, pixelRatio);
+    std::string key = std::string(prefix) + text;
+
+    auto cached = textWidths.find(key);
+    if (cached != textWidths.end())
+    {
+        return cached->second;
+    }
 
-    EM_ASM_({
+    float width = EM_ASM_DOUBLE({
         var font = Module.fonts[$0];
         font = font.replace("{size}", $1 * devicePixelRatio + "px");
         Module.gridContext.font = font;
-    }, index, height);
+        return Module.gridContext.measureText(UTF8ToString($2)).width;
+    }, index, height, text);
+    if (textWidths.size() >= MAX_CACHED_TEXT_WIDTHS)
+    {
+        textWidths.clear();
+    }
+    textWidths[key] = width;
+    return width;
 }
 
 int astGFlush(void)
 {
+    flushGridCommands();
     return 1;
 }
 
@@ -72,27 +164,16 @@ int astGLine(int n, const float* x, const float* y)
     {
         return 1;
     }
-    EM_ASM_({
-        Module.gridContext.beginPath();
-        Module.gridContext.moveTo($0, $1);
-    }, x[0], y[0]);
 
-    if (lineThickness <= 1)
-    {
-        // Round coordinates to the nearest pixel center for sharp lines
-        for (int i = 0; i < n; i++)
-        {
-            EM_ASM_({Module.gridContext.lineTo(Math.floor($0)+0.5, Math.floor($1)+0.5);}, x[i], y[i]);
-        }
-    }
-    else
+    // Lines up to 1 pixel wide are snapped to the nearest pixel center for sharp lines
+    pushCommand(GRID_POLYLINE);
+    pushCommand(n);
+    pushCommand(lineThickness <= 1);
+    for (int i = 0; i < n; i++)
     {
-        for (int i = 0; i < n; i++)
-        {
-            EM_ASM_({Module.gridContext.lineTo($0, $1);}, x[i], y[i]);
-        }
+        pushCommandFloat(x[i]);
+        pushCommandFloat(y[i]);
     }
-    EM_ASM(Module.gridContext.stroke(););
     return 1;
 }
 
@@ -101,10 +182,9 @@ int astGQch(float* chv, float* chh)
     // canvas does not provide an easy method of measuring height.
     // measuring the width of the character "E" and doubling is a crude approximation
     float height = fontSizeVals[GRF__TEXT];
-    applyFont(GRF__FONT);
     if (height < 0)
     {
-        height = EM_ASM_DOUBLE({return 2*Module.gridContext.measureText("e").width;});
+        height = 2 * measureText(GRF__TEXT, "e");
     }
 
     if (chh)
@@ -129,22 +209,13 @@ int astGMark(int n, const float* x, const float* y, int type)
         return 1;
     }
 
-    EM_ASM_({
-        Module.gridContext.textAlign = "center";
-        Module.gridContext.textBaseline = "middle";
-        var index = Math.max(Math.min($0, Module.shapes.length -1), 0);
-        Module.gridContext.symbolText = Module.shapes[index];
-    }, type);
-
+    pushCommand(GRID_MARKS);
+    pushCommand(type);
+    pushCommand(n);
     for (int i = 0; i < n; i++)
     {
-        EM_ASM_({
-            Module.gridContext.save();
-            Module.gridContext.translate($0, $1);
-            Module.gridContext.scale(1, -1);
-            Module.gridContext.fillText(Module.gridContext.symbolText, 0, 0);
-            Module.gridContext.restore();
-        }, x[i], y[i]);
+        pushCommandFloat(x[i]);
+        pushCommandFloat(y[i]);
     }
     return 1;
 }
@@ -158,21 +229,24 @@ int astGText(const char* text, float x, float y, const char* just,
     {
         return 0;
     }
+
+    // Alignments are 1 to 3 for left / center / right and top / middle / bottom, or 0 to keep the current one
+    int hAlign = 0;
     int justLength = strlen(just);
     if (justLength >= 2)
     {
         char hJust = just[1];
         if (hJust == 'C')
         {
-            EM_ASM(Module.gridContext.textAlign = "center";);
+            hAlign = 2;
         }
         else if (hJust == 'L')
         {
-            EM_ASM(Module.gridContext.textAlign = "left";);
+            hAlign = 1;
         }
         else if (hJust == 'R')
         {
-            EM_ASM(Module.gridContext.textAlign = "right";);
+            hAlign = 3;
         }
         else
         {
@@ -180,18 +254,19 @@ int astGText(const char* text, float x, float y, const char* just,
         }
     }
 
+    int vAlign = 0;
     char vJust = just[0];
     if (vJust == 'T')
     {
-        EM_ASM(Module.gridContext.textBaseline = "top";);
+        vAlign = 1;
     }
     else if (vJust == 'C')
     {
-        EM_ASM(Module.gridContext.textBaseline = "middle";);
+        vAlign = 2;
     }
     else if (vJust == 'B')
     {
-        EM_ASM(Module.gridContext.textBaseline = "bottom";);
+        vAlign = 3;
     }
     else
     {
@@ -199,14 +274,14 @@ int astGText(const char* text, float x, float y, const char* just,
     }
 
     float angle = atan2f(-upx, upy);
-    EM_ASM_({
-        Module.gridContext.save();
-        Module.gridContext.translate($1, $2);
-        Module.gridContext.rotate($3);
-        Module.gridContext.scale(1, -1);
-        Module.gridContext.fillText(UTF8ToString($0), 0, 0);
-        Module.gridContext.restore();
-    }, text, x, y, angle);
+    pushCommand(GRID_TEXT);
+    pushCommand(gridStrings.size());
+    pushCommandFloat(x);
+    pushCommandFloat(y);
+    pushCommandFloat(angle);
+    pushCommand(hAlign);
+    pushCommand(vAlign);
+    gridStrings.insert(gridStrings.end(), text, text + strlen(text) + 1);
 
     return 1;
 }
@@ -215,12 +290,11 @@ int astGTxExt(const char* text, float x, float y, const char* just,
               float upx, float upy, float* xb, float* yb)
 {
     float height = fontSizeVals[GRF__TEXT];
-    applyFont(GRF__TEXT);
     if (height < 0)
     {
-        height = EM_ASM_DOUBLE({return 2*Module.gridContext.measureText("e").width;});
+        height = 2 * measureText(GRF__TEXT, "e");
     }
-    float width = EM_ASM_DOUBLE({return Module.gridContext.measureText(UTF8ToString($0)).width;}, text);
+    float width = measureText(GRF__TEXT, text);
 
     if (!just)
     {
@@ -305,7 +379,8 @@ int astGAttr(int attr, double value, double* old_value, int prim)
         if (value != AST__BAD)
         {
             lineThickness = value;
-            EM_ASM_({Module.gridContext.lineWidth = $0;}, lineThickness);
+            pushCommand(GRID_LINE_WIDTH);
+            pushCommandFloat(lineThickness);
         }
     }
     else if (attr == GRF__COLOUR)
@@ -358,11 +433,14 @@ int astGBBuf(void)
 {
     numColors = EM_ASM_INT({return Module.colors.length;});
     numFonts = EM_ASM_INT({return Module.fonts.length;});
-    EM_ASM_({
-        Module.gridContext.lineWidth = $0 * devicePixelRatio;
-        Module.gridContext.font = Module.fonts[0];
-        Module.gridContext.clearRect(0, 0, Module.gridContext.canvas.width, Module.gridContext.canvas.height);
-    }, lineThickness);
+    pixelRatio = EM_ASM_DOUBLE({return devicePixelRatio;});
+    gridCommands.clear();
+    gridStrings.clear();
+    appliedColorVal = -1;
+    appliedFontVal = -1;
+    appliedFontSize = -1;
+    pushCommand(GRID_BEGIN);
+    pushCommandFloat(lineThickness);
     fontSizeVals[0] = 20;
     fontSizeVals[1] = 20;
     fontSizeVals[2] = 20;
@@ -371,6 +449,7 @@ int astGBBuf(void)
 
 int astGEBuf(void)
 {
+    flushGridCommands();
     return 1;
 }
 
@@ -49,6 +49,7 @@ export function geodesicDistance(frameSet: FrameSet, x1: number, y1: number, x2:
 export function format(frameSet: FrameSet, axis: number, value: number): string;
 // Not exported unformat()
 // Not exported transform(), transform3D(), spectralTransform()
+export function clearSpectralTransformCache(specFrame?: SpecFrame): void;
 export function getLastErrorMessage(): string;
 export function clearLastErrorMessage(): void;
 export function copy<T extends AstObject>(src: T): T;
@@ -76,7 +77,7 @@ export function transform3DPoint(frameSet: FrameSet, x: number, y: number, z: nu
 export function transformSpectralPoint(specFrame: SpecFrame, specType: string, specUnit: string, specSys: string, z: number, forward?: boolean);
 export function transformSpectralPointArray(specFrame: SpecFrame, specType: string, specUnit: string, specSys: string, zIn: Float64Array | Array<number>, forward?: boolean): Float64Array;
 export function normalizeCoordinates(frameSet: FrameSet, x: number, y: number): {x: number; y: number};
-export function getTransformGrid(transformFrameSet: FrameSet, xMin: number, xMax: number, numX: number, yMin: number, yMax: number, numY: number, forward: boolean);
+export function getTransformGrid(transformFrameSet: FrameSet, xMin: number, xMax: number, numX: number, yMin: number, yMax: number, numY: number, forward: boolean, tolerance?: number, out?: Float32Array): Float32Array | null;
 export function transform3DPointArrays(frameSet: FrameSet, xIn: Float64Array, yIn: Float64Array, zIn: Float64Array, forward?: boolean): {x: Float64Array, y: Float64Array, z: Float64Array};
 
 export const onReady: Promise<void>;
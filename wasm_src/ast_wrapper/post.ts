@@ -18,6 +18,8 @@ Module.LABEL_EXTERIOR = 0;
 Module.LABEL_INTERIOR = 1;
 Module.DEFAULT_TOLERANCE = 0.01;
 Module.DEFAULT_COLOR = 2;
+// Maximum interpolation error of transform grids, in output pixels
+Module.DEFAULT_GRID_TOLERANCE = 0.001;
 Module.DEFAULT_FONT = "20px Arial";
 Module.SYS_ECLIPTIC = 0;
 Module.SYS_FK4 = 1;
@@ -85,6 +87,7 @@ Module.setColor = function (color, index) {
 
 Module.setFontList = function (fonts) {
     Module.fonts = fonts;
+    Module.clearGridTextCache();
 };
 
 Module.setCanvas = function (canvas) {
@@ -95,6 +98,121 @@ Module.setCanvas = function (canvas) {
     Module.gridContext.font = Module.font;
 };
 
+// Commands recorded by the GRF functions in grf_debug.cc (GridCommand)
+const GridCommand = {
+    BEGIN: 0,
+    LINE_WIDTH: 1,
+    COLOR: 2,
+    FONT: 3,
+    POLYLINE: 4,
+    MARKS: 5,
+    TEXT: 6
+};
+const TextAlignments = ["", "left", "center", "right"];
+const TextBaselines = ["", "top", "middle", "bottom"];
+
+// Draws the commands recorded in WASM memory on the grid canvas. Consecutive polylines are stroked as a single path
+Module.drawGridCommands = function (commandsPtr: number, numWords: number, stringsPtr: number) {
+    const ctx = Module.gridContext;
+    if (!ctx) {
+        return;
+    }
+    const ints = Module.HEAP32;
+    const floats = Module.HEAPF32;
+    const end = commandsPtr / 4 + numWords;
+    let i = commandsPtr / 4;
+    let pathOpen = false;
+
+    while (i < end) {
+        const command = ints[i++];
+        if (pathOpen && command !== GridCommand.POLYLINE) {
+            ctx.stroke();
+            pathOpen = false;
+        }
+
+        switch (command) {
+            case GridCommand.BEGIN:
+                ctx.lineWidth = floats[i++] * devicePixelRatio;
+                ctx.font = Module.fonts[0];
+                ctx.clearRect(0, 0, ctx.canvas.width, ctx.canvas.height);
+                break;
+            case GridCommand.LINE_WIDTH:
+                ctx.lineWidth = floats[i++];
+                break;
+            case GridCommand.COLOR: {
+                const color = Module.colors[ints[i++]];
+                ctx.strokeStyle = color;
+                ctx.fillStyle = color;
+                break;
+            }
+            case GridCommand.FONT: {
+                const font = Module.fonts[ints[i++]];
+                ctx.font = font.replace("{size}", floats[i++] * devicePixelRatio + "px");
+                break;
+            }
+            case GridCommand.POLYLINE: {
+                const n = ints[i++];
+                const snap = ints[i++];
+                if (!pathOpen) {
+                    ctx.beginPath();
+                    pathOpen = true;
+                }
+                ctx.moveTo(floats[i], floats[i + 1]);
+                for (let j = 0; j < n; j++, i += 2) {
+                    if (snap) {
+                        ctx.lineTo(Math.floor(floats[i]) + 0.5, Math.floor(floats[i + 1]) + 0.5);
+                    } else {
+                        ctx.lineTo(floats[i], floats[i + 1]);
+                    }
+                }
+                break;
+            }
+            case GridCommand.MARKS: {
+                const symbol = Module.shapes[Math.max(Math.min(ints[i++], Module.shapes.length - 1), 0)];
+                const n = ints[i++];
+                ctx.textAlign = "center";
+                ctx.textBaseline = "middle";
+                for (let j = 0; j < n; j++, i += 2) {
+                    ctx.save();
+                    ctx.translate(floats[i], floats[i + 1]);
+                    ctx.scale(1, -1);
+                    ctx.fillText(symbol, 0, 0);
+                    ctx.restore();
+                }
+                break;
+            }
+            case GridCommand.TEXT: {
+                const text = Module.UTF8ToString(stringsPtr + ints[i]);
+                const x = floats[i + 1];
+                const y = floats[i + 2];
+                const angle = floats[i + 3];
+                if (ints[i + 4]) {
+                    ctx.textAlign = TextAlignments[ints[i + 4]];
+                }
+                if (ints[i + 5]) {
+                    ctx.textBaseline = TextBaselines[ints[i + 5]];
+                }
+                i += 6;
+                ctx.save();
+                ctx.translate(x, y);
+                ctx.rotate(angle);
+                ctx.scale(1, -1);
+                ctx.fillText(text, 0, 0);
+                ctx.restore();
+                break;
+            }
+            default:
+                // The length of an unknown command is unknown too, so the rest of the buffer is ignored
+                return;
+        }
+    }
+
+    if (pathOpen) {
+        ctx.stroke();
+    }
+};
+
+Module.clearGridTextCache = Module.cwrap("clearGridTextCache", null, []);
 Module.plot = Module.cwrap("plotGrid", "number", ["number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "string", "boolean", "boolean", "number", "number", "number", "number"]);
 Module.emptyFitsChan = Module.cwrap("emptyFitsChan", "number");
 Module.putFits = Module.cwrap("putFits", null, ["number", "string"]);
@@ -116,6 +234,7 @@ Module.transform = Module.cwrap("transform", "number", ["number", "number", "num
 Module.transform3D = Module.cwrap("transform3D", "number", ["number", "number", "number", "number", "number", "number"]);
 Module.transform3DArray = Module.cwrap("transform3DArray", "number", ["number", "number", "number", "number", "number"]);
 Module.spectralTransform = Module.cwrap("spectralTransform", "number", ["number", "string", "string", "string", "number", "number", "number", "number"]);
+Module.clearSpectralTransformCache = Module.cwrap("clearSpectralTransformCache", null, ["number"]);
 Module.getLastErrorMessage = Module.cwrap("getLastErrorMessage", "string");
 Module.clearLastErrorMessage = Module.cwrap("clearLastErrorMessage", null);
 Module.copy = Module.cwrap("copy", null, ["number"]);
@@ -129,7 +248,7 @@ Module.addFrame = Module.cwrap("addFrame", null, ["number", "number", "number",
 Module.setI = Module.cwrap("setI", null, ["number", "string", "number"]);
 Module.setD = Module.cwrap("setD", null, ["number", "string", "number"]);
 Module.createTransformedFrameset = Module.cwrap("createTransformedFrameset", "number", ["number", "number", "number", "number", "number", "number", "number", "number"]);
-Module.fillTransformGrid = Module.cwrap("fillTransformGrid", "number", ["number", "number", "number", "number", "number", "number", "number", "number"]);
+Module.fillTransformGrid = Module.cwrap("fillTransformGrid", "number", ["number", "number", "number", "number", "number", "number", "number", "number", "number", "number"]);
 Module.pointList = Module.cwrap("pointList", "number", ["number", "number", "number", "number", "number"]);
 Module.axPointList = Module.cwrap("axPointList", "number", ["number", "number", "number", "number", "number", "number", "number"]);
 Module.makeSwappedFrameSet = Module.cwrap("makeSwappedFrameSet", "number", ["number", "number", "number", "number", "number"]);
@@ -338,15 +457,41 @@ Module.normalizeCoordinates = function (wcsInfo, xIn, yIn) {
     return {x: xOut[0], y: xOut[1]};
 };
 
-Module.getTransformGrid = function (transformFrameSet: number, xMin: number, xMax: number, nx: number, yMin: number, yMax: number, ny: number, forward: number) {
-    const out = Module.fillTransformGrid(transformFrameSet, xMin, xMax, nx, yMin, yMax, ny, forward);
-    if (out) {
-        const outArray = new Float32Array(Module.HEAPF32.buffer, out, nx * ny * 2).slice();
-        Module._free(out);
-        return outArray;
-    } else {
+// Heap buffer for the transform grids, which only grows
+Module.transformGridPtr = 0;
+Module.transformGridLength = 0;
+
+// Fills out (or a new array, if it is not given or too short) with the nx * ny grid of transformed points, as interleaved x, y pairs.
+// Points are interpolated where that is accurate to the tolerance; a tolerance of 0 transforms every point exactly
+Module.getTransformGrid = function (
+    transformFrameSet: number,
+    xMin: number,
+    xMax: number,
+    nx: number,
+    yMin: number,
+    yMax: number,
+    ny: number,
+    forward: number,
+    tolerance: number = Module.DEFAULT_GRID_TOLERANCE,
+    out: Float32Array = null
+) {
+    const N = nx * ny * 2;
+    if (Module.transformGridLength < N) {
+        if (Module.transformGridPtr) {
+            Module._free(Module.transformGridPtr);
+        }
+        Module.transformGridPtr = Module._malloc(N * 4);
+        Module.transformGridLength = N;
+    }
+
+    if (Module.fillTransformGrid(transformFrameSet, xMin, xMax, nx, yMin, yMax, ny, forward, tolerance, Module.transformGridPtr) < 0) {
         return null;
     }
+    if (!out || out.length < N) {
+        out = new Float32Array(N);
+    }
+    out.set(new Float32Array(Module.HEAPF32.buffer, Module.transformGridPtr, N));
+    return out;
 };
 
 Module.onReady = new Promise(function (func) {
@@ -6,6 +6,7 @@
 #include "gsl/gsl_statistics.h"
 #include "gsl/gsl_statistics_double.h"
 #include "gsl/gsl_sort_int.h"
+#include "gsl/gsl_fft_complex.h"
 #include <math.h>
 #include "gsl/gsl_fit.h"
 #include "gsl/gsl_multifit.h"
@@ -16,17 +17,56 @@
 #include <gsl/gsl_multifit_nlinear.h>
 #include <iostream>
 #include <string.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+/*
+ * Smoothing kernels, templated on the input type so that Float32 profiles can be smoothed without first converting
+ * them to double. Output is always double
+ */
+
+/* Neumaier's compensated summation, so that the running sums don't drift over long profiles */
+struct CompensatedSum {
+    double sum = 0;
+    double compensation = 0;
 
-extern "C" {
+    void add(const double val) {
+        const double t = sum + val;
+        if (fabs(sum) >= fabs(val)) {
+            compensation += (sum - t) + val;
+        } else {
+            compensation += (val - t) + sum;
+        }
+        sum = t;
+    }
 
-int EMSCRIPTEN_KEEPALIVE linearRegression(const double *x, const double *y, size_t n, double *c0, double *c1, double *cov00, double *cov01, double *cov11, double *sumsq) {
-    return gsl_fit_linear(x, 1, y, 1, n, c0, c1, cov00, cov01, cov11, sumsq);
+    double value() const {
+        return sum + compensation;
+    }
+};
+
+/*
+ * Mean of a window with the same recurrence as gsl_stats_mean, so that windows containing infinite values give the same
+ * result as averaging each window directly
+ */
+template <typename T>
+double directMean(const T* window, const size_t n) {
+    long double mean = 0;
+    for (size_t i = 0; i < n; i++) {
+        mean += (window[i] - mean) / (i + 1);
+    }
+    return (double)mean;
 }
 
-int EMSCRIPTEN_KEEPALIVE filterBoxcar(double* yInArray, const int N, double* yOutArray, const int kernel) {
-    int status = 0;    /* return value: 0 = success */
-    gsl_vector_view yIn = gsl_vector_view_array(yInArray, N);
-    double* window = new double[kernel];
+/*
+ * Moving average with a running sum, in O(N) regardless of the kernel size. Edge values without a full window are NaN.
+ * nanMode = 0: a window containing NaN values gives NaN, and a window containing infinite values is averaged directly,
+ * as the running sum can't remove them again. nanMode = 1: NaN and infinite values are skipped
+ */
+template <typename T>
+void boxcar(const T* yInArray, const size_t N, double* yOutArray, const int kernel, const int nanMode) {
     size_t H, J;
     if (kernel % 2 == 0) {
         H = kernel / 2 - 1;
@@ -36,137 +76,356 @@ int EMSCRIPTEN_KEEPALIVE filterBoxcar(double* yInArray, const int N, double* yOu
         J = (kernel - 1) / 2;
     }
 
+    CompensatedSum sum;
+    size_t validCount = 0;
+    size_t nanCount = 0;
+    size_t infCount = 0;
+    auto update = [&](const T val, const bool entering) {
+        size_t& counter = isfinite(val) ? validCount : (isnan(val) ? nanCount : infCount);
+        if (entering) {
+            counter++;
+        } else {
+            counter--;
+        }
+        if (isfinite(val)) {
+            sum.add(entering ? (double)val : -(double)val);
+        }
+    };
     for (size_t i = 0; i < N; ++i) {
+        // add the value entering the window, and remove the value leaving it
+        if (i == 0) {
+            for (size_t j = 0; j < J && j < N; ++j) {
+                update(yInArray[j], true);
+            }
+        }
+        if (i + J < N) {
+            update(yInArray[i + J], true);
+        }
+        if (i > H) {
+            update(yInArray[i - H - 1], false);
+        }
+
         // set edge values NaN
-        if (i < H || i > N - 1 - J) {
+        if (i < H || i + J >= N) {
             yOutArray[i] = NAN;
-            continue;
+        } else if (nanMode == 0 && nanCount) {
+            yOutArray[i] = NAN;
+        } else if (nanMode == 0 && infCount) {
+            yOutArray[i] = directMean(yInArray + i - H, H + J + 1);
+        } else if (validCount == 0) {
+            yOutArray[i] = NAN;
+        } else {
+            yOutArray[i] = sum.value() / validCount;
         }
-        size_t wsize = gsl_movstat_fill(GSL_MOVSTAT_END_PADZERO, &yIn.vector, i, H, J, window);
-        yOutArray[i] = gsl_stats_mean(window, 1, wsize);
     }
-
-
-    delete[] window;
-
-    return status;
 }
 
-int EMSCRIPTEN_KEEPALIVE filterGaussian(double* yInArray, const int N, double* yOutArray, const int kernel, const double alpha) {
-    int status = 0;    /* return value: 0 = success */
-    gsl_vector_view yIn = gsl_vector_view_array(yInArray, N);
-    gsl_vector_view yOut = gsl_vector_view_array(yOutArray, N);
-    gsl_filter_gaussian_workspace* w = gsl_filter_gaussian_alloc(kernel);
+/* Smoothing kernel weights, normalised to unit sum, for a symmetric window of 2H + 1 points */
+struct SmoothingKernel {
+    size_t H = 0;
+    double alpha = NAN;
+    std::vector<double> weights;
+};
 
-    gsl_filter_gaussian(GSL_FILTER_END_PADZERO, alpha, 0, &yIn.vector, &yOut.vector, w);
+/*
+ * Kernel weights, the kernel spectrum and scratch buffer of the FFT convolution, and Savitzky-Golay coefficients of the
+ * last filter applied, as the same filter is usually applied to many profiles. Owned by the caller (see
+ * smoothingContextCreate and StreamingSmoother), so that nothing is kept between calls of the module otherwise
+ */
+struct SmoothingContext {
+    SmoothingKernel gaussian;
+    SmoothingKernel hanning;
+    std::vector<double> kernelSpectrum;
+    std::vector<double> scratch;
+    size_t spectrumM = 0;
+    size_t spectrumH = 0;
+    double spectrumAlpha = NAN;
+    std::vector<double> savitzkyGolay;
+    size_t savitzkyGolayH = 0;
+    int savitzkyGolayOrder = -1;
+};
 
-    // set edge values NaN
-    for (size_t i = 0; i < (kernel - 1) / 2; i++) {
-        yOutArray[i] = NAN;
-        yOutArray[N - 1 - i] = NAN;
+/* Same weights as gsl_filter_gaussian_kernel (order 0, normalised) for a window of K = 2H + 1 points */
+static const SmoothingKernel& gaussianKernel(SmoothingContext& context, const int kernel, const double alpha) {
+    SmoothingKernel& cached = context.gaussian;
+    const size_t H = kernel / 2;
+    if (cached.H == H && cached.alpha == alpha && !cached.weights.empty()) {
+        return cached;
     }
 
-    gsl_filter_gaussian_free(w);
-
-    return status;
+    cached.H = H;
+    cached.alpha = alpha;
+    cached.weights.assign(2 * H + 1, 1.0);
+    if (H > 0) {
+        double sum = 0;
+        for (size_t i = 0; i < 2 * H + 1; i++) {
+            const double xi = ((double)i - H) / H;
+            cached.weights[i] = exp(-0.5 * alpha * alpha * xi * xi);
+            sum += cached.weights[i];
+        }
+        for (double& weight : cached.weights) {
+            weight /= sum;
+        }
+    }
+    return cached;
 }
 
-double hanningWindow(const size_t n, double window[], void* params) {
-    double val = 0;
-    double sum = 0;
+/* Hanning weights 0.5 * (1 - cos(2 pi (i + 1) / (n + 1))) for a window of n = 2H + 1 points */
+static const SmoothingKernel& hanningKernel(SmoothingContext& context, const int kernel) {
+    SmoothingKernel& cached = context.hanning;
+    const size_t H = kernel / 2;
+    if (cached.H == H && !cached.weights.empty()) {
+        return cached;
+    }
 
+    const size_t n = 2 * H + 1;
+    cached.H = H;
+    cached.weights.resize(n);
+    double sum = 0;
     for (size_t i = 0; i < n; i++) {
-        double hanningVal = (0.5 * (1 - gsl_sf_cos(2 * M_PI * (i + 1) / (n + 1))));
-        val += hanningVal * window[i];
-        sum += hanningVal;
+        cached.weights[i] = 0.5 * (1 - cos(2 * M_PI * (i + 1) / (n + 1)));
+        sum += cached.weights[i];
     }
-
-    return val / sum;
+    for (double& weight : cached.weights) {
+        weight /= sum;
+    }
+    return cached;
 }
 
-int EMSCRIPTEN_KEEPALIVE filterHanning(double* yInArray, const int N, double* yOutArray, const int kernel) {
-    int status = 0;    /* return value: 0 = success */
-    gsl_vector_view yIn = gsl_vector_view_array(yInArray, N);
-    gsl_vector_view yOut = gsl_vector_view_array(yOutArray, N);
-    gsl_movstat_workspace* w = gsl_movstat_alloc(kernel);
-    gsl_movstat_function F;
-
-    F.function = hanningWindow;
-    gsl_movstat_apply(GSL_MOVSTAT_END_PADZERO, &F, &yIn.vector, &yOut.vector, w);
-
-    // set edge values NaN
-    for (size_t i = 0; i < (kernel - 1) / 2; i++) {
-        yOutArray[i] = NAN;
-        yOutArray[N - 1 - i] = NAN;
+/*
+ * Direct convolution with a symmetric kernel, treating values beyond the ends as zero (as GSL_MOVSTAT_END_PADZERO).
+ * The interior loop is a plain dot product over contiguous memory, so that the compiler can vectorise it
+ */
+template <typename T>
+void convolvePadZero(const T* yInArray, const size_t N, double* yOutArray, const SmoothingKernel& kernel) {
+    const size_t H = kernel.H;
+    const size_t K = 2 * H + 1;
+    const double* weights = kernel.weights.data();
+    for (size_t i = 0; i < N; i++) {
+        double sum = 0;
+        if (i >= H && i + H < N) {
+            const T* window = yInArray + (i - H);
+            for (size_t j = 0; j < K; j++) {
+                sum += weights[j] * window[j];
+            }
+        } else {
+            for (size_t j = 0; j < K; j++) {
+                if (i + j >= H && i + j - H < N) {
+                    sum += weights[j] * yInArray[i + j - H];
+                }
+            }
+        }
+        yOutArray[i] = sum;
     }
+}
 
+/*
+ * Kernels at least this wide are applied with FFTs, whose cost doesn't depend on the kernel size. Below it, the direct
+ * convolution is faster
+ */
+const size_t FFT_KERNEL_THRESHOLD = 256;
+
+/*
+ * Zero-padded convolution through a radix-2 FFT of length M >= N + H, which is long enough that the circular
+ * convolution never wraps around into the output. The kernel spectrum of the last (M, kernel) is kept in the context. The result
+ * differs from the direct convolution by rounding only: the absolute error is within about 1e-12 of max |y| for
+ * profiles of 100k points, and 1e-11 for a million points. NaN values would spread over the whole FFT, so the caller must check for them.
+ * Returns false if the FFT failed
+ */
+template <typename T>
+bool convolvePadZeroFFT(SmoothingContext& context, const T* yInArray, const size_t N, double* yOutArray, const SmoothingKernel& kernel) {
+    std::vector<double>& kernelSpectrum = context.kernelSpectrum;
+    std::vector<double>& scratch = context.scratch;
+
+    const size_t H = kernel.H;
+    size_t M = 1;
+    while (M < N + H) {
+        M *= 2;
+    }
 
-    gsl_movstat_free(w);
+    if (context.spectrumM != M || context.spectrumH != H || !(context.spectrumAlpha == kernel.alpha)) {
+        // the kernel is centred on index 0, wrapping negative offsets to the end
+        kernelSpectrum.assign(2 * M, 0.0);
+        for (size_t j = 0; j < 2 * H + 1; j++) {
+            const size_t index = (j + M - H) % M;
+            kernelSpectrum[2 * index] = kernel.weights[j];
+        }
+        if (gsl_fft_complex_radix2_forward(kernelSpectrum.data(), 1, M) != GSL_SUCCESS) {
+            context.spectrumM = 0;
+            return false;
+        }
+        context.spectrumM = M;
+        context.spectrumH = H;
+        context.spectrumAlpha = kernel.alpha;
+    }
 
-    return status;
+    scratch.assign(2 * M, 0.0);
+    for (size_t i = 0; i < N; i++) {
+        scratch[2 * i] = yInArray[i];
+    }
+    if (gsl_fft_complex_radix2_forward(scratch.data(), 1, M) != GSL_SUCCESS) {
+        return false;
+    }
+    for (size_t i = 0; i < M; i++) {
+        const double re = scratch[2 * i] * kernelSpectrum[2 * i] - scratch[2 * i + 1] * kernelSpectrum[2 * i + 1];
+        const double im = scratch[2 * i] * kernelSpectrum[2 * i + 1] + scratch[2 * i + 1] * kernelSpectrum[2 * i];
+        scratch[2 * i] = re;
+        scratch[2 * i + 1] = im;
+    }
+    if (gsl_fft_complex_radix2_inverse(scratch.data(), 1, M) != GSL_SUCCESS) {
+        return false;
+    }
+    for (size_t i = 0; i < N; i++) {
+        yOutArray[i] = scratch[2 * i];
+    }
+    return true;
 }
 
-int EMSCRIPTEN_KEEPALIVE filterDecimation(double* xInArray, double* yInArray, const int inN, double* xOutArray, double* yOutArray, const int outN, const int decimationWidth) {
-    int status = 0;    /* return value: 0 = success */
-    int* indexArray = new int[outN];
-    int remainder = inN % decimationWidth;
+/* Wide kernels on finite data use the FFT convolution, everything else the direct convolution */
+template <typename T>
+void convolveGaussian(SmoothingContext& context, const T* yInArray, const size_t N, double* yOutArray, const int kernel, const double alpha) {
+    const SmoothingKernel& weights = gaussianKernel(context, kernel, alpha);
+    if (kernel >= (int)FFT_KERNEL_THRESHOLD) {
+        bool finite = true;
+        for (size_t i = 0; i < N && finite; i++) {
+            finite = isfinite(yInArray[i]);
+        }
+        if (finite && convolvePadZeroFFT(context, yInArray, N, yOutArray, weights)) {
+            return;
+        }
+    }
+    convolvePadZero(yInArray, N, yOutArray, weights);
+}
 
-    for (size_t i = 0; i <= inN / decimationWidth; i++) {
+/*
+ * Savitzky-Golay smoothing coefficients for a window of 2H + 1 uniformly spaced points: the value at the centre of the
+ * least-squares polynomial fit is a fixed linear combination of the window values. With the normal matrix M = A^T A of
+ * the design matrix A[j][k] = t_j^k, the coefficients are c_j = sum_k z_k t_j^k, where M z = e_0. Offsets are scaled to
+ * t_j = j / H, which keeps M well-conditioned for wide kernels without changing the fitted value at the centre.
+ * The coefficients of the last (H, order) are kept in the context
+ */
+static const std::vector<double>& savitzkyGolayCoefficients(SmoothingContext& context, const size_t H, const int order) {
+    std::vector<double>& coefficients = context.savitzkyGolay;
+    if (context.savitzkyGolayH == H && context.savitzkyGolayOrder == order && !coefficients.empty()) {
+        return coefficients;
+    }
 
-        if (i == inN / decimationWidth && (remainder == 0 || remainder == 1)) {
-            // remainder = 0, the last data of yIn has already been handled when i = inN / decimationWidth - 1
-            // remainder = 1, only 1 data remains, so there is no need to perform min/max search
-            if (remainder == 1) {
-                indexArray[outN - 1] = inN - 1;
+    const size_t cNum = order + 1;
+    const size_t wsize = 2 * H + 1;
+    const double scale = H > 0 ? 1.0 / H : 1.0;
+
+    // augmented normal matrix [M | e_0]
+    std::vector<double> M(cNum * (cNum + 1), 0.0);
+    for (size_t j = 0; j < wsize; j++) {
+        const double t = ((double)j - H) * scale;
+        double tPow = 1;
+        std::vector<double> powers(2 * cNum - 1);
+        for (size_t k = 0; k < powers.size(); k++) {
+            powers[k] = tPow;
+            tPow *= t;
+        }
+        for (size_t r = 0; r < cNum; r++) {
+            for (size_t c = 0; c < cNum; c++) {
+                M[r * (cNum + 1) + c] += powers[r + c];
             }
-            break;
         }
-
-        int localWidth = decimationWidth;
-        if (i == inN / decimationWidth && remainder > 1) {
-            localWidth = remainder;
+    }
+    M[cNum] = 1;
+
+    // Gauss-Jordan elimination with partial pivoting
+    for (size_t c = 0; c < cNum; c++) {
+        size_t pivot = c;
+        for (size_t r = c + 1; r < cNum; r++) {
+            if (fabs(M[r * (cNum + 1) + c]) > fabs(M[pivot * (cNum + 1) + c])) {
+                pivot = r;
+            }
         }
-
-        size_t minIndex, maxIndex;
-        gsl_stats_minmax_index(&maxIndex, &minIndex, &yInArray[i * decimationWidth], 1, localWidth);
-
-        indexArray[i*2] = i * decimationWidth + minIndex;
-        indexArray[i*2 + 1] = i * decimationWidth + maxIndex;
-        if (minIndex == maxIndex) {
-            indexArray[i*2 + 1] = i * decimationWidth + (localWidth - 1);
+        for (size_t k = 0; k <= cNum; k++) {
+            std::swap(M[c * (cNum + 1) + k], M[pivot * (cNum + 1) + k]);
+        }
+        const double diagonal = M[c * (cNum + 1) + c];
+        for (size_t k = 0; k <= cNum; k++) {
+            M[c * (cNum + 1) + k] /= diagonal;
+        }
+        for (size_t r = 0; r < cNum; r++) {
+            const double factor = M[r * (cNum + 1) + c];
+            if (r != c && factor != 0) {
+                for (size_t k = 0; k <= cNum; k++) {
+                    M[r * (cNum + 1) + k] -= factor * M[c * (cNum + 1) + k];
+                }
+            }
         }
     }
 
-    gsl_sort_int(indexArray, 1, outN);
-
-    for (size_t i = 0; i < outN; i++) {
-        xOutArray[i] = xInArray[indexArray[i]];
-        yOutArray[i] = yInArray[indexArray[i]];
+    coefficients.assign(wsize, 0.0);
+    for (size_t j = 0; j < wsize; j++) {
+        const double t = ((double)j - H) * scale;
+        double tPow = 1;
+        for (size_t k = 0; k < cNum; k++) {
+            coefficients[j] += M[k * (cNum + 1) + cNum] * tPow;
+            tPow *= t;
+        }
     }
-
-    delete[] indexArray;
-
-    return status;
+    context.savitzkyGolayH = H;
+    context.savitzkyGolayOrder = order;
+    return coefficients;
 }
 
-int EMSCRIPTEN_KEEPALIVE filterBinning(double* inputArray, const int N, double* outputArray, const int binWidth) {
-    int status = 0;    /* return value: 0 = success */
-
-    for (size_t i = 0; i < N / binWidth; i++) {
-        outputArray[i] = gsl_stats_mean(&inputArray[i * binWidth], 1, binWidth);
+/* x is uniformly spaced if all steps match the mean step to within a relative tolerance */
+static bool isUniformlySpaced(const double* xInArray, const size_t N) {
+    if (N < 2) {
+        return false;
     }
-
-    if (N % binWidth != 0) {
-        size_t lastBin = floor(N / binWidth);
-        outputArray[lastBin] = gsl_stats_mean(&inputArray[lastBin * binWidth], 1, N % binWidth);
+    const double step = (xInArray[N - 1] - xInArray[0]) / (N - 1);
+    if (!isfinite(step) || step == 0) {
+        return false;
+    }
+    for (size_t i = 1; i < N; i++) {
+        if (fabs(xInArray[i] - xInArray[i - 1] - step) > 1e-6 * fabs(step)) {
+            return false;
+        }
     }
+    return true;
+}
 
-    return status;
+/* Savitzky-Golay smoothing of uniformly spaced data, as a convolution with precomputed coefficients */
+template <typename T>
+void savitzkyGolayConvolve(SmoothingContext& context, const T* yInArray, const size_t N, double* yOutArray, const int kernel, const int order) {
+    const size_t H = kernel / 2;
+    const std::vector<double>& coefficients = savitzkyGolayCoefficients(context, H, order);
+    const double* c = coefficients.data();
+    for (size_t i = 0; i < N; ++i) {
+        // set edge values NaN
+        if (i < H || i + H >= N) {
+            yOutArray[i] = NAN;
+            continue;
+        }
+        const T* window = yInArray + (i - H);
+        double sum = 0;
+        for (size_t j = 0; j < 2 * H + 1; j++) {
+            sum += c[j] * window[j];
+        }
+        yOutArray[i] = sum;
+    }
 }
 
-int EMSCRIPTEN_KEEPALIVE filterSavitzkyGolay(double* xInArray, double* yInArray, const int N, double* yOutArray, const int kernel, const int order) {
-    int status = 0;    /* return value: 0 = success */
+enum SmoothingFilter {
+    SMOOTHING_BOXCAR = 0,
+    SMOOTHING_GAUSSIAN = 1,
+    SMOOTHING_HANNING = 2,
+    SMOOTHING_SAVITZKY_GOLAY = 3
+};
 
+/*
+ * The fitted polynomial must have fewer coefficients than the window has points, otherwise the fit is underdetermined
+ * (and the normal matrix of the convolution coefficients is singular). Checked once, before either path runs
+ */
+static bool validSavitzkyGolayParameters(const int kernel, const int order) {
+    return kernel > 0 && order >= 0 && order < kernel;
+}
+
+/* Savitzky-Golay smoothing of arbitrarily spaced data, fitting a polynomial to each window */
+static void savitzkyGolayFit(double* xInArray, double* yInArray, const int N, double* yOutArray, const int kernel, const int order) {
     gsl_vector_view yIn = gsl_vector_view_array(yInArray, N);
     double* window = new double[kernel];
     size_t H;
@@ -240,363 +499,1955 @@ int EMSCRIPTEN_KEEPALIVE filterSavitzkyGolay(double* xInArray, double* yInArray,
         }
     }
     delete[] window;
-
-    return status;
-}
-
-struct fitData
-{
-  double *t;
-  double *y;
-  size_t n;
-  size_t component;
-  int function;
-  double **inputs;
-  double *orderInputs;
-  int **lockedInputs;
-  int *lockedOrderInputs;
-  gsl_matrix *parameterIndexes;
-  gsl_vector *orderParameterIndexes;
-};
-
-char logBuffer[8192];
-
-/* y = amp * exp( -4ln2[(x - center)/ fwhm]^2 */
-double gaussian(const double amp, const double center, const double fwhm, const double x)
-{
-  return (amp * exp(-4 * log(2.0) * pow((x - center) / fwhm, 2)));
-}
-
-/* y = amp * (0.5fwhm)^2 / [(x - center)^2 + (0.5fwhm)^2] */
-double lorentzian(const double amp, const double center, const double fwhm, const double x)
-{
-  return (amp * 0.25 * pow(fwhm, 2) / (pow(x - center, 2) + 0.25 * pow(fwhm, 2)));
 }
 
-int func_f (const gsl_vector * x, void *params, gsl_vector * f) {
-    struct fitData *d = (struct fitData *) params;
-
-    for (size_t i = 0; i < d->n; ++i)
-    {
-        double ti = d->t[i];
-        double yi = d->y[i];
-        double y = 0;
-        for (size_t j = 0; j <  d->component; ++j )
-        {
-            int *lockedInput = d->lockedInputs[j];
-            double amp, center, fwhm;
-            if (lockedInput[0] == 0) {
-                amp = gsl_vector_get(x, gsl_matrix_get(d->parameterIndexes, j, 0));
-            } else {
-                amp = d->inputs[j][0];
-            }
-
-            if (lockedInput[1] == 0) {
-                center = gsl_vector_get(x, gsl_matrix_get(d->parameterIndexes, j, 1));
-            } else {
-                center = d->inputs[j][1];
-            }
-
-            if (lockedInput[2] == 0) {
-                fwhm = gsl_vector_get(x, gsl_matrix_get(d->parameterIndexes, j, 2));
+template <typename T>
+int smoothProfiles(SmoothingContext& context, const int filter, const T* yInArray, const int N, const int M, double* yOutArray, const int kernel, const double param, double* xInArray) {
+    if (filter == SMOOTHING_SAVITZKY_GOLAY && !validSavitzkyGolayParameters(kernel, (int)param)) {
+        std::fill(yOutArray, yOutArray + (size_t)M * N, NAN);
+        return 1;
+    }
+    const bool uniform = filter == SMOOTHING_SAVITZKY_GOLAY && isUniformlySpaced(xInArray, N);
+    std::vector<double> profile;
+    for (size_t m = 0; m < M; m++) {
+        const T* yIn = yInArray + m * N;
+        double* yOut = yOutArray + m * N;
+        if (filter == SMOOTHING_BOXCAR) {
+            boxcar(yIn, N, yOut, kernel, (int)param);
+        } else if (filter == SMOOTHING_GAUSSIAN || filter == SMOOTHING_HANNING) {
+            if (filter == SMOOTHING_GAUSSIAN) {
+                convolveGaussian(context, yIn, N, yOut, kernel, param);
             } else {
-                fwhm = d->inputs[j][2];
+                convolvePadZero(yIn, N, yOut, hanningKernel(context, kernel));
             }
-
-            if (d->function == 0) {
-                y = y + gaussian(amp, center, fwhm, ti);
-            } else if (d->function == 1) {
-                y = y + lorentzian(amp, center, fwhm, ti);
+            // set edge values NaN
+            for (size_t i = 0; i < (kernel - 1) / 2 && i < N; i++) {
+                yOut[i] = NAN;
+                yOut[N - 1 - i] = NAN;
             }
+        } else if (filter == SMOOTHING_SAVITZKY_GOLAY && uniform) {
+            savitzkyGolayConvolve(context, yIn, N, yOut, kernel, (int)param);
+        } else if (filter == SMOOTHING_SAVITZKY_GOLAY) {
+            // the per-window fit only handles double input
+            profile.assign(yIn, yIn + N);
+            savitzkyGolayFit(xInArray, profile.data(), N, yOut, kernel, (int)param);
+        } else {
+            return 1;
         }
+    }
+    return 0;
+}
 
-        double yIntercept, slope;
-        if (d->lockedOrderInputs[0] == 0) {
-            yIntercept = gsl_vector_get(x, gsl_vector_get(d->orderParameterIndexes, 0));
-        } else {
-            yIntercept = d->orderInputs[0];
+/*
+ * Smoother for a profile that is streamed in pieces. The last input and output are kept, and each update only
+ * recomputes the output around the samples that changed, since the filters only reach kernel / 2 samples on either side
+ */
+struct StreamingSmoother {
+    int filter;
+    int kernel;
+    double param;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> output;
+    std::vector<double> scratch;
+    SmoothingContext context;
+
+    StreamingSmoother(const int filter, const int kernel, const double param) : filter(filter), kernel(kernel), param(param) {}
+
+    // Returns 0 on success. Outputs of all samples changed since the last update (with NaN equal to NaN) are recomputed
+    int update(const double* yInArray, const size_t N, const double* xInArray) {
+        if (filter == SMOOTHING_SAVITZKY_GOLAY && !xInArray) {
+            return 1;
         }
-        if (d->lockedOrderInputs[1] == 0) {
-            slope = gsl_vector_get(x, gsl_vector_get(d->orderParameterIndexes, 1));
+        size_t first = N, last = 0;
+        const bool xChanged = xInArray && (x.size() != N || !std::equal(x.begin(), x.end(), xInArray));
+        if (N < y.size() || xChanged) {
+            first = 0;
+            last = N;
         } else {
-            slope = d->orderInputs[1];
+            for (size_t i = 0; i < N; i++) {
+                if (i >= y.size() || !(yInArray[i] == y[i] || (isnan(yInArray[i]) && isnan(y[i])))) {
+                    first = std::min(first, i);
+                    last = i + 1;
+                }
+            }
+        }
+        y.assign(yInArray, yInArray + N);
+        if (xInArray) {
+            x.assign(xInArray, xInArray + N);
+        }
+        output.resize(N, NAN);
+        if (first >= last) {
+            return 0;
         }
 
-        y = y + slope * ti + yIntercept;
-        gsl_vector_set(f, i, yi - y);
+        // outputs within W of a changed sample are affected, and depend on inputs within W of them
+        const size_t W = kernel / 2 + 1;
+        const size_t outStart = first > W ? first - W : 0;
+        const size_t outEnd = std::min(N, last + W);
+        const size_t inStart = outStart > W ? outStart - W : 0;
+        const size_t inEnd = std::min(N, outEnd + W);
+        scratch.resize(inEnd - inStart);
+        const int status = smoothProfiles(context, filter, y.data() + inStart, inEnd - inStart, 1, scratch.data(), kernel, param, xInArray ? x.data() + inStart : NULL);
+        std::copy(scratch.begin() + (outStart - inStart), scratch.begin() + (outEnd - inStart), output.begin() + outStart);
+        return status;
     }
+};
 
-    return GSL_SUCCESS;
-}
+enum FittingFunction {
+    FITTING_GAUSSIAN = 0,
+    FITTING_LORENTZIAN = 1
+};
 
-void
-solve_system(gsl_vector *x, gsl_multifit_nlinear_fdf *fdf, gsl_multifit_nlinear_parameters *params, gsl_matrix *covar, gsl_vector *residual)
-{
-  const gsl_multifit_nlinear_type *T = gsl_multifit_nlinear_trust;
-  const size_t max_iter = 200;
-  const double xtol = 1.0e-8;
-  const double gtol = 1.0e-8;
-  const double ftol = 1.0e-8;
-  const size_t n = fdf->n;
-  const size_t p = fdf->p;
-  gsl_multifit_nlinear_workspace *work = gsl_multifit_nlinear_alloc(T, params, n, p);
-  gsl_vector * f = gsl_multifit_nlinear_residual(work);
-  gsl_vector * y = gsl_multifit_nlinear_position(work);
-  int info;
-  double chisq0, chisq, rcond;
+const double FOUR_LN2 = 4 * M_LN2;
+
+/*
+ * Adds a component to y at all n samples t: amp * exp(-4ln2 [(t - center) / fwhm]^2) for a Gaussian, and
+ * amp * (0.5fwhm)^2 / [(t - center)^2 + (0.5fwhm)^2] for a Lorentzian. The per-component constants are computed once,
+ * leaving a loop over contiguous samples that the compiler can vectorise
+ */
+template <int Function>
+void addProfileComponent(const double* t, const size_t n, const double amp, const double center, const double fwhm, double* y) {
+    if (Function == FITTING_GAUSSIAN) {
+        const double scale = -FOUR_LN2 / (fwhm * fwhm);
+        for (size_t i = 0; i < n; ++i) {
+            const double dx = t[i] - center;
+            y[i] += amp * exp(scale * dx * dx);
+        }
+    } else {
+        const double q = 0.25 * fwhm * fwhm;
+        const double ampQ = amp * q;
+        for (size_t i = 0; i < n; ++i) {
+            const double dx = t[i] - center;
+            y[i] += ampQ / (dx * dx + q);
+        }
+    }
+}
 
-  /* initialize solver */
-  gsl_multifit_nlinear_init(x, fdf, work);
+extern "C" {
 
-  /* store initial cost */
-  gsl_blas_ddot(f, f, &chisq0);
+int EMSCRIPTEN_KEEPALIVE linearRegression(const double *x, const double *y, size_t n, double *c0, double *c1, double *cov00, double *cov01, double *cov11, double *sumsq) {
+    return gsl_fit_linear(x, 1, y, 1, n, c0, c1, cov00, cov01, cov11, sumsq);
+}
 
-  /* iterate until convergence */
-  gsl_multifit_nlinear_driver(max_iter, xtol, gtol, ftol, NULL, NULL, &info, work);
+int EMSCRIPTEN_KEEPALIVE filterBoxcar(double* yInArray, const int N, double* yOutArray, const int kernel, const int nanMode) {
+    int status = 0;    /* return value: 0 = success */
 
-  /* compute covariance of best fit parameters */
-  gsl_matrix *J = gsl_multifit_nlinear_jac(work);
-  gsl_multifit_nlinear_covar (J, 0.0, covar);
+    boxcar(yInArray, N, yOutArray, kernel, nanMode);
 
-  /* store final cost */
-  gsl_blas_ddot(f, f, &chisq);
+    return status;
+}
 
-  /* store cond(J(x)) */
-  gsl_multifit_nlinear_rcond(&rcond, work);
+int EMSCRIPTEN_KEEPALIVE filterGaussian(double* yInArray, const int N, double* yOutArray, const int kernel, const double alpha) {
+    int status = 0;    /* return value: 0 = success */
 
-  gsl_vector_memcpy(x, y);
-  gsl_vector_memcpy(residual, f);
+    SmoothingContext context;
+    convolveGaussian(context, yInArray, N, yOutArray, kernel, alpha);
 
-  /* print summary */
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " summary from method '%s/%s'\n", gsl_multifit_nlinear_name(work), gsl_multifit_nlinear_trs_name(work));
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " number of iterations = %zu\n", gsl_multifit_nlinear_niter(work));
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " function evaluations = %zu\n", fdf->nevalf);
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " Jacobian evaluations = %zu\n", fdf->nevaldf);
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " reason for stopping  = %s\n", (info == 1) ? "small step size" : "small gradient");
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " initial |f(x)|       = %f\n", sqrt(chisq0));
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " final |f(x)|         = %f\n", sqrt(chisq));
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " initial cost         = %.12e\n", chisq0);
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " final cost           = %.12e\n", chisq);
-  snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " final cond(J)        = %.12e\n", 1.0 / rcond);
+    // set edge values NaN
+    for (size_t i = 0; i < (kernel - 1) / 2; i++) {
+        yOutArray[i] = NAN;
+        yOutArray[N - 1 - i] = NAN;
+    }
 
-  gsl_multifit_nlinear_free(work);
+    return status;
 }
 
-/* return the number of unlocked parameters */
-size_t setParametersIndexMatrix(int **lockedInputs, gsl_matrix *parameterIndexes, const int componentN, int *lockedOrderInputs, gsl_vector *orderParameterIndexes) {
-    size_t n = 0;
+int EMSCRIPTEN_KEEPALIVE filterHanning(double* yInArray, const int N, double* yOutArray, const int kernel) {
+    int status = 0;    /* return value: 0 = success */
 
-    if (lockedOrderInputs[0] == 0) {
-        gsl_vector_set(orderParameterIndexes, 0, n);
-        n++;
-    }
+    SmoothingContext context;
+    convolvePadZero(yInArray, N, yOutArray, hanningKernel(context, kernel));
 
-    if (lockedOrderInputs[1] == 0) {
-        gsl_vector_set(orderParameterIndexes, 1, n);
-        n++;
+    // set edge values NaN
+    for (size_t i = 0; i < (kernel - 1) / 2; i++) {
+        yOutArray[i] = NAN;
+        yOutArray[N - 1 - i] = NAN;
     }
 
-    for (size_t i = 0; i < componentN; ++i) {
-        for (size_t j = 0; j < 3; ++j) {
-            if (lockedInputs[i][j] == 0) {
-                gsl_matrix_set(parameterIndexes, i, j, n);
-                n++;
-            }
-        }
-    }
-    return n;
+    return status;
 }
 
-char * EMSCRIPTEN_KEEPALIVE fitting(
-    double* xInArray, double* yInArray, const int dataN,
-    double **inputs, int **lockedInputs, const int componentN,
-    int function, double* orderInputs, int* lockedOrderInputs,
-    double* ampOut, double* centerOut, double* fwhmOut, double* orderInputsOut, double* integralOut, double* residualOut) {
-    snprintf(logBuffer, sizeof(logBuffer), "");
-    if (function == 0) {
-        snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " Gaussian function fitting with %d component(s)\n", componentN);
-    } else if (function == 1) {
-        snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " Lorentzian function fitting with %d component(s)\n", componentN);
-    }
-
-    gsl_vector *orderParameterIndexes = gsl_vector_alloc(2); // the vector to store the indexes of unlocked order inputs in the fitting parameters vector. [fdf.p]
-    gsl_matrix *parameterIndexes = gsl_matrix_alloc(componentN, 3); // the matrix to store the indexes of unlocked inputs in the fitting parameters vector. [fdf.p]
+int EMSCRIPTEN_KEEPALIVE filterDecimation(double* xInArray, double* yInArray, const int inN, double* xOutArray, double* yOutArray, const int outN, const int decimationWidth) {
+    int status = 0;    /* return value: 0 = success */
+    int* indexArray = new int[outN];
+    int remainder = inN % decimationWidth;
 
-    const size_t n = dataN;  /* number of data points to fit */
-    const size_t p = setParametersIndexMatrix(lockedInputs, parameterIndexes, componentN, lockedOrderInputs, orderParameterIndexes);  /* number of model parameters */
+    for (size_t i = 0; i <= inN / decimationWidth; i++) {
 
-    gsl_vector *f = gsl_vector_alloc(n); // vector of data points
-    gsl_vector *x = gsl_vector_alloc(p); // vector of parameters(unlocked input)
-    gsl_vector *residual = gsl_vector_alloc(n); // vector of residual
-    gsl_matrix *covar = gsl_matrix_alloc (p, p); // matrix of covariance
-    gsl_multifit_nlinear_fdf fdf;
-    gsl_multifit_nlinear_parameters fdf_params = gsl_multifit_nlinear_default_parameters();
-    struct fitData fit_data;
-
-    fit_data.t = xInArray;
-    fit_data.y = yInArray;
-    fit_data.n = n;
-    fit_data.component = componentN;
-    fit_data.function = function;
-    fit_data.inputs = inputs;
-    fit_data.orderInputs = orderInputs;
-    fit_data.lockedInputs = lockedInputs;
-    fit_data.lockedOrderInputs = lockedOrderInputs;
-    fit_data.parameterIndexes = parameterIndexes;
-    fit_data.orderParameterIndexes = orderParameterIndexes;
-
-    /* define function to be minimized */
-    fdf.f = func_f;
-    fdf.df = NULL;
-    fdf.fvv = NULL;
-    fdf.n = n;
-    fdf.p = p;
-    fdf.params = &fit_data;
-
-    /* starting point */
-    size_t parameterIndex = 0;
-    if (lockedOrderInputs[0] == 0) {
-        gsl_vector_set(x, parameterIndex, orderInputs[0]);
-        parameterIndex++;
-    }
-    if (lockedOrderInputs[1] == 0) {
-        gsl_vector_set(x, parameterIndex, orderInputs[1]);
-        parameterIndex++;
-    }
-
-    for (size_t i = 0; i < componentN; ++i)
-    {
-        for (size_t j = 0; j < 3; ++j)
-        {
-            if (lockedInputs[i][j] == 0) {
-                gsl_vector_set(x, parameterIndex, inputs[i][j]);
-                parameterIndex++;
+        if (i == inN / decimationWidth && (remainder == 0 || remainder == 1)) {
+            // remainder = 0, the last data of yIn has already been handled when i = inN / decimationWidth - 1
+            // remainder = 1, only 1 data remains, so there is no need to perform min/max search
+            if (remainder == 1) {
+                indexArray[outN - 1] = inN - 1;
             }
+            break;
         }
-    }
 
-    fdf_params.trs = gsl_multifit_nlinear_trs_lm;
-    solve_system(x, &fdf, &fdf_params, covar, residual);
+        int localWidth = decimationWidth;
+        if (i == inN / decimationWidth && remainder > 1) {
+            localWidth = remainder;
+        }
 
-    /* For an unweighted least-squares function f_i = (Y(x, t_i) - y_i)
-       the covariance matrix should be multiplied by the variance of the residuals
-       about the best-fit \sigma^2 = \sum (y_i - Y(x,t_i))^2 / (n-p)
-       to give the variance-covariance matrix \sigma^2 C. */
-    double residualVariance = 0;
-    for (size_t i = 0; i < n; ++i)
-    {
-        residualVariance = residualVariance + pow(gsl_vector_get(residual, i), 2);
-        residualOut[i] = gsl_vector_get(residual, i);
-    }
-    residualVariance = residualVariance / (n -p);
-
-    size_t index;
-    /* set fitting results of orderInputsOut(yIntercept, slope) */
-    double yIntercept, yInterceptError, slope, slopeError;
-    snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), "\n baseline\n");
-    if (lockedOrderInputs[0] == 0) {
-        index = gsl_vector_get(orderParameterIndexes, 0);
-        yIntercept = gsl_vector_get(x, index);
-        yInterceptError = sqrt(residualVariance * gsl_matrix_get(covar, index, index));
-        orderInputsOut[0] = yIntercept;
-        orderInputsOut[1] = yInterceptError;
-        snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " y intercept          = %.12e @yUnit \u00b1 %.12e (%.3g%%)\n", yIntercept, yInterceptError, 100 * yInterceptError/ abs(yIntercept));
-    } else {
-        orderInputsOut[0] = orderInputs[0];
-        orderInputsOut[1] = NAN;
-        snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " y intercept  (fixed) = %.12e @yUnit\n", orderInputs[0]);
-    }
-
-    if (lockedOrderInputs[1] == 0) {
-        index = gsl_vector_get(orderParameterIndexes, 1);
-        slope = gsl_vector_get(x, index);
-        slopeError = sqrt(residualVariance * gsl_matrix_get(covar, index, index));
-        orderInputsOut[2] = slope;
-        orderInputsOut[3] = slopeError;
-        snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " slope                = %.12e @slopeUnit \u00b1 %.12e (%.3g%%)\n", slope, slopeError, 100 * slopeError/ abs(slope));
-    } else {
-        orderInputsOut[2] = orderInputs[1];
-        orderInputsOut[3] = NAN;
-        snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " slope        (fixed) = %.12e @slopeUnit\n", orderInputs[1]);
-    }
+        size_t minIndex, maxIndex;
+        gsl_stats_minmax_index(&maxIndex, &minIndex, &yInArray[i * decimationWidth], 1, localWidth);
 
-    /* set fitting results of components(amp, center, fwhm) */
-    double amp, center, fwhm, ampError, centerError, fwhmError, integral, integralError, sigmaAmpFwhm;
-    for (size_t i = 0; i < componentN; ++i)
-    {
-        snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " component #%zu\n", i + 1);
-        if (lockedInputs[i][0] == 0) {
-            index = gsl_matrix_get(parameterIndexes, i, 0);
-            amp = gsl_vector_get(x, index);
-            ampError = sqrt(residualVariance * gsl_matrix_get(covar, index, index));
-            snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " amp%zu                 = %.12e @yUnit \u00b1 %.12e (%.3g%%)\n", i + 1, amp, ampError, 100 * ampError / abs(amp));
-        } else {
-            amp = inputs[i][0];
-            ampError = NAN;
-            snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " amp%zu         (fixed) = %.12e @yUnit\n", i + 1, amp);
+        indexArray[i*2] = i * decimationWidth + minIndex;
+        indexArray[i*2 + 1] = i * decimationWidth + maxIndex;
+        if (minIndex == maxIndex) {
+            indexArray[i*2 + 1] = i * decimationWidth + (localWidth - 1);
         }
+    }
 
-        if (lockedInputs[i][1] == 0) {
-            index = gsl_matrix_get(parameterIndexes, i, 1);
-            center = gsl_vector_get(x, index);
-            centerError = sqrt(residualVariance * gsl_matrix_get(covar, index, index));
-            snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " center%zu              = %.12e @xUnit \u00b1 %.12e (%.3g%%)\n", i + 1, center, centerError, 100 * centerError / abs(center));
-        } else {
-            center = inputs[i][1];
-            centerError = NAN;
-            snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " center%zu      (fixed) = %.12e @xUnit\n", i + 1, center);
-        }
+    gsl_sort_int(indexArray, 1, outN);
+
+    for (size_t i = 0; i < outN; i++) {
+        xOutArray[i] = xInArray[indexArray[i]];
+        yOutArray[i] = yInArray[indexArray[i]];
+    }
+
+    delete[] indexArray;
+
+    return status;
+}
+
+/*
+ * M4 decimation for plotting: the points are split into runs falling into the same pixel column (between xMin and xMax),
+ * and the first, minimum, maximum and last finite points of each run are kept. x may be non-uniform, and ascending or
+ * descending. The first NaN of each run is also kept, so that gaps in the data remain gaps in the plot.
+ * Indices are written in ascending order (at most N). Returns the number of indices
+ */
+int EMSCRIPTEN_KEEPALIVE filterM4(const double* xInArray, const double* yInArray, const int N, const double xMin, const double xMax, const int numPixels, int* indexOut) {
+    const double scale = numPixels / (xMax - xMin);
+    if (!isfinite(scale) || numPixels <= 0) {
+        return 0;
+    }
+
+    int count = 0;
+    long column = 0;
+    for (size_t start = 0, end; start < N; start = end) {
+        // find the end of the run of points in the same column. Points with a NaN x value stay in the current run
+        const double x = isfinite(xInArray[start]) ? xInArray[start] : xMin;
+        column = (long)floor(fmin(fmax((x - xMin) * scale, -1.0), (double)numPixels));
+        int first = -1, last = -1, minIndex = -1, maxIndex = -1, gap = -1;
+        for (end = start; end < N; end++) {
+            if (end > start && isfinite(xInArray[end]) && (long)floor(fmin(fmax((xInArray[end] - xMin) * scale, -1.0), (double)numPixels)) != column) {
+                break;
+            }
+            const double y = yInArray[end];
+            if (!isfinite(y)) {
+                if (gap < 0) {
+                    gap = end;
+                }
+                continue;
+            }
+            if (first < 0) {
+                first = minIndex = maxIndex = end;
+            }
+            last = end;
+            if (y < yInArray[minIndex]) {
+                minIndex = end;
+            }
+            if (y > yInArray[maxIndex]) {
+                maxIndex = end;
+            }
+        }
+
+        // emit the (at most five) indices in order, skipping duplicates
+        int candidates[5] = {first, minIndex, maxIndex, last, gap};
+        std::sort(candidates, candidates + 5);
+        for (size_t i = 0; i < 5; i++) {
+            if (candidates[i] >= 0 && (i == 0 || candidates[i] != candidates[i - 1])) {
+                indexOut[count++] = candidates[i];
+            }
+        }
+    }
+    return count;
+}
+
+int EMSCRIPTEN_KEEPALIVE filterBinning(double* inputArray, const int N, double* outputArray, const int binWidth) {
+    int status = 0;    /* return value: 0 = success */
+
+    for (size_t i = 0; i < N / binWidth; i++) {
+        outputArray[i] = gsl_stats_mean(&inputArray[i * binWidth], 1, binWidth);
+    }
+
+    if (N % binWidth != 0) {
+        size_t lastBin = floor(N / binWidth);
+        outputArray[lastBin] = gsl_stats_mean(&inputArray[lastBin * binWidth], 1, N % binWidth);
+    }
+
+    return status;
+}
+
+/*
+ * For uniformly spaced x (e.g. a regular spectral axis), the per-window polynomial fit reduces to a convolution with
+ * precomputed coefficients. Non-uniform x falls back to fitting each window. Returns 1 with all outputs NaN if the
+ * parameters are invalid
+ */
+int EMSCRIPTEN_KEEPALIVE filterSavitzkyGolay(double* xInArray, double* yInArray, const int N, double* yOutArray, const int kernel, const int order) {
+    if (!validSavitzkyGolayParameters(kernel, order)) {
+        std::fill(yOutArray, yOutArray + N, NAN);
+        return 1;
+    }
+
+    if (isUniformlySpaced(xInArray, N)) {
+        SmoothingContext context;
+        savitzkyGolayConvolve(context, yInArray, N, yOutArray, kernel, order);
+    } else {
+        savitzkyGolayFit(xInArray, yInArray, N, yOutArray, kernel, order);
+    }
+    return 0;
+}
+
+/*
+ * Smooths M profiles of length N, stored consecutively, in a single call. The input is float32 if isFloat32 is set,
+ * and double otherwise. The parameter is the NaN mode for boxcar smoothing, alpha for Gaussian smoothing and the order
+ * for Savitzky-Golay smoothing, which also requires the x values shared by all profiles. The kernels are kept in the
+ * given context, owned by the caller, or in a temporary context if it is NULL
+ */
+int EMSCRIPTEN_KEEPALIVE filterBatch(
+    SmoothingContext* context, const int filter, void* yInArray, const int isFloat32, const int N, const int M, double* yOutArray, const int kernel,
+    const double param, double* xInArray) {
+    if (!context) {
+        SmoothingContext temporaryContext;
+        return filterBatch(&temporaryContext, filter, yInArray, isFloat32, N, M, yOutArray, kernel, param, xInArray);
+    }
+    if (isFloat32) {
+        return smoothProfiles(*context, filter, (const float*)yInArray, N, M, yOutArray, kernel, param, xInArray);
+    }
+    return smoothProfiles(*context, filter, (const double*)yInArray, N, M, yOutArray, kernel, param, xInArray);
+}
+
+SmoothingContext* EMSCRIPTEN_KEEPALIVE smoothingContextCreate() {
+    return new SmoothingContext();
+}
+
+void EMSCRIPTEN_KEEPALIVE smoothingContextFree(SmoothingContext* context) {
+    delete context;
+}
+
+/* Creates a streaming smoother with the same filter parameters as filterBatch. Must be freed with smootherFree */
+StreamingSmoother* EMSCRIPTEN_KEEPALIVE smootherCreate(const int filter, const int kernel, const double param) {
+    return new StreamingSmoother(filter, kernel, param);
+}
+
+/*
+ * Updates the smoother with the full profile of length N, and returns its output (valid until the next update), or NULL
+ * if smoothing failed. Only the output around changed samples is recomputed. x is required for Savitzky-Golay smoothing
+ */
+double* EMSCRIPTEN_KEEPALIVE smootherUpdate(StreamingSmoother* smoother, const double* yInArray, const int N, const double* xInArray) {
+    if (!smoother || N < 0) {
+        return NULL;
+    }
+    if (smoother->update(yInArray, N, xInArray)) {
+        return NULL;
+    }
+    return smoother->output.data();
+}
+
+void EMSCRIPTEN_KEEPALIVE smootherFree(StreamingSmoother* smoother) {
+    delete smoother;
+}
+
+struct fitData
+{
+  const double *t;
+  const double *y;
+  size_t n;
+  size_t component;
+  int function;
+
+  /* flattened parameter layout: the values of all parameters, (amp, center, fwhm) of each component followed by
+     (yIntercept, slope), with locked parameters keeping these values, and the indexes of each component's
+     (amp, center, fwhm) and of the (yIntercept, slope) in the fitting parameters vector (-1 if locked). The values
+     are unpacked once per evaluation into amp, center and fwhm */
+  const double *inputs;
+  const int *componentIndexes;
+  const int *orderIndexes;
+  double *amp;
+  double *center;
+  double *fwhm;
+  double yIntercept;
+  double slope;
+  double *model;
+};
+
+/* unpack the fitting parameters into the amp, center and fwhm arrays and the baseline of the fit data */
+void unpackParameters(const gsl_vector * x, struct fitData *d) {
+    double *values[3] = {d->amp, d->center, d->fwhm};
+    for (size_t j = 0; j < d->component; ++j) {
+        for (size_t k = 0; k < 3; ++k) {
+            const int index = d->componentIndexes[3 * j + k];
+            values[k][j] = index >= 0 ? gsl_vector_get(x, index) : d->inputs[3 * j + k];
+        }
+    }
+    const double *orderInputs = d->inputs + 3 * d->component;
+    d->yIntercept = d->orderIndexes[0] >= 0 ? gsl_vector_get(x, d->orderIndexes[0]) : orderInputs[0];
+    d->slope = d->orderIndexes[1] >= 0 ? gsl_vector_get(x, d->orderIndexes[1]) : orderInputs[1];
+}
+
+/* evaluate the model at all samples into d->model */
+void evaluateModel(struct fitData *d) {
+    for (size_t i = 0; i < d->n; ++i) {
+        d->model[i] = d->slope * d->t[i] + d->yIntercept;
+    }
+    for (size_t j = 0; j < d->component; ++j) {
+        if (d->function == FITTING_GAUSSIAN) {
+            addProfileComponent<FITTING_GAUSSIAN>(d->t, d->n, d->amp[j], d->center[j], d->fwhm[j], d->model);
+        } else if (d->function == FITTING_LORENTZIAN) {
+            addProfileComponent<FITTING_LORENTZIAN>(d->t, d->n, d->amp[j], d->center[j], d->fwhm[j], d->model);
+        }
+    }
+}
+
+int func_f (const gsl_vector * x, void *params, gsl_vector * f) {
+    struct fitData *d = (struct fitData *) params;
+
+    unpackParameters(x, d);
+    evaluateModel(d);
+    for (size_t i = 0; i < d->n; ++i)
+    {
+        gsl_vector_set(f, i, d->y[i] - d->model[i]);
+    }
+
+    return GSL_SUCCESS;
+}
+
+/*
+ * Derivatives of a component at x with respect to (amp, center, fwhm): first derivatives in grad[3], and the second
+ * derivatives d2[0..5] = (amp amp, amp center, amp fwhm, center center, center fwhm, fwhm fwhm) if d2 is not NULL
+ */
+void componentDerivatives(const int function, const double amp, const double center, const double fwhm, const double x, double *grad, double *d2) {
+    const double dx = x - center;
+    if (function == FITTING_GAUSSIAN) {
+        /* y = amp * e, e = exp(-k (dx / fwhm)^2), k = 4ln2 */
+        const double k = FOUR_LN2;
+        const double w2 = fwhm * fwhm;
+        const double e = exp(-k * dx * dx / w2);
+        const double s = 2 * k * dx * dx / w2;
+        grad[0] = e;
+        grad[1] = amp * e * 2 * k * dx / w2;
+        grad[2] = amp * e * s / fwhm;
+        if (d2) {
+            d2[0] = 0;
+            d2[1] = e * 2 * k * dx / w2;
+            d2[2] = e * s / fwhm;
+            d2[3] = amp * e * 2 * k / w2 * (s - 1);
+            d2[4] = amp * e * 2 * k * dx / (w2 * fwhm) * (s - 2);
+            d2[5] = amp * e * s / w2 * (s - 3);
+        }
+    } else {
+        /* y = amp * q / D, q = 0.25fwhm^2, D = dx^2 + q */
+        const double q = 0.25 * fwhm * fwhm;
+        const double D = dx * dx + q;
+        const double D2 = D * D;
+        grad[0] = q / D;
+        grad[1] = 2 * amp * q * dx / D2;
+        grad[2] = 0.5 * amp * fwhm * dx * dx / D2;
+        if (d2) {
+            const double D3 = D2 * D;
+            d2[0] = 0;
+            d2[1] = 2 * q * dx / D2;
+            d2[2] = 0.5 * fwhm * dx * dx / D2;
+            d2[3] = 2 * amp * q * (4 * dx * dx - D) / D3;
+            d2[4] = amp * dx * fwhm * (D - 2 * q) / D3;
+            d2[5] = 0.5 * amp * dx * dx * (D - fwhm * fwhm) / D3;
+        }
+    }
+}
+
+/* Jacobian of the residuals f_i = y_i - Y(x, t_i), one column per unlocked parameter */
+int func_df (const gsl_vector * x, void *params, gsl_matrix * J) {
+    struct fitData *d = (struct fitData *) params;
+
+    unpackParameters(x, d);
+    for (size_t j = 0; j < d->component; ++j)
+    {
+        const int *indexes = d->componentIndexes + 3 * j;
+        for (size_t i = 0; i < d->n; ++i)
+        {
+            double grad[3];
+            componentDerivatives(d->function, d->amp[j], d->center[j], d->fwhm[j], d->t[i], grad, NULL);
+            for (size_t k = 0; k < 3; ++k) {
+                if (indexes[k] >= 0) {
+                    gsl_matrix_set(J, i, indexes[k], -grad[k]);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < d->n; ++i)
+    {
+        if (d->orderIndexes[0] >= 0) {
+            gsl_matrix_set(J, i, d->orderIndexes[0], -1.0);
+        }
+        if (d->orderIndexes[1] >= 0) {
+            gsl_matrix_set(J, i, d->orderIndexes[1], -d->t[i]);
+        }
+    }
+
+    return GSL_SUCCESS;
+}
+
+/* second directional derivative of the residuals along v, for geodesic acceleration. The baseline is linear and doesn't contribute */
+int func_fvv (const gsl_vector * x, const gsl_vector * v, void *params, gsl_vector * fvv) {
+    struct fitData *d = (struct fitData *) params;
+
+    unpackParameters(x, d);
+    gsl_vector_set_zero(fvv);
+    for (size_t j = 0; j < d->component; ++j)
+    {
+        const int *indexes = d->componentIndexes + 3 * j;
+        double vj[3];
+        for (size_t k = 0; k < 3; ++k) {
+            vj[k] = indexes[k] >= 0 ? gsl_vector_get(v, indexes[k]) : 0;
+        }
+        if (vj[0] == 0 && vj[1] == 0 && vj[2] == 0) {
+            continue;
+        }
+
+        for (size_t i = 0; i < d->n; ++i)
+        {
+            double grad[3], d2[6];
+            componentDerivatives(d->function, d->amp[j], d->center[j], d->fwhm[j], d->t[i], grad, d2);
+            const double sum = vj[0] * vj[0] * d2[0] + vj[1] * vj[1] * d2[3] + vj[2] * vj[2] * d2[5]
+                + 2 * (vj[0] * vj[1] * d2[1] + vj[0] * vj[2] * d2[2] + vj[1] * vj[2] * d2[4]);
+            gsl_vector_set(fvv, i, gsl_vector_get(fvv, i) - sum);
+        }
+    }
+
+    return GSL_SUCCESS;
+}
+
+/* integral of a Gaussian or Lorentzian component */
+double componentIntegral(const int function, const double amp, const double fwhm) {
+    if (function == FITTING_GAUSSIAN) {
+        return amp * abs(fwhm / (2 * sqrt(log(2.0)))) * sqrt(M_PI);
+    }
+    return 0.5 * M_PI * amp * fwhm;
+}
+
+/* error of the integral from the amp and fwhm errors (NaN if locked) and their covariance */
+double componentIntegralError(const double integral, const double amp, const double ampError, const double fwhm, const double fwhmError, const double covAmpFwhm) {
+    if (isnan(ampError) && isnan(fwhmError)) {
+        return NAN;
+    } else if (!isnan(ampError) && !isnan(fwhmError)) {
+        return integral * sqrt(pow(ampError / amp, 2) + pow(fwhmError / fwhm, 2) + 2 * covAmpFwhm / (amp * fwhm));
+    } else if (!isnan(ampError)) {
+        return integral * abs(ampError / amp);
+    }
+    return integral * abs(fwhmError / fwhm);
+}
+
+/* append printf-style formatted text to a string */
+static void appendFormat(std::string &s, const char *format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    s += buffer;
+}
+
+/* Reason for the driver to stop, from its info output. Must match FittingStopReason in post.ts */
+enum FittingStopReason {
+    FITTING_STOP_NONE = 0,
+    FITTING_STOP_SMALL_STEP = 1,
+    FITTING_STOP_SMALL_GRADIENT = 2,
+    FITTING_STOP_CANCELLED = 3,
+    FITTING_STOP_TIME_LIMIT = 4
+};
+
+/* Summary of a fit, stored as consecutive doubles so that it can be read from the module heap in one go. Must match FittingSummaryFields in post.ts */
+struct FittingSummary {
+    double status;              // status of the driver, GSL_SUCCESS (0) if it converged
+    double stopReason;          // FittingStopReason
+    double iterations;
+    double functionEvaluations;
+    double jacobianEvaluations;
+    double initialCost;         // sum of the squared residuals at the starting point
+    double finalCost;           // chi-squared of the fit (unweighted)
+    double condition;           // cond(J) at the solution
+    double residualVariance;    // finalCost / (n - p)
+    double numFreeParameters;
+    double numData;
+    double elapsedTime;         // time taken by the fit, in ms
+    double warmStarted;         // 1 if the fit started from the previous solution
+};
+
+/*
+ * Trust region solver shared by the fitting contexts. The workspace and buffers are kept while the number of samples
+ * and free parameters stay the same. The driver loop can be run in chunks of iterations, so that a caller on the same
+ * thread (the module is built without pthreads) can cancel a fit between chunks, and it stops early once it runs out of
+ * time
+ */
+struct NonlinearSolver {
+    /* solver workspace and buffers, for workN samples and workP free parameters */
+    gsl_multifit_nlinear_workspace *work;
+    gsl_vector *start;
+    gsl_matrix *covar;
+    size_t workN;
+    size_t workP;
+    bool workAccelerated;
+
+    size_t maxIterations;
+    double timeLimit;                   // in ms, 0 for no limit
+    bool cancelRequested;
+
+    /* state of the driver loop between chunks of iterations */
+    size_t iteration;
+    double startTime;
+    int info;
+    int stopReason;
+
+    NonlinearSolver()
+        : work(NULL), start(NULL), covar(NULL), workN(0), workP(0), workAccelerated(false), maxIterations(200), timeLimit(0), cancelRequested(false),
+          iteration(0), startTime(0), info(0), stopReason(FITTING_STOP_NONE) {}
+
+    ~NonlinearSolver() {
+        releaseWorkspace();
+    }
+
+    NonlinearSolver(const NonlinearSolver&) = delete;
+    NonlinearSolver& operator=(const NonlinearSolver&) = delete;
+
+    void releaseWorkspace() {
+        if (work) {
+            gsl_multifit_nlinear_free(work);
+            gsl_vector_free(start);
+            gsl_matrix_free(covar);
+        }
+        work = NULL;
+        start = NULL;
+        covar = NULL;
+    }
+
+    /* allocate the workspace and buffers for n samples and p free parameters, unless the current ones fit */
+    void reserveWorkspace(const size_t n, const size_t numFree, const bool accelerated) {
+        if (work && workN == n && workP == numFree && workAccelerated == accelerated) {
+            return;
+        }
+        releaseWorkspace();
+        gsl_multifit_nlinear_parameters fdf_params = gsl_multifit_nlinear_default_parameters();
+        fdf_params.trs = accelerated ? gsl_multifit_nlinear_trs_lmaccel : gsl_multifit_nlinear_trs_lm;
+        work = gsl_multifit_nlinear_alloc(gsl_multifit_nlinear_trust, &fdf_params, n, numFree);
+        start = gsl_vector_alloc(numFree);
+        covar = gsl_matrix_alloc(numFree, numFree);
+        workN = n;
+        workP = numFree;
+        workAccelerated = accelerated;
+    }
+
+    /* reset the driver loop after the workspace has been initialized, with the time limit counted from startMs */
+    void beginIterations(const double startMs) {
+        iteration = 0;
+        startTime = startMs;
+        info = 0;
+        stopReason = FITTING_STOP_NONE;
+        cancelRequested = false;
+    }
+
+    /*
+     * iterate from the initialized workspace until convergence, as gsl_multifit_nlinear_driver does, but checking for
+     * cancellation and the time limit before each iteration. Runs at most maxSteps iterations, and returns GSL_CONTINUE
+     * with stopReason FITTING_STOP_NONE if the fit is unfinished, so that the next call carries on from the same state.
+     * Otherwise returns the final status of the fit (GSL_CONTINUE if it was cancelled or ran out of time)
+     */
+    int iterate(const size_t maxSteps) {
+        const double xtol = 1.0e-8;
+        const double gtol = 1.0e-8;
+        const double ftol = 1.0e-8;
+        int status = GSL_CONTINUE;
+        for (size_t step = 0; iteration < maxIterations; ++step) {
+            if (cancelRequested) {
+                stopReason = FITTING_STOP_CANCELLED;
+                return GSL_CONTINUE;
+            }
+            if (timeLimit > 0 && emscripten_get_now() - startTime > timeLimit) {
+                stopReason = FITTING_STOP_TIME_LIMIT;
+                return GSL_CONTINUE;
+            }
+            if (step >= maxSteps) {
+                return GSL_CONTINUE;
+            }
+
+            status = gsl_multifit_nlinear_iterate(work);
+            /* no step reduced the cost from the starting point, so more iterations won't help */
+            if (status == GSL_ENOPROG && iteration == 0) {
+                info = status;
+                return GSL_EMAXITER;
+            }
+            ++iteration;
+            status = gsl_multifit_nlinear_test(xtol, gtol, ftol, &info, work);
+            if (status != GSL_CONTINUE) {
+                break;
+            }
+        }
+
+        /* converged to within machine precision */
+        if (status == GSL_ETOLF || status == GSL_ETOLX || status == GSL_ETOLG) {
+            info = status == GSL_ETOLX ? 1 : 2;
+            status = GSL_SUCCESS;
+        }
+        if (status == GSL_SUCCESS) {
+            stopReason = info == 1 ? FITTING_STOP_SMALL_STEP : FITTING_STOP_SMALL_GRADIENT;
+        } else if (iteration >= maxIterations) {
+            status = GSL_EMAXITER;
+        }
+        return status;
+    }
+
+    /* whether iterate stopped without finishing the fit */
+    bool unfinished(const int status) const {
+        return status == GSL_CONTINUE && stopReason == FITTING_STOP_NONE;
+    }
+};
+
+/*
+ * A fit and its results. All the state of a fit lives in its context, so that fits in separate contexts don't
+ * interfere and can run concurrently. Parameters are laid out as (amp, center, fwhm) for each component followed by
+ * (yIntercept, slope), P = 3 * componentN + 2 values, for the inputs and locked flags, and for the parameters and
+ * errors of the result. The covariance is P x P in the same layout, scaled by the residual variance, with NaN rows and
+ * columns for locked parameters. The log is only formatted when requested.
+ * A context can be kept as a session for repeated fits: the solver workspace and buffers are reused while the number of
+ * samples and free parameters stay the same, and fits can be warm-started from the previous converged solution. A fit
+ * can be run in one go with solve, or started with begin and advanced in chunks of iterations, so that it can be
+ * cancelled between chunks. Fits stop early once they run out of time
+ */
+struct FittingContext : NonlinearSolver {
+    int function;
+    size_t componentN;
+    std::vector<double> inputs;
+    std::vector<int> parameterIndexes;  // index of each parameter in the fitting parameters vector, -1 if locked
+    size_t p;                           // number of free parameters
+    bool geodesicAcceleration;
+
+    std::vector<double> t;
+    std::vector<double> y;
+    std::vector<double> componentValues;
+    std::vector<double> model;
+
+    std::vector<double> parameters;
+    std::vector<double> errors;
+    std::vector<double> integrals;      // (integral, error) of each component
+    std::vector<double> covariance;
+    std::vector<double> residual;
+    FittingSummary summary;
+    const char *methodName;
+    const char *trsName;
+
+    std::string log;
+    bool logFormatted;
+
+    /* previous converged solution, and the layout it was fitted with */
+    std::vector<double> solution;
+    std::vector<int> solutionIndexes;
+    int solutionFunction;
+    bool hasSolution;
+
+    /* fit in progress between begin and its last chunk of iterations. The solver workspace points to fdf */
+    struct fitData fitState;
+    gsl_multifit_nlinear_fdf fdf;
+    double initialCost;
+    bool running;
+
+    FittingContext()
+        : function(FITTING_GAUSSIAN), componentN(0), p(0), geodesicAcceleration(true), summary(), methodName(NULL), trsName(NULL), logFormatted(false),
+          solutionFunction(FITTING_GAUSSIAN), hasSolution(false), fitState(), fdf(), initialCost(0), running(false) {}
+
+    /* set the model and its P initial values. The free parameters are numbered with the baseline first. Returns the number of free parameters */
+    size_t setModel(const int fittingFunction, const size_t numComponents, const double *initialInputs, const int *lockedInputs) {
+        function = fittingFunction;
+        componentN = numComponents;
+        const size_t P = 3 * componentN + 2;
+        inputs.assign(initialInputs, initialInputs + P);
+        parameterIndexes.assign(P, -1);
+        p = 0;
+        for (size_t k = 3 * componentN; k < P; ++k) {
+            if (lockedInputs[k] == 0) {
+                parameterIndexes[k] = p++;
+            }
+        }
+        for (size_t k = 0; k < 3 * componentN; ++k) {
+            if (lockedInputs[k] == 0) {
+                parameterIndexes[k] = p++;
+            }
+        }
+        return p;
+    }
+
+    /* set the samples to fit, leaving out non-finite ones if skipNonFinite is set. Returns the number of samples kept */
+    size_t setData(const double *xInArray, const double *yInArray, const size_t N, const bool skipNonFinite) {
+        t.clear();
+        y.clear();
+        for (size_t i = 0; i < N; ++i) {
+            if (!skipNonFinite || (isfinite(xInArray[i]) && isfinite(yInArray[i]))) {
+                t.push_back(xInArray[i]);
+                y.push_back(yInArray[i]);
+            }
+        }
+        return t.size();
+    }
+
+    /*
+     * fit the model to the data, starting from the previous converged solution if warmStart is set and the model has the
+     * same function and free parameters. Returns the status of the solver (GSL_SUCCESS if it converged, GSL_CONTINUE if
+     * it ran out of time), or GSL_EINVAL if there are no free parameters or fewer samples than free parameters
+     */
+    int solve(const bool useGeodesicAcceleration, const bool warmStart) {
+        begin(useGeodesicAcceleration, warmStart);
+        return advance(maxIterations);
+    }
+
+    /*
+     * start a fit as solve does, without iterating. Returns GSL_CONTINUE if the fit is ready to advance, or GSL_EINVAL if
+     * there are no free parameters or fewer samples than free parameters, in which case the results are already set
+     */
+    int begin(const bool useGeodesicAcceleration, const bool warmStart) {
+        const double startMs = emscripten_get_now();
+        const size_t n = t.size();
+        const size_t P = inputs.size();
+        geodesicAcceleration = useGeodesicAcceleration;
+        log.clear();
+        logFormatted = false;
+        summary = FittingSummary();
+        summary.status = GSL_EINVAL;
+        summary.numFreeParameters = p;
+        summary.numData = n;
+        summary.warmStarted = warmStart && hasSolution && solutionFunction == function && solutionIndexes == parameterIndexes;
+        methodName = NULL;
+        trsName = NULL;
+        parameters = inputs;
+        errors.assign(P, NAN);
+        integrals.assign(2 * componentN, NAN);
+        covariance.assign(P * P, NAN);
+        residual.assign(n, NAN);
+        running = false;
+
+        if (p == 0 || n < p) {
+            beginIterations(startMs);
+            finish();
+            return summary.status;
+        }
+
+        componentValues.resize(3 * componentN);
+        model.resize(n);
+        fitState.t = t.data();
+        fitState.y = y.data();
+        fitState.n = n;
+        fitState.component = componentN;
+        fitState.function = function;
+        fitState.inputs = inputs.data();
+        fitState.componentIndexes = parameterIndexes.data();
+        fitState.orderIndexes = parameterIndexes.data() + 3 * componentN;
+        fitState.amp = componentValues.data();
+        fitState.center = componentValues.data() + componentN;
+        fitState.fwhm = componentValues.data() + 2 * componentN;
+        fitState.model = model.data();
+
+        /* define function to be minimized */
+        fdf.f = func_f;
+        fdf.df = func_df;
+        fdf.fvv = geodesicAcceleration ? func_fvv : NULL;
+        fdf.n = n;
+        fdf.p = p;
+        fdf.params = &fitState;
+
+        reserveWorkspace(n, p, geodesicAcceleration);
+
+        /* starting point */
+        const std::vector<double> &startValues = summary.warmStarted ? solution : inputs;
+        for (size_t k = 0; k < P; ++k) {
+            if (parameterIndexes[k] >= 0) {
+                gsl_vector_set(start, parameterIndexes[k], startValues[k]);
+            }
+        }
+
+        /* initialize solver */
+        gsl_multifit_nlinear_init(start, &fdf, work);
+        gsl_vector *f = gsl_multifit_nlinear_residual(work);
+        gsl_blas_ddot(f, f, &initialCost);
+        beginIterations(startMs);
+        running = true;
+        return GSL_CONTINUE;
+    }
+
+    /*
+     * run at most maxSteps iterations of the fit started with begin. Returns GSL_CONTINUE while the fit is unfinished,
+     * and otherwise the status of the solver as solve does, once the results are set. A cancelled fit finishes at the
+     * next call, with GSL_CONTINUE and the cancelled stop reason
+     */
+    int advance(const size_t maxSteps) {
+        if (!running) {
+            return summary.status;
+        }
+        const int status = iterate(maxSteps);
+        if (unfinished(status)) {
+            return GSL_CONTINUE;
+        }
+        summary.status = status;
+        finish();
+        return summary.status;
+    }
+
+    /* set the results of the fit from the solver, or from the inputs if there was nothing to fit */
+    void finish() {
+        const size_t n = t.size();
+        const size_t P = inputs.size();
+        if (running) {
+            running = false;
+            double chisq, rcond;
+            gsl_vector *f = gsl_multifit_nlinear_residual(work);
+
+            /* covariance of best fit parameters, final cost and cond(J(x)) */
+            gsl_multifit_nlinear_covar(gsl_multifit_nlinear_jac(work), 0.0, covar);
+            gsl_blas_ddot(f, f, &chisq);
+            gsl_multifit_nlinear_rcond(&rcond, work);
+
+            /* For an unweighted least-squares function f_i = (Y(x, t_i) - y_i)
+               the covariance matrix should be multiplied by the variance of the residuals
+               about the best-fit \sigma^2 = \sum (y_i - Y(x,t_i))^2 / (n-p)
+               to give the variance-covariance matrix \sigma^2 C. */
+            const double residualVariance = chisq / (n - p);
+            const gsl_vector *solutionVector = gsl_multifit_nlinear_position(work);
+            for (size_t i = 0; i < n; ++i) {
+                residual[i] = gsl_vector_get(f, i);
+            }
+            for (size_t k = 0; k < P; ++k) {
+                const int index = parameterIndexes[k];
+                if (index < 0) {
+                    continue;
+                }
+                parameters[k] = gsl_vector_get(solutionVector, index);
+                errors[k] = sqrt(residualVariance * gsl_matrix_get(covar, index, index));
+                for (size_t l = 0; l < P; ++l) {
+                    if (parameterIndexes[l] >= 0) {
+                        covariance[k * P + l] = residualVariance * gsl_matrix_get(covar, index, parameterIndexes[l]);
+                    }
+                }
+            }
+
+            summary.stopReason = stopReason;
+            summary.iterations = gsl_multifit_nlinear_niter(work);
+            summary.functionEvaluations = fdf.nevalf;
+            summary.jacobianEvaluations = fdf.nevaldf;
+            summary.initialCost = initialCost;
+            summary.finalCost = chisq;
+            summary.condition = 1.0 / rcond;
+            summary.residualVariance = residualVariance;
+            methodName = gsl_multifit_nlinear_name(work);
+            trsName = gsl_multifit_nlinear_trs_name(work);
+
+            if (summary.status == GSL_SUCCESS) {
+                solution = parameters;
+                solutionIndexes = parameterIndexes;
+                solutionFunction = function;
+                hasSolution = true;
+            }
+        }
+
+        for (size_t i = 0; i < componentN; ++i) {
+            const double amp = parameters[3 * i], fwhm = parameters[3 * i + 2];
+            const double covAmpFwhm = isnan(errors[3 * i]) || isnan(errors[3 * i + 2]) ? 0 : covariance[(3 * i) * P + 3 * i + 2];
+            integrals[2 * i] = componentIntegral(function, amp, fwhm);
+            integrals[2 * i + 1] = componentIntegralError(integrals[2 * i], amp, errors[3 * i], fwhm, errors[3 * i + 2], covAmpFwhm);
+        }
+        summary.elapsedTime = emscripten_get_now() - startTime;
+    }
+
+    /* human-readable summary of the fit, with @xUnit, @yUnit, @slopeUnit and @integralUnit placeholders for the units */
+    const char *formatLog() {
+        if (logFormatted) {
+            return log.c_str();
+        }
+        log.clear();
+        if (function == FITTING_GAUSSIAN) {
+            appendFormat(log, " Gaussian function fitting with %zu component(s)\n", componentN);
+        } else if (function == FITTING_LORENTZIAN) {
+            appendFormat(log, " Lorentzian function fitting with %zu component(s)\n", componentN);
+        }
+
+        if (methodName) {
+            appendFormat(log, " summary from method '%s/%s'\n", methodName, trsName);
+            appendFormat(log, " number of iterations = %zu\n", (size_t)summary.iterations);
+            appendFormat(log, " function evaluations = %zu\n", (size_t)summary.functionEvaluations);
+            appendFormat(log, " Jacobian evaluations = %zu\n", (size_t)summary.jacobianEvaluations);
+            const char *reasons[] = {"not converged", "small step size", "small gradient", "cancelled", "time limit"};
+            appendFormat(log, " reason for stopping  = %s\n", reasons[(int)summary.stopReason]);
+            appendFormat(log, " initial |f(x)|       = %f\n", sqrt(summary.initialCost));
+            appendFormat(log, " final |f(x)|         = %f\n", sqrt(summary.finalCost));
+            appendFormat(log, " initial cost         = %.12e\n", summary.initialCost);
+            appendFormat(log, " final cost           = %.12e\n", summary.finalCost);
+            appendFormat(log, " final cond(J)        = %.12e\n", summary.condition);
+            if (summary.warmStarted) {
+                appendFormat(log, " started from the previous solution\n");
+            }
+            appendFormat(log, " fitting time         = %.3f ms\n", summary.elapsedTime);
+        }
 
-        if (lockedInputs[i][2] == 0) {
-            index = gsl_matrix_get(parameterIndexes, i, 2);
-            fwhm = gsl_vector_get(x, index);
-            fwhmError = sqrt(residualVariance * gsl_matrix_get(covar, index, index));
-            snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " fwhm%zu                = %.12e @yUnit \u00b1 %.12e (%.3g%%)\n", i + 1, fwhm, fwhmError, 100 * fwhmError / abs(fwhm));
+        const size_t baseline = 3 * componentN;
+        appendFormat(log, "\n baseline\n");
+        if (parameterIndexes[baseline] >= 0) {
+            const double yIntercept = parameters[baseline], yInterceptError = errors[baseline];
+            appendFormat(log, " y intercept          = %.12e @yUnit \u00b1 %.12e (%.3g%%)\n", yIntercept, yInterceptError, 100 * yInterceptError / abs(yIntercept));
         } else {
-            fwhm = inputs[i][2];
-            fwhmError = NAN;
-            snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " fwhm%zu        (fixed) = %.12e @yUnit\n", i + 1, fwhm);
+            appendFormat(log, " y intercept  (fixed) = %.12e @yUnit\n", parameters[baseline]);
+        }
+        if (parameterIndexes[baseline + 1] >= 0) {
+            const double slope = parameters[baseline + 1], slopeError = errors[baseline + 1];
+            appendFormat(log, " slope                = %.12e @slopeUnit \u00b1 %.12e (%.3g%%)\n", slope, slopeError, 100 * slopeError / abs(slope));
+        } else {
+            appendFormat(log, " slope        (fixed) = %.12e @slopeUnit\n", parameters[baseline + 1]);
+        }
+
+        const char *names[3] = {"amp", "center", "fwhm"};
+        const char *units[3] = {"@yUnit", "@xUnit", "@yUnit"};
+        for (size_t i = 0; i < componentN; ++i) {
+            appendFormat(log, " component #%zu\n", i + 1);
+            for (size_t k = 0; k < 3; ++k) {
+                const double value = parameters[3 * i + k], error = errors[3 * i + k];
+                char label[32];
+                snprintf(label, sizeof(label), "%s%zu", names[k], i + 1);
+                if (parameterIndexes[3 * i + k] >= 0) {
+                    appendFormat(log, " %-20s = %.12e %s \u00b1 %.12e (%.3g%%)\n", label, value, units[k], error, 100 * error / abs(value));
+                } else {
+                    appendFormat(log, " %-12s (fixed) = %.12e %s\n", label, value, units[k]);
+                }
+            }
+
+            const double integral = integrals[2 * i], integralError = integrals[2 * i + 1];
+            if (parameterIndexes[3 * i] < 0 && parameterIndexes[3 * i + 2] < 0) {
+                appendFormat(log, " integral of function = %.12e @integralUnit\n", integral);
+            } else {
+                appendFormat(log, " integral of function ~= %.12e @integralUnit \u00b1 %.12e (%.3g%%)\n", integral, integralError, 100 * integralError / abs(integral));
+            }
+        }
+
+        logFormatted = true;
+        return log.c_str();
+    }
+};
+
+FittingContext* EMSCRIPTEN_KEEPALIVE fittingContextCreate() {
+    return new FittingContext();
+}
+
+void EMSCRIPTEN_KEEPALIVE fittingContextFree(FittingContext* context) {
+    delete context;
+}
+
+/*
+ * Fits componentN Gaussian (function 0) or Lorentzian (function 1) components and a linear baseline to N samples,
+ * starting from the P = 3 * componentN + 2 inputs (amp, center, fwhm) of each component followed by (yIntercept,
+ * slope), with lockedInputs flagging the locked ones with 1. If warmStart is set, the free parameters start from the
+ * previous solution of the context instead, if it converged with the same function and free parameters. The results
+ * are kept in the context until its next fit. Returns the status of the solver, 0 if it converged
+ */
+int EMSCRIPTEN_KEEPALIVE fittingContextFit(
+    FittingContext* context, const int function, const double* xInArray, const double* yInArray, const int N,
+    const double* inputs, const int* lockedInputs, const int componentN, const int geodesicAcceleration, const int warmStart) {
+    context->setModel(function, componentN, inputs, lockedInputs);
+    context->setData(xInArray, yInArray, N, false);
+    return context->solve(geodesicAcceleration, warmStart);
+}
+
+/*
+ * Starts a fit with the same arguments as fittingContextFit, without iterating, so that it can be advanced with
+ * fittingContextIterate. Returns GSL_CONTINUE if the fit has started, or the status of the fit if there was nothing to fit
+ */
+int EMSCRIPTEN_KEEPALIVE fittingContextBegin(
+    FittingContext* context, const int function, const double* xInArray, const double* yInArray, const int N,
+    const double* inputs, const int* lockedInputs, const int componentN, const int geodesicAcceleration, const int warmStart) {
+    context->setModel(function, componentN, inputs, lockedInputs);
+    context->setData(xInArray, yInArray, N, false);
+    return context->begin(geodesicAcceleration, warmStart);
+}
+
+/*
+ * Runs at most maxSteps iterations of the fit started with fittingContextBegin. Returns 1 while the fit is unfinished,
+ * and 0 once it has finished, with its results kept in the context as for fittingContextFit
+ */
+int EMSCRIPTEN_KEEPALIVE fittingContextIterate(FittingContext* context, const int maxSteps) {
+    context->advance(maxSteps > 0 ? maxSteps : 0);
+    return context->running ? 1 : 0;
+}
+
+/* limits of the following fits: the maximum number of iterations, and the time limit in ms (0 for none) */
+void EMSCRIPTEN_KEEPALIVE fittingContextSetLimits(FittingContext* context, const int maxIterations, const double timeLimit) {
+    context->maxIterations = maxIterations > 0 ? maxIterations : 200;
+    context->timeLimit = timeLimit > 0 ? timeLimit : 0;
+}
+
+/*
+ * stop the fit started in the context with fittingContextBegin. The next call to fittingContextIterate finishes it with
+ * the cancelled stop reason, keeping the parameters reached so far. A fit running in fittingContextFit blocks the thread
+ * (the module is built without pthreads), so it can't be cancelled, only bounded with the time limit
+ */
+void EMSCRIPTEN_KEEPALIVE fittingContextCancel(FittingContext* context) {
+    context->cancelRequested = true;
+}
+
+const FittingSummary* EMSCRIPTEN_KEEPALIVE fittingContextSummary(FittingContext* context) {
+    return &context->summary;
+}
+
+/* P parameters of the last fit */
+const double* EMSCRIPTEN_KEEPALIVE fittingContextParameters(FittingContext* context) {
+    return context->parameters.data();
+}
+
+/* P errors of the last fit, NaN for locked parameters */
+const double* EMSCRIPTEN_KEEPALIVE fittingContextErrors(FittingContext* context) {
+    return context->errors.data();
+}
+
+/* P x P covariance of the last fit */
+const double* EMSCRIPTEN_KEEPALIVE fittingContextCovariance(FittingContext* context) {
+    return context->covariance.data();
+}
+
+/* (integral, error) of each component of the last fit */
+const double* EMSCRIPTEN_KEEPALIVE fittingContextIntegrals(FittingContext* context) {
+    return context->integrals.data();
+}
+
+/* N residuals of the last fit */
+const double* EMSCRIPTEN_KEEPALIVE fittingContextResidual(FittingContext* context) {
+    return context->residual.data();
+}
+
+/* log of the last fit, formatted on the first request */
+const char* EMSCRIPTEN_KEEPALIVE fittingContextLog(FittingContext* context) {
+    return context->formatLog();
+}
+
+/*
+ * Fits the same model to M spectra of N channels sharing the x values, stored consecutively, such as the pixels of a
+ * region of a cube in raster order with the given width. The parameters of each pixel are laid out as (amp, center,
+ * fwhm) for each component, followed by (yIntercept, slope), giving P = 3 * componentN + 2 values per pixel for the
+ * initial and locked inputs, and the parameter and error outputs. The integral output has (integral, error) for each
+ * component of each pixel.
+ * NaN channels are left out of each fit. If seedFromNeighbour is set, each fit starts from the parameters of the pixel
+ * to the left, or failing that above, if that fit converged, and from the initial inputs otherwise.
+ * Pixels whose fits fail to converge, or give non-finite values or components centred outside the data, are flagged
+ * with 0 in the convergence mask. Returns the number of converged fits
+ */
+int EMSCRIPTEN_KEEPALIVE fittingBatch(
+    const int function, const double* xInArray, const double* spectra, const int N, const int M, const int width,
+    const double* initialInputs, const int* lockedInputs, const int componentN, const int seedFromNeighbour,
+    double* parametersOut, double* errorsOut, double* integralOut, unsigned char* convergedOut) {
+    const size_t P = 3 * componentN + 2;
+    FittingContext context;
+
+    int numConverged = 0;
+    for (size_t m = 0; m < M; ++m) {
+        double *parametersPixel = parametersOut + m * P;
+        double *errorsPixel = errorsOut + m * P;
+        double *integralPixel = integralOut + m * 2 * componentN;
+        convergedOut[m] = 0;
+
+        /* seed from a converged neighbour, or the initial inputs */
+        const double *seedPixel = initialInputs;
+        if (seedFromNeighbour && m % width > 0 && convergedOut[m - 1]) {
+            seedPixel = parametersOut + (m - 1) * P;
+        } else if (seedFromNeighbour && m >= width && convergedOut[m - width]) {
+            seedPixel = parametersOut + (m - width) * P;
+        }
+        const size_t p = context.setModel(function, componentN, seedPixel, lockedInputs);
+
+        /* leave out NaN channels */
+        const size_t n = context.setData(xInArray, spectra + m * N, N, true);
+
+        std::fill(parametersPixel, parametersPixel + P, NAN);
+        std::fill(errorsPixel, errorsPixel + P, NAN);
+        std::fill(integralPixel, integralPixel + 2 * componentN, NAN);
+        if (n <= p || p == 0) {
+            continue;
+        }
+
+        const int status = context.solve(true, false);
+        std::copy(context.parameters.begin(), context.parameters.end(), parametersPixel);
+        std::copy(context.errors.begin(), context.errors.end(), errorsPixel);
+        std::copy(context.integrals.begin(), context.integrals.end(), integralPixel);
+
+        /* a fit is only accepted if its parameters and errors are finite, and the components are centred within the data */
+        bool valid = true;
+        for (size_t k = 0; k < P; ++k) {
+            if (context.parameterIndexes[k] >= 0) {
+                valid = valid && isfinite(parametersPixel[k]) && isfinite(errorsPixel[k]);
+            }
+        }
+        const double xMin = *std::min_element(context.t.begin(), context.t.end());
+        const double xMax = *std::max_element(context.t.begin(), context.t.end());
+        for (size_t i = 0; i < componentN; ++i) {
+            valid = valid && parametersPixel[3 * i + 1] >= xMin && parametersPixel[3 * i + 1] <= xMax && parametersPixel[3 * i + 2] != 0;
+        }
+
+        if (status == GSL_SUCCESS && valid) {
+            convergedOut[m] = 1;
+            numConverged++;
+        }
+    }
+    return numConverged;
+}
+
+/*
+ * Guesses the initial values of a profile fit by detecting the spectral features and the continuum of the profile.
+ * The profile is binned to about 128 channels and Hanning smoothed twice. A Gaussian fitted to the peak of the
+ * histogram of the smoothed intensities gives the mean and noise (stddev) of the line-free channels. Runs of at least
+ * 4 channels beyond 2 sigma of the mean, with their own mean beyond 3 sigma, are taken as features. Strong, wide
+ * features are split at the local minima and maxima within them, if their pattern suggests blended lines (e.g.
+ * max-min-max in an emission feature). Each feature then gives a component: amp and center from its extremum, and
+ * fwhm from half its width.
+ * Without a given baseline, the continuum is first estimated from the line-free channels of the profile plus its
+ * reverse, which cancels the slope and is found with the same histogram fit, and removed from the profile. If the
+ * features dominate the profile, the mean and noise are over-estimated, which affects the detection.
+ * The buffers are kept between detections with the same detector, so that repeated detections (e.g. over the pixels
+ * of a region) don't allocate
+ */
+struct ProfileFeatureDetector {
+    struct Feature {
+        int fromIndex;      // channels of the smoothed profile
+        int toIndex;
+        int fromIndexOri;   // channels of the profile
+        int toIndexOri;
+    };
+
+    FittingContext histogramFit;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> xSmoothed;
+    std::vector<double> ySmoothed;
+    std::vector<double> scratch;
+    std::vector<double> histX;
+    std::vector<double> histY;
+    std::vector<Feature> features;
+    std::vector<Feature> finalFeatures;
+
+    /*
+     * index i of the values such that target lies between values[i] and values[i + 1], or i + 1 if it equals
+     * values[i + 1], and -1 if there is none. Other lookups treat -1 as index 0, or the value at it as NaN
+     */
+    static int indexByValue(const std::vector<double> &values, const double target) {
+        for (size_t i = 0; i + 1 < values.size(); i++) {
+            if (values[i] <= target && target < values[i + 1]) {
+                return i;
+            } else if (values[i] >= target && target > values[i + 1]) {
+                return i;
+            } else if (target == values[i + 1]) {
+                return i + 1;
+            }
+        }
+        return -1;
+    }
+
+    static double valueAt(const std::vector<double> &values, const int index) {
+        return index >= 0 && index < (int)values.size() ? values[index] : NAN;
+    }
+
+    /* mean of values[start, end), NaN if empty */
+    static double mean(const std::vector<double> &values, const int start, int end) {
+        end = std::min(end, (int)values.size());
+        if (start < 0 || start >= end) {
+            return NAN;
+        }
+        double sum = 0;
+        for (int i = start; i < end; i++) {
+            sum += values[i];
+        }
+        return sum / (end - start);
+    }
+
+    /* extremum of values[start, end), skipping NaN values. NaN if there is none */
+    static double extremum(const std::vector<double> &values, const int start, const int end, const bool maximum) {
+        double result = NAN;
+        for (int i = start; i < end; i++) {
+            if (!isnan(values[i]) && (isnan(result) || (maximum ? values[i] > result : values[i] < result))) {
+                result = values[i];
+            }
+        }
+        return result;
+    }
+
+    /* smooth with a Hanning kernel of width 3, keeping the first and last values */
+    static void hanning(std::vector<double> &data, std::vector<double> &buffer) {
+        if (data.size() < 3) {
+            return;
+        }
+        buffer.assign(data.begin(), data.end());
+        for (size_t i = 1; i + 1 < data.size(); i++) {
+            data[i] = 0.25 * buffer[i - 1] + 0.5 * buffer[i] + 0.25 * buffer[i + 1];
+        }
+    }
+
+    /* bin by floor(N / 128) + 1 channels, leaving out the last bin, and Hanning smooth twice */
+    void preprocess(const std::vector<double> &data, std::vector<double> &out) {
+        const size_t binWidth = data.size() / 128 + 1;
+        out.clear();
+        for (size_t i = 0; i + binWidth < data.size(); i += binWidth) {
+            out.push_back(mean(data, i, i + binWidth));
+        }
+        hanning(out, scratch);
+        hanning(out, scratch);
+    }
+
+    /*
+     * fit a Gaussian to the peak of the histogram of the values with the given number of equal-width bins, giving the
+     * center and stddev of the distribution. If the peak is in the first or last bin, the fit is skipped and the
+     * center of that bin and the bin width are used instead
+     */
+    void histogramGaussianFit(const std::vector<double> &values, const int bins, double *center, double *stddev) {
+        double min = NAN, max = NAN;
+        for (size_t i = 0; i < values.size(); i++) {
+            if (!isnan(values[i])) {
+                min = isnan(min) || values[i] < min ? values[i] : min;
+                max = isnan(max) || values[i] > max ? values[i] : max;
+            }
+        }
+        const double binWidth = (max - min) / bins;
+        std::vector<double> &edges = scratch;
+        edges.resize(bins + 1);
+        for (int i = 0; i < bins; i++) {
+            edges[i] = min + i * binWidth;
+        }
+        edges[bins] = max;
+
+        /* the histogram, padded with an empty bin on either side */
+        histY.assign(bins + 2, 0);
+        for (size_t i = 0; i < values.size(); i++) {
+            const double value = values[i];
+            if (isnan(value)) {
+                continue;
+            } else if (value == edges[bins]) {
+                histY[bins]++;
+                continue;
+            } else if (!(binWidth > 0)) {
+                continue;
+            }
+            int j = std::max(0, std::min(bins - 1, (int)floor((value - min) / binWidth)));
+            while (j > 0 && value < edges[j]) {
+                j--;
+            }
+            while (j < bins - 1 && value >= edges[j + 1]) {
+                j++;
+            }
+            if (value >= edges[j] && value < edges[j + 1]) {
+                histY[j + 1]++;
+            }
+        }
+
+        /* centers of the bins, padded on either side. Only the first bins - 1 centers are used, so the last padding bin falls on the last bin */
+        histX.resize(bins + 1);
+        for (int i = 0; i + 1 < bins; i++) {
+            histX[i + 1] = (edges[i] + edges[i + 1]) / 2;
+        }
+        const double delta = bins > 2 ? histX[2] - histX[1] : NAN;
+        histX[0] = histX[1] - delta;
+        histX[bins] = histX[bins - 1] + delta;
+
+        const int maxIndex = std::max_element(histY.begin(), histY.end()) - histY.begin();
+        if (maxIndex == 1 || maxIndex == bins) {
+            *center = histX[maxIndex];
+            *stddev = delta;
+            return;
+        }
+
+        const double inputs[5] = {histY[maxIndex], histX[maxIndex], 2 * sqrt(log(10.0) * 2) * 0.5 * delta, 0, 0};
+        const int locked[5] = {0, 0, 0, 1, 1};
+        histogramFit.setModel(FITTING_GAUSSIAN, 1, inputs, locked);
+        histogramFit.setData(histX.data(), histY.data(), bins + 1, false);
+        histogramFit.solve(true, false);
+        *center = histogramFit.parameters[1];
+        *stddev = fabs(histogramFit.parameters[2]) / (2 * sqrt(log(2.0) * 2));
+    }
+
+    /*
+     * mean positions of the first and last line-free segments of the profile, from the histogram of the profile plus
+     * its reverse. If there is only one, the mean positions of the halves of the profile are added
+     */
+    void estimatedPoints(double *start, double *end) {
+        const int N = y.size();
+        std::vector<double> flippedSum(N);
+        for (int i = 0; i < N; i++) {
+            flippedSum[i] = y[i] + y[N - 1 - i];
+        }
+        double flippedSumMean, flippedSumStddev;
+        histogramGaussianFit(flippedSum, (int)floor(sqrt((double)N)), &flippedSumMean, &flippedSumStddev);
+
+        std::vector<double> xMeanSegment, yMeanSegment;
+        const double SN = 2;
+        const double FLOOR = flippedSumMean - SN * flippedSumStddev;
+        const double CEILING = flippedSumMean + SN * flippedSumStddev;
+        int indexFrom = 0;
+        bool inSegment = false;
+        for (int i = 0; i < N; i++) {
+            const double value = flippedSum[i];
+            if (value < CEILING && value > FLOOR && !inSegment && i <= N - 2) {
+                indexFrom = i;
+                inSegment = true;
+            } else if ((value > CEILING || value < FLOOR) && inSegment) {
+                inSegment = false;
+                xMeanSegment.push_back(mean(x, indexFrom, i));
+                yMeanSegment.push_back(mean(y, indexFrom, i));
+            } else if (value < CEILING && value > FLOOR && inSegment && i == N - 1) {
+                xMeanSegment.push_back(mean(x, indexFrom, i));
+                yMeanSegment.push_back(mean(y, indexFrom, i));
+                break;
+            }
         }
 
-        if (function == 0) {
-            integral = amp * abs(fwhm / (2 * sqrt(log(2.0)))) * sqrt(M_PI);
-        } else if (function == 1) {
-            integral = 0.5 * M_PI * amp * fwhm;
+        if (xMeanSegment.size() <= 1) {
+            xMeanSegment.push_back(mean(x, 0, N / 2));
+            xMeanSegment.push_back(mean(x, N / 2, N));
+            yMeanSegment.push_back(mean(y, 0, N / 2));
+            yMeanSegment.push_back(mean(y, N / 2, N));
         }
+        start[0] = xMeanSegment.front();
+        start[1] = yMeanSegment.front();
+        end[0] = xMeanSegment.back();
+        end[1] = yMeanSegment.back();
+    }
 
-        if (lockedInputs[i][0] == 1 && lockedInputs[i][2] == 1) {
-            integralError = NAN;
-            snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " integral of function = %.12e @integralUnit\n", integral);
+    /* channels at which a strong feature should be split, from the pattern of its local minima and maxima */
+    static void splitFeature(const Feature &feature, const double meanSN, const std::vector<int> &localMin, const std::vector<int> &localMax, std::vector<int> &dividers) {
+        std::vector<int> candidates(localMin);
+        candidates.insert(candidates.end(), localMax.begin(), localMax.end());
+        std::sort(candidates.begin(), candidates.end());
+        /* peaks are the extrema of the same sign as the feature, e.g. maxima of an emission feature */
+        const std::vector<int> &peaks = meanSN > 0 ? localMax : localMin;
+        const std::vector<int> &troughs = meanSN > 0 ? localMin : localMax;
+        const auto isPeak = [&peaks](const int index) { return std::find(peaks.begin(), peaks.end(), index) != peaks.end(); };
+        const auto isTrough = [&troughs](const int index) { return std::find(troughs.begin(), troughs.end(), index) != troughs.end(); };
+
+        dividers.push_back(feature.fromIndexOri);
+        const size_t count = candidates.size();
+        if (count == 1) {
+            if (isTrough(candidates[0])) {
+                dividers.push_back(candidates[0]);
+            }
+        } else if (count == 2) {
+            const int left = candidates[0], right = candidates[1];
+            if (isTrough(left)) {
+                if (isTrough(right)) {
+                    dividers.push_back(left);
+                    dividers.push_back(right);
+                } else if (isPeak(right)) {
+                    dividers.push_back(left);
+                }
+            } else if (isPeak(left)) {
+                if (isTrough(right)) {
+                    dividers.push_back(right);
+                } else if (isPeak(right)) {
+                    dividers.push_back((left + right) / 2);
+                }
+            }
+        } else if (count >= 3) {
+            for (size_t k = 0; k + 2 < count; k++) {
+                const int left = candidates[k], middle = candidates[k + 1], right = candidates[k + 2];
+                if (isTrough(left)) {
+                    if (isTrough(middle)) {
+                        dividers.push_back(left);
+                    } else if (isPeak(middle) && k == 0) {
+                        dividers.push_back(left);
+                    }
+                } else if (isPeak(left)) {
+                    if (isTrough(middle) && isPeak(right)) {
+                        dividers.push_back(middle);
+                    } else if (isPeak(middle)) {
+                        dividers.push_back((left + middle) / 2);
+                    }
+                }
+            }
+
+            const int last1 = candidates[count - 1], last2 = candidates[count - 2], last3 = candidates[count - 3];
+            if (isTrough(last1)) {
+                dividers.push_back(last1);
+            }
+            if (isPeak(last2) && isPeak(last1)) {
+                dividers.push_back((last2 + last1) / 2);
+            }
+            if (isTrough(last3) && isTrough(last2) && isPeak(last1)) {
+                dividers.push_back(last2);
+            }
+        }
+        dividers.push_back(feature.toIndexOri);
+    }
+
+    /*
+     * detect the components of the profile, writing the (amp, center, fwhm) of up to maxComponents components, and
+     * the (order, yIntercept, slope) of the baseline, using the given one if it is not NULL. Returns the number of
+     * components detected
+     */
+    int detect(const double *xInArray, const double *yInArray, const int N, const double *baselineIn, double *componentsOut, const int maxComponents, double *baselineOut) {
+        x.assign(xInArray, xInArray + N);
+        y.assign(yInArray, yInArray + N);
+
+        double startPoint[2], endPoint[2];
+        estimatedPoints(startPoint, endPoint);
+
+        /* set baseline */
+        double order, yIntercept, slope, yMean = NAN;
+        if (baselineIn) {
+            slope = baselineIn[2];
+            yIntercept = baselineIn[1];
         } else {
-            if (lockedInputs[i][0] == 0 && lockedInputs[i][2] == 0) {
-                sigmaAmpFwhm = residualVariance * gsl_matrix_get(covar, gsl_matrix_get(parameterIndexes, i, 0), gsl_matrix_get(parameterIndexes, i, 2));
-                integralError = integral * sqrt(pow(ampError / amp, 2) + pow(fwhmError / fwhm, 2) + 2 * sigmaAmpFwhm / (amp * fwhm));
-            } else if (lockedInputs[i][0] == 0) {
-                integralError = integral * abs(ampError / amp);
+            yMean = (startPoint[1] + endPoint[1]) / 2;
+            slope = (endPoint[1] - startPoint[1]) / (endPoint[0] - startPoint[0]);
+            yIntercept = startPoint[1] - slope * startPoint[0];
+        }
+        for (int i = 0; i < N; i++) {
+            y[i] -= slope * x[i] + yIntercept;
+        }
+
+        preprocess(x, xSmoothed);
+        preprocess(y, ySmoothed);
+
+        /* fit a gaussian to the intensity histogram as an estimate of continuum level and noise level */
+        const int bins = (int)floor(sqrt((double)N));
+        double intensityMean, intensityStddev;
+        histogramGaussianFit(ySmoothed, bins <= 8 ? 8 : bins, &intensityMean, &intensityStddev);
+
+        if (baselineIn) {
+            order = baselineIn[0];
+        } else {
+            /* validate order of baseline with the estimated points and the histogram fitting stddev */
+            const double width = 3 * intensityStddev;
+            if (-width < startPoint[1] && startPoint[1] < width && -width < endPoint[1] && endPoint[1] < width) {
+                order = -1;
+                yIntercept = 0;
+                slope = 0;
+            } else if (yMean - width < startPoint[1] && startPoint[1] < yMean + width && yMean - width < endPoint[1] && endPoint[1] < yMean + width) {
+                order = 0;
+                yIntercept = yMean;
+                slope = 0;
             } else {
-                integralError = integral * abs(fwhmError / fwhm);
+                order = 1;
+            }
+        }
+        baselineOut[0] = order;
+        baselineOut[1] = yIntercept;
+        baselineOut[2] = slope;
+
+        /* 1st: mark runs of channels with signal */
+        const double nSigmaThreshold = 2;
+        const int signalChCountThreshold = 4;
+        const double floorValue = intensityMean - nSigmaThreshold * intensityStddev;
+        const double ceilingValue = intensityMean + nSigmaThreshold * intensityStddev;
+        const int M = ySmoothed.size();
+        features.clear();
+        bool inFeature = false;
+        int fromIndex = 0;
+        for (int i = 0; i < M; i++) {
+            const double value = ySmoothed[i];
+            const bool outside = value > ceilingValue || value < floorValue;
+            const bool inside = value < ceilingValue && value > floorValue;
+            int toIndex = -1;
+            if (outside && !inFeature) {
+                fromIndex = i;
+                inFeature = true;
+            } else if (inside && inFeature) {
+                toIndex = i - 1;
+                inFeature = false;
+            } else if (outside && inFeature && i == M - 1) {
+                toIndex = i;
+            }
+            if (toIndex >= 0) {
+                const Feature feature = {fromIndex, toIndex, indexByValue(x, xSmoothed[fromIndex]), indexByValue(x, xSmoothed[toIndex])};
+                const double featureMean = mean(ySmoothed, fromIndex, toIndex + 1);
+                if (std::max(feature.toIndexOri, 0) - std::max(feature.fromIndexOri, 0) + 1 >= signalChCountThreshold &&
+                    (featureMean > intensityMean + 3 * intensityStddev || featureMean < intensityMean - 3 * intensityStddev)) {
+                    features.push_back(feature);
+                }
+            }
+        }
+
+        /* 2nd: check the multiplicity of each feature */
+        const int multiChCountThreshold = 12;
+        const double multiMeanSnThreshold = 4;
+        finalFeatures.clear();
+        std::vector<int> localMin, localMax, dividers;
+        for (size_t i = 0; i < features.size(); i++) {
+            const Feature &feature = features[i];
+            const double meanSN = (mean(ySmoothed, feature.fromIndex, feature.toIndex) - intensityMean) / intensityStddev;
+            const int chCount = feature.toIndex - feature.fromIndex + 1;
+            if (!(fabs(meanSN) >= multiMeanSnThreshold && chCount >= multiChCountThreshold)) {
+                finalFeatures.push_back(feature);
+                continue;
+            }
+
+            /* local minima and maxima, where the ends of a window of 5 channels are its two highest or lowest values */
+            localMin.clear();
+            localMax.clear();
+            for (int j = feature.fromIndex; j < feature.toIndex - 4; j++) {
+                int sortedIndex[5] = {0, 1, 2, 3, 4};
+                const double *window = ySmoothed.data() + j;
+                std::stable_sort(sortedIndex, sortedIndex + 5, [window](const int a, const int b) {
+                    return !isnan(window[a]) && (isnan(window[b]) || window[a] < window[b]);
+                });
+                const int index = indexByValue(x, xSmoothed[j + 2]);
+                if (index >= 0 && ((sortedIndex[3] == 0 && sortedIndex[4] == 4) || (sortedIndex[3] == 4 && sortedIndex[4] == 0))) {
+                    localMin.push_back(index);
+                }
+                if (index >= 0 && ((sortedIndex[0] == 0 && sortedIndex[1] == 4) || (sortedIndex[0] == 4 && sortedIndex[1] == 0))) {
+                    localMax.push_back(index);
+                }
+            }
+
+            dividers.clear();
+            splitFeature(feature, meanSN, localMin, localMax, dividers);
+            for (size_t d = 0; d + 1 < dividers.size(); d++) {
+                const Feature part = {indexByValue(xSmoothed, valueAt(x, dividers[d])), indexByValue(xSmoothed, valueAt(x, dividers[d + 1])), dividers[d], dividers[d + 1]};
+                finalFeatures.push_back(part);
+            }
+        }
+
+        /* 3rd: a component for each feature, at its extremum */
+        for (size_t i = 0; i < finalFeatures.size() && (int)i < maxComponents; i++) {
+            const Feature &feature = finalFeatures[i];
+            const int start = std::max(feature.fromIndex, 0);
+            const int end = std::min(std::max(feature.toIndex, 0) + 1, M);
+            const double amp = extremum(ySmoothed, start, end, mean(ySmoothed, start, end) > intensityMean);
+            int extremumIndex = -1;
+            for (int j = start; j < end && extremumIndex < 0; j++) {
+                extremumIndex = ySmoothed[j] == amp ? j - start : -1;
             }
-            snprintf(logBuffer + strlen(logBuffer), sizeof(logBuffer) - strlen(logBuffer), " integral of function ~= %.12e @integralUnit \u00b1 %.12e (%.3g%%)\n", integral, integralError, 100 * integralError / abs(integral));
+            componentsOut[3 * i] = amp;
+            componentsOut[3 * i + 1] = valueAt(xSmoothed, start + extremumIndex);
+            componentsOut[3 * i + 2] = fabs(valueAt(x, feature.toIndexOri) - valueAt(x, feature.fromIndexOri)) / 2;
         }
+        return finalFeatures.size();
+    }
+};
+
+ProfileFeatureDetector* EMSCRIPTEN_KEEPALIVE featureDetectorCreate() {
+    return new ProfileFeatureDetector();
+}
 
-        ampOut[2 * i] = amp;
-        ampOut[2 * i + 1] = ampError;
-        centerOut[2 * i] = center;
-        centerOut[2 * i + 1] = centerError;
-        fwhmOut[2 * i] = fwhm;
-        fwhmOut[2 * i + 1] = fwhmError;
-        integralOut[2 * i] = integral;
-        integralOut[2 * i + 1] = integralError;
+void EMSCRIPTEN_KEEPALIVE featureDetectorFree(ProfileFeatureDetector* detector) {
+    delete detector;
+}
+
+/*
+ * Detects the spectral features of a profile of N samples, and estimates the initial values of a fit: (amp, center,
+ * fwhm) of up to maxComponents components in componentsOut, and (order, yIntercept, slope) of the baseline in
+ * baselineOut, with order -1 for no baseline. The baseline is estimated unless baselineIn gives it as (order,
+ * yIntercept, slope). The detection uses the buffers of the given detector, owned by the caller, or of a temporary
+ * detector if it is NULL. Returns the number of components detected, which can exceed maxComponents
+ */
+int EMSCRIPTEN_KEEPALIVE autoDetectComponents(
+    ProfileFeatureDetector* detector, const double* xInArray, const double* yInArray, const int N, const double* baselineIn, double* componentsOut,
+    const int maxComponents, double* baselineOut) {
+    if (N < 4) {
+        baselineOut[0] = baselineIn ? baselineIn[0] : -1;
+        baselineOut[1] = baselineIn ? baselineIn[1] : 0;
+        baselineOut[2] = baselineIn ? baselineIn[2] : 0;
+        return 0;
+    }
+    if (!detector) {
+        ProfileFeatureDetector temporaryDetector;
+        return temporaryDetector.detect(xInArray, yInArray, N, baselineIn, componentsOut, maxComponents, baselineOut);
     }
+    return detector->detect(xInArray, yInArray, N, baselineIn, componentsOut, maxComponents, baselineOut);
+}
+
+
+/*
+ * 2D Gaussian components of an image fit, each with (centerX, centerY, amp, fwhmX, fwhmY, pa) as in the image fitting
+ * requests to the backend: fwhmX is the FWHM along the major axis, which is at pa degrees counterclockwise from the
+ * y axis, as for ellipse regions
+ */
+const size_t IMAGE_COMPONENT_PARAMETERS = 6;
+
+struct imageFitData
+{
+  const double *x;
+  const double *y;
+  const double *z;
+  size_t n;
+  size_t component;
 
-    gsl_vector_free(f);
-    gsl_vector_free(x);
-    gsl_vector_free(residual);
-    gsl_matrix_free(covar);
-    gsl_matrix_free(parameterIndexes);
-    gsl_vector_free(orderParameterIndexes);
+  /* values of all parameters, 6 for each component followed by the background offset, with locked parameters keeping
+     these values, and the index of each parameter in the fitting parameters vector (-1 if locked). The values are
+     unpacked once per evaluation into values */
+  const double *inputs;
+  const int *parameterIndexes;
+  double *values;
+};
 
-    return logBuffer;
+void unpackImageParameters(const gsl_vector * v, struct imageFitData *d) {
+    const size_t P = IMAGE_COMPONENT_PARAMETERS * d->component + 1;
+    for (size_t k = 0; k < P; ++k) {
+        const int index = d->parameterIndexes[k];
+        d->values[k] = index >= 0 ? gsl_vector_get(v, index) : d->inputs[k];
+    }
 }
 
-}
\ No newline at end of file
+/*
+ * A 2D Gaussian component at the offset (dx, dy) from its center, and its derivatives with respect to (centerX,
+ * centerY, amp, fwhmX, fwhmY, pa) in grad[6] if grad is not NULL
+ */
+double imageComponent(const double *values, const double dx, const double dy, double *grad) {
+    const double amp = values[2], fwhmX = values[3], fwhmY = values[4];
+    const double theta = values[5] * M_PI / 180.0;
+    const double c = cos(theta), s = sin(theta);
+    /* offsets along the major and minor axes */
+    const double u = -dx * s + dy * c;
+    const double v = dx * c + dy * s;
+    const double a = 1.0 / (fwhmX * fwhmX), b = 1.0 / (fwhmY * fwhmY);
+    const double e = exp(-FOUR_LN2 * (u * u * a + v * v * b));
+    const double g = amp * e;
+    if (grad) {
+        const double k = 2 * FOUR_LN2 * g;
+        grad[0] = -k * (u * s * a - v * c * b);
+        grad[1] = k * (u * c * a + v * s * b);
+        grad[2] = e;
+        grad[3] = k * u * u * a / fwhmX;
+        grad[4] = k * v * v * b / fwhmY;
+        grad[5] = k * u * v * (a - b) * M_PI / 180.0;
+    }
+    return g;
+}
+
+int image_f (const gsl_vector * v, void *params, gsl_vector * f) {
+    struct imageFitData *d = (struct imageFitData *) params;
+
+    unpackImageParameters(v, d);
+    const double offset = d->values[IMAGE_COMPONENT_PARAMETERS * d->component];
+    for (size_t i = 0; i < d->n; ++i)
+    {
+        double model = offset;
+        for (size_t j = 0; j < d->component; ++j) {
+            const double *values = d->values + IMAGE_COMPONENT_PARAMETERS * j;
+            model += imageComponent(values, d->x[i] - values[0], d->y[i] - values[1], NULL);
+        }
+        gsl_vector_set(f, i, d->z[i] - model);
+    }
+
+    return GSL_SUCCESS;
+}
+
+/* Jacobian of the residuals f_i = z_i - Z(x_i, y_i), one column per unlocked parameter */
+int image_df (const gsl_vector * v, void *params, gsl_matrix * J) {
+    struct imageFitData *d = (struct imageFitData *) params;
+
+    unpackImageParameters(v, d);
+    const int offsetIndex = d->parameterIndexes[IMAGE_COMPONENT_PARAMETERS * d->component];
+    for (size_t i = 0; i < d->n; ++i)
+    {
+        for (size_t j = 0; j < d->component; ++j) {
+            const double *values = d->values + IMAGE_COMPONENT_PARAMETERS * j;
+            const int *indexes = d->parameterIndexes + IMAGE_COMPONENT_PARAMETERS * j;
+            double grad[IMAGE_COMPONENT_PARAMETERS];
+            imageComponent(values, d->x[i] - values[0], d->y[i] - values[1], grad);
+            for (size_t k = 0; k < IMAGE_COMPONENT_PARAMETERS; ++k) {
+                if (indexes[k] >= 0) {
+                    gsl_matrix_set(J, i, indexes[k], -grad[k]);
+                }
+            }
+        }
+        if (offsetIndex >= 0) {
+            gsl_matrix_set(J, i, offsetIndex, -1.0);
+        }
+    }
+
+    return GSL_SUCCESS;
+}
+
+/*
+ * An image fit and its results, for fitting 2D Gaussians to the pixels of a small image region, such as the tiles
+ * cached by the client, as a preview of the fit by the backend. Parameters are laid out as (centerX, centerY, amp,
+ * fwhmX, fwhmY, pa) for each component followed by the background offset, P = 6 * componentN + 1 values, for the
+ * inputs and locked flags, and for the parameters and errors of the result. Pixel coordinates are those of the image.
+ * The solver workspace is reused between fits of the same size, as for profile fits
+ */
+struct ImageFittingContext : NonlinearSolver {
+    size_t componentN;
+    std::vector<double> inputs;
+    std::vector<int> parameterIndexes;  // index of each parameter in the fitting parameters vector, -1 if locked
+    size_t p;                           // number of free parameters
+
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+    std::vector<double> values;
+
+    std::vector<double> parameters;
+    std::vector<double> errors;
+    FittingSummary summary;
+
+    ImageFittingContext() : componentN(0), p(0), summary() {}
+
+    /* set the components and their P initial values. Returns the number of free parameters */
+    size_t setModel(const size_t numComponents, const double *initialInputs, const int *lockedInputs) {
+        componentN = numComponents;
+        const size_t P = IMAGE_COMPONENT_PARAMETERS * componentN + 1;
+        inputs.assign(initialInputs, initialInputs + P);
+        parameterIndexes.assign(P, -1);
+        p = 0;
+        for (size_t k = 0; k < P; ++k) {
+            if (lockedInputs[k] == 0) {
+                parameterIndexes[k] = p++;
+            }
+        }
+        return p;
+    }
+
+    /*
+     * set the pixels of a width x height block of the image starting at pixel (x0, y0), in raster order. NaN pixels,
+     * and pixels outside the mask (0) if there is one, are left out. Returns the number of pixels kept
+     */
+    size_t setData(const float *data, const size_t width, const size_t height, const double x0, const double y0, const unsigned char *mask) {
+        x.clear();
+        y.clear();
+        z.clear();
+        for (size_t j = 0; j < height; ++j) {
+            for (size_t i = 0; i < width; ++i) {
+                const size_t index = j * width + i;
+                if (isfinite(data[index]) && (!mask || mask[index])) {
+                    x.push_back(x0 + i);
+                    y.push_back(y0 + j);
+                    z.push_back(data[index]);
+                }
+            }
+        }
+        return z.size();
+    }
+
+    /*
+     * fit the model to the data. Returns the status of the solver (GSL_SUCCESS if it converged, GSL_CONTINUE if it ran
+     * out of time), or GSL_EINVAL if there are no free parameters or fewer pixels than free parameters
+     */
+    int solve() {
+        const double startMs = emscripten_get_now();
+        const size_t n = z.size();
+        const size_t P = inputs.size();
+        summary = FittingSummary();
+        summary.status = GSL_EINVAL;
+        summary.numFreeParameters = p;
+        summary.numData = n;
+        parameters = inputs;
+        errors.assign(P, NAN);
+
+        if (p > 0 && n >= p) {
+            values.resize(P);
+            struct imageFitData fit_data;
+            fit_data.x = x.data();
+            fit_data.y = y.data();
+            fit_data.z = z.data();
+            fit_data.n = n;
+            fit_data.component = componentN;
+            fit_data.inputs = inputs.data();
+            fit_data.parameterIndexes = parameterIndexes.data();
+            fit_data.values = values.data();
+
+            /* define function to be minimized */
+            gsl_multifit_nlinear_fdf fdf;
+            fdf.f = image_f;
+            fdf.df = image_df;
+            fdf.fvv = NULL;
+            fdf.n = n;
+            fdf.p = p;
+            fdf.params = &fit_data;
+
+            reserveWorkspace(n, p, false);
+            gsl_vector *f = gsl_multifit_nlinear_residual(work);
+            double chisq0, chisq, rcond;
+
+            for (size_t k = 0; k < P; ++k) {
+                if (parameterIndexes[k] >= 0) {
+                    gsl_vector_set(start, parameterIndexes[k], inputs[k]);
+                }
+            }
+
+            /* initialize solver, and iterate until convergence */
+            gsl_multifit_nlinear_init(start, &fdf, work);
+            gsl_blas_ddot(f, f, &chisq0);
+            beginIterations(startMs);
+            const int status = iterate(maxIterations);
+
+            /* covariance of best fit parameters, final cost and cond(J(x)). Errors are scaled by the residual variance, as for profile fits */
+            gsl_multifit_nlinear_covar(gsl_multifit_nlinear_jac(work), 0.0, covar);
+            gsl_blas_ddot(f, f, &chisq);
+            gsl_multifit_nlinear_rcond(&rcond, work);
+            const double residualVariance = n > p ? chisq / (n - p) : NAN;
+            const gsl_vector *solutionVector = gsl_multifit_nlinear_position(work);
+            for (size_t k = 0; k < P; ++k) {
+                const int index = parameterIndexes[k];
+                if (index >= 0) {
+                    parameters[k] = gsl_vector_get(solutionVector, index);
+                    errors[k] = sqrt(residualVariance * gsl_matrix_get(covar, index, index));
+                }
+            }
+
+            /* report positive FWHMs with the major axis first (unless either is locked), and the position angle in [0, 180) */
+            for (size_t j = 0; j < componentN; ++j) {
+                double *component = parameters.data() + IMAGE_COMPONENT_PARAMETERS * j;
+                double *componentErrors = errors.data() + IMAGE_COMPONENT_PARAMETERS * j;
+                const int *indexes = parameterIndexes.data() + IMAGE_COMPONENT_PARAMETERS * j;
+                component[3] = fabs(component[3]);
+                component[4] = fabs(component[4]);
+                if (component[3] < component[4] && indexes[3] >= 0 && indexes[4] >= 0 && indexes[5] >= 0) {
+                    std::swap(component[3], component[4]);
+                    std::swap(componentErrors[3], componentErrors[4]);
+                    component[5] += 90.0;
+                }
+                component[5] = fmod(component[5], 180.0);
+                component[5] += component[5] < 0 ? 180.0 : 0.0;
+            }
+
+            summary.status = status;
+            summary.stopReason = stopReason;
+            summary.iterations = gsl_multifit_nlinear_niter(work);
+            summary.functionEvaluations = fdf.nevalf;
+            summary.jacobianEvaluations = fdf.nevaldf;
+            summary.initialCost = chisq0;
+            summary.finalCost = chisq;
+            summary.condition = 1.0 / rcond;
+            summary.residualVariance = residualVariance;
+        }
+        summary.elapsedTime = emscripten_get_now() - startMs;
+        return summary.status;
+    }
+};
+
+ImageFittingContext* EMSCRIPTEN_KEEPALIVE imageFittingContextCreate() {
+    return new ImageFittingContext();
+}
+
+void EMSCRIPTEN_KEEPALIVE imageFittingContextFree(ImageFittingContext* context) {
+    delete context;
+}
+
+/*
+ * Fits componentN 2D Gaussians and a background offset to a width x height block of float pixels of an image,
+ * starting at pixel (x0, y0), in raster order. NaN pixels, and pixels where the mask is 0 if it is not NULL, are left
+ * out. inputs holds the P = 6 * componentN + 1 initial values, (centerX, centerY, amp, fwhmX, fwhmY, pa) for each
+ * component followed by the offset, with lockedInputs flagging the locked ones with 1. Returns the status of the fit
+ */
+int EMSCRIPTEN_KEEPALIVE imageFittingContextFit(
+    ImageFittingContext* context, const float* data, const int width, const int height, const double x0, const double y0, const unsigned char* mask,
+    const double* inputs, const int* lockedInputs, const int componentN) {
+    context->setModel(componentN, inputs, lockedInputs);
+    context->setData(data, width, height, x0, y0, mask);
+    return context->solve();
+}
+
+void EMSCRIPTEN_KEEPALIVE imageFittingContextSetLimits(ImageFittingContext* context, const int maxIterations, const double timeLimit) {
+    context->maxIterations = maxIterations > 0 ? maxIterations : 200;
+    context->timeLimit = timeLimit > 0 ? timeLimit : 0;
+}
+
+const double* EMSCRIPTEN_KEEPALIVE imageFittingContextSummary(ImageFittingContext* context) {
+    return &context->summary.status;
+}
+
+const double* EMSCRIPTEN_KEEPALIVE imageFittingContextParameters(ImageFittingContext* context) {
+    return context->parameters.data();
+}
+
+const double* EMSCRIPTEN_KEEPALIVE imageFittingContextErrors(ImageFittingContext* context) {
+    return context->errors.data();
+}
+
+}
@@ -1,14 +1,45 @@
 declare var Module: any;
 declare var addOnPostRun: any;
+declare var ENVIRONMENT_IS_WORKER: boolean;
 
 Module.linearRegression = Module.cwrap("linearRegression", "number", ["number", "number", "number", "number", "number", "number", "number", "number", "number"]);
-Module.filterBoxcar = Module.cwrap("filterBoxcar", "number", ["number", "number", "number", "number"]);
+Module.filterBoxcar = Module.cwrap("filterBoxcar", "number", ["number", "number", "number", "number", "number"]);
 Module.filterGaussian = Module.cwrap("filterGaussian", "number", ["number", "number", "number", "number", "number"]);
 Module.filterHanning = Module.cwrap("filterHanning", "number", ["number", "number", "number", "number"]);
 Module.filterDecimation = Module.cwrap("filterDecimation", "number", ["number", "number", "number", "number", "number"]);
+Module.filterM4 = Module.cwrap("filterM4", "number", ["number", "number", "number", "number", "number", "number", "number"]);
 Module.filterBinning = Module.cwrap("filterBinning", "number", ["number", "number", "number", "number"]);
 Module.filterSavitzkyGolay = Module.cwrap("filterSavitzkyGolay", "number", ["number", "number", "number", "number", "number", "number"]);
-Module.fittingGaussian = Module.cwrap("fitting", "string", ["number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "number"]);
+Module.filterBatch = Module.cwrap("filterBatch", "number", ["number", "number", "number", "number", "number", "number", "number", "number", "number", "number"]);
+Module.smoothingContextCreate = Module.cwrap("smoothingContextCreate", "number", []);
+Module.smoothingContextFree = Module.cwrap("smoothingContextFree", null, ["number"]);
+Module.smootherCreate = Module.cwrap("smootherCreate", "number", ["number", "number", "number"]);
+Module.smootherUpdate = Module.cwrap("smootherUpdate", "number", ["number", "number", "number", "number"]);
+Module.smootherFree = Module.cwrap("smootherFree", null, ["number"]);
+Module.fittingBatch = Module.cwrap("fittingBatch", "number", ["number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "number", "number"]);
+Module.fittingContextCreate = Module.cwrap("fittingContextCreate", "number", []);
+Module.fittingContextFree = Module.cwrap("fittingContextFree", null, ["number"]);
+Module.fittingContextFit = Module.cwrap("fittingContextFit", "number", ["number", "number", "number", "number", "number", "number", "number", "number", "number", "number"]);
+Module.fittingContextBegin = Module.cwrap("fittingContextBegin", "number", ["number", "number", "number", "number", "number", "number", "number", "number", "number", "number"]);
+Module.fittingContextIterate = Module.cwrap("fittingContextIterate", "number", ["number", "number"]);
+Module.fittingContextSetLimits = Module.cwrap("fittingContextSetLimits", null, ["number", "number", "number"]);
+Module.fittingContextCancel = Module.cwrap("fittingContextCancel", null, ["number"]);
+Module.fittingContextSummary = Module.cwrap("fittingContextSummary", "number", ["number"]);
+Module.fittingContextParameters = Module.cwrap("fittingContextParameters", "number", ["number"]);
+Module.fittingContextErrors = Module.cwrap("fittingContextErrors", "number", ["number"]);
+Module.fittingContextCovariance = Module.cwrap("fittingContextCovariance", "number", ["number"]);
+Module.fittingContextIntegrals = Module.cwrap("fittingContextIntegrals", "number", ["number"]);
+Module.fittingContextResidual = Module.cwrap("fittingContextResidual", "number", ["number"]);
+Module.fittingContextLog = Module.cwrap("fittingContextLog", "string", ["number"]);
+Module.imageFittingContextCreate = Module.cwrap("imageFittingContextCreate", "number", []);
+Module.imageFittingContextFit = Module.cwrap("imageFittingContextFit", "number", ["number", "number", "number", "number", "number", "number", "number", "number", "number", "number"]);
+Module.imageFittingContextSetLimits = Module.cwrap("imageFittingContextSetLimits", null, ["number", "number", "number"]);
+Module.imageFittingContextSummary = Module.cwrap("imageFittingContextSummary", "number", ["number"]);
+Module.imageFittingContextParameters = Module.cwrap("imageFittingContextParameters", "number", ["number"]);
+Module.imageFittingContextErrors = Module.cwrap("imageFittingContextErrors", "number", ["number"]);
+Module.featureDetectorCreate = Module.cwrap("featureDetectorCreate", "number", []);
+Module.featureDetectorFree = Module.cwrap("featureDetectorFree", null, ["number"]);
+Module.autoDetectComponents = Module.cwrap("autoDetectComponents", "number", ["number", "number", "number", "number", "number", "number", "number", "number"]);
 
 Module.getFittingParameters = function (x: Float64Array, y: Float64Array) {
     const N = x.length;
@@ -49,23 +80,117 @@ Module.getFittingParameters = function (x: Float64Array, y: Float64Array) {
     return {intercept: c0, slope: c1, cov00: cov00, cov01: cov01, cov11: cov11, rss:sumsq};
 }
 
-Module.boxcarSmooth = function (yIn: Float64Array | Float32Array, kernelSize: number) {
-    // Return empty array if arguments are invalid
-    if (!yIn) {
-        return new Float64Array(1);
+// Must match SmoothingFilter in gsl_wrapper.cc
+Module.SmoothingFilter = {BOXCAR: 0, GAUSSIAN: 1, HANNING: 2, SAVITZKY_GOLAY: 3};
+
+// Scratch buffers in the module heap, kept between calls and only reallocated when a larger buffer is required
+Module.scratchBuffers = {};
+
+function scratchBuffer(name: string, numBytes: number): number {
+    let buffer = Module.scratchBuffers[name];
+    if (!buffer || buffer.numBytes < numBytes) {
+        if (buffer) {
+            Module._free(buffer.ptr);
+        }
+        buffer = {ptr: Module._malloc(numBytes), numBytes};
+        Module.scratchBuffers[name] = buffer;
+    }
+    return buffer.ptr;
+}
+
+// Creates a smoothing context, which keeps the kernel weights of the last filter between calls of smoothBatch with the same filter.
+// The context must be released with freeSmoothingContext
+Module.createSmoothingContext = function () {
+    return {ptr: Module.smoothingContextCreate()};
+};
+
+Module.freeSmoothingContext = function (context: {ptr: number}) {
+    if (context && context.ptr) {
+        Module.smoothingContextFree(context.ptr);
+        context.ptr = 0;
+    }
+};
+
+// Smooths M profiles of the same length N in a single call, returning a Float64Array for each profile. Float32 profiles are smoothed
+// without converting them to double first. The parameter is the NaN mode for boxcar smoothing (1 to skip NaN values), alpha for
+// Gaussian smoothing and the order for Savitzky-Golay smoothing, which also requires the x values. Uses the given smoothing context,
+// or one that only lasts for this call
+Module.smoothBatch = function (
+    filter: number,
+    profiles: (Float64Array | Float32Array)[],
+    kernelSize: number,
+    param: number = 0,
+    xIn?: Float64Array | Float32Array | number[],
+    context?: {ptr: number}
+) {
+    if (!profiles || !profiles.length) {
+        return [];
+    }
+
+    const N = profiles[0].length;
+    const M = profiles.length;
+    const isFloat32 = profiles.every(profile => profile instanceof Float32Array);
+    const yIn = scratchBuffer("yIn", N * M * (isFloat32 ? 4 : 8));
+    const yOut = scratchBuffer("yOut", N * M * 8);
+    for (let m = 0; m < M; m++) {
+        if (isFloat32) {
+            Module.HEAPF32.set(profiles[m], yIn / 4 + m * N);
+        } else {
+            Module.HEAPF64.set(profiles[m], yIn / 8 + m * N);
+        }
+    }
+    let x = 0;
+    if (xIn) {
+        x = scratchBuffer("xIn", Math.max(N, xIn.length) * 8);
+        Module.HEAPF64.set(xIn, x / 8);
+    }
+
+    Module.filterBatch(context && context.ptr ? context.ptr : 0, filter, yIn, isFloat32 ? 1 : 0, N, M, yOut, kernelSize, param, x);
+    const output = new Float64Array(Module.HEAPF64.buffer, yOut, N * M).slice();
+    return profiles.map((profile, m) => output.subarray(m * N, (m + 1) * N));
+};
+
+// Creates a smoother for a profile that is updated progressively, with the same parameters as smoothBatch. Each call to
+// streamingSmooth with the full profile only recomputes the output around the values that changed since the previous call.
+// The smoother must be released with freeStreamingSmoother
+Module.createStreamingSmoother = function (filter: number, kernelSize: number, param: number = 0) {
+    return {ptr: Module.smootherCreate(filter, kernelSize, param), filter, kernelSize, param};
+};
+
+Module.streamingSmooth = function (smoother: {ptr: number}, yIn: Float64Array | Float32Array, xIn?: Float64Array | Float32Array | number[]) {
+    if (!smoother || !smoother.ptr || !yIn) {
+        return new Float64Array(0);
     }
 
     const N = yIn.length;
-    Module.yIn = Module._malloc(N * 8);
-    Module.yOut = Module._malloc(N * 8);
+    const y = scratchBuffer("yIn", N * 8);
+    Module.HEAPF64.set(yIn, y / 8);
+    let x = 0;
+    if (xIn) {
+        x = scratchBuffer("xIn", Math.max(N, xIn.length) * 8);
+        Module.HEAPF64.set(xIn, x / 8);
+    }
+    const yOut = Module.smootherUpdate(smoother.ptr, y, N, x);
+    if (!yOut) {
+        return new Float64Array(0);
+    }
+    return new Float64Array(Module.HEAPF64.buffer, yOut, N).slice();
+};
 
-    Module.HEAPF64.set(new Float64Array(yIn), Module.yIn / 8);
-    Module.filterBoxcar(Module.yIn, N, Module.yOut, kernelSize);
-    const yOut = new Float64Array(Module.HEAPF64.buffer, Module.yOut, N).slice();
+Module.freeStreamingSmoother = function (smoother: {ptr: number}) {
+    if (smoother && smoother.ptr) {
+        Module.smootherFree(smoother.ptr);
+        smoother.ptr = 0;
+    }
+};
 
-    Module._free(Module.yIn);
-    Module._free(Module.yOut);
-    return yOut;
+// By default, windows containing NaN values give NaN. If skipNaN is set, NaN values are ignored instead
+Module.boxcarSmooth = function (yIn: Float64Array | Float32Array, kernelSize: number, skipNaN: boolean = false) {
+    // Return empty array if arguments are invalid
+    if (!yIn) {
+        return new Float64Array(1);
+    }
+    return Module.smoothBatch(Module.SmoothingFilter.BOXCAR, [yIn], kernelSize, skipNaN ? 1 : 0)[0];
 };
 
 Module.gaussianSmooth = function (yIn: Float64Array | Float32Array, kernelSize: number, alpha: number) {
@@ -73,36 +198,14 @@ Module.gaussianSmooth = function (yIn: Float64Array | Float32Array, kernelSize:
     if (!yIn) {
         return new Float64Array(1);
     }
-
-    const N = yIn.length;
-    Module.yIn = Module._malloc(N * 8);
-    Module.yOut = Module._malloc(N * 8);
-
-    Module.HEAPF64.set(new Float64Array(yIn), Module.yIn / 8);
-    Module.filterGaussian(Module.yIn, N, Module.yOut, kernelSize, alpha);
-    const yOut = new Float64Array(Module.HEAPF64.buffer, Module.yOut, N).slice();
-
-    Module._free(Module.yIn);
-    Module._free(Module.yOut);
-    return yOut;
+    return Module.smoothBatch(Module.SmoothingFilter.GAUSSIAN, [yIn], kernelSize, alpha)[0];
 };
 
 Module.hanningSmooth = function (yIn: Float64Array | Float32Array, kernelSize: number) {
     if (!yIn) {
         return new Float64Array(1);
     }
-
-    const N = yIn.length;
-    Module.yIn = Module._malloc(N * 8);
-    Module.yOut = Module._malloc(N * 8);
-
-    Module.HEAPF64.set(new Float64Array(yIn), Module.yIn / 8);
-    Module.filterHanning(Module.yIn, N, Module.yOut, kernelSize);
-    const yOut = new Float64Array(Module.HEAPF64.buffer, Module.yOut, N).slice();
-
-    Module._free(Module.yIn);
-    Module._free(Module.yOut);
-    return yOut;
+    return Module.smoothBatch(Module.SmoothingFilter.HANNING, [yIn], kernelSize)[0];
 };
 
 Module.decimation = function (xIn: Float64Array | Float32Array, yIn: Float64Array | Float32Array, decimationWidth: number) {
@@ -130,6 +233,35 @@ Module.decimation = function (xIn: Float64Array | Float32Array, yIn: Float64Arra
     return {x: xOut, y: yOut};
 };
 
+// Copies the points at the decimated indices into new arrays
+function decimatedPoints(xIn: Float64Array | Float32Array | number[], yIn: Float64Array | Float32Array | number[], indexOut: number, count: number) {
+    const indices = new Int32Array(Module.HEAP32.buffer, indexOut, count);
+    const xOut = new Float64Array(count);
+    const yOut = new Float64Array(count);
+    for (let i = 0; i < count; i++) {
+        xOut[i] = xIn[indices[i]];
+        yOut[i] = yIn[indices[i]];
+    }
+    return {x: xOut, y: yOut};
+}
+
+// M4 decimation for a plot numPixels wide covering xMin to xMax. Keeps the first, min, max and last point of each pixel column,
+// which draws the same line as the full resolution data. The points are returned in their original order
+Module.m4Decimation = function (xIn: Float64Array | Float32Array | number[], yIn: Float64Array | Float32Array | number[], numPixels: number, xMin: number, xMax: number) {
+    if (!xIn || !yIn) {
+        return {x: new Float64Array(0), y: new Float64Array(0)};
+    }
+
+    const N = Math.min(xIn.length, yIn.length);
+    const x = scratchBuffer("xIn", N * 8);
+    const y = scratchBuffer("yIn", N * 8);
+    const indexOut = scratchBuffer("indexOut", N * 4);
+    Module.HEAPF64.set(N === xIn.length ? xIn : xIn.slice(0, N), x / 8);
+    Module.HEAPF64.set(N === yIn.length ? yIn : yIn.slice(0, N), y / 8);
+    const count = Module.filterM4(x, y, N, xMin, xMax, Math.round(numPixels), indexOut);
+    return decimatedPoints(xIn, yIn, indexOut, count);
+};
+
 Module.binning = function (input: Float64Array | Float32Array, binWidth: number) {
     if (!input) {
         return new Float64Array(1);
@@ -153,101 +285,334 @@ Module.savitzkyGolaySmooth = function (xIn: Float64Array | Float32Array, yIn: Fl
     if (!xIn || !yIn || order >= kernelSize) {
         return new Float64Array(1);
     }
+    return Module.smoothBatch(Module.SmoothingFilter.SAVITZKY_GOLAY, [yIn], kernelSize, order, xIn)[0];
+};
 
-    const N = xIn.length;
-    Module.xIn = Module._malloc(N * 8);
-    Module.yIn = Module._malloc(N * 8);
-    Module.yOut = Module._malloc(N * 8);
+// Must match FittingStopReason in gsl_wrapper.cc
+Module.FittingStopReason = {NONE: 0, SMALL_STEP: 1, SMALL_GRADIENT: 2, CANCELLED: 3, TIME_LIMIT: 4};
 
-    Module.HEAPF64.set(new Float64Array(xIn), Module.xIn / 8);
-    Module.HEAPF64.set(new Float64Array(yIn), Module.yIn / 8);
-    Module.filterSavitzkyGolay(Module.xIn, Module.yIn, N, Module.yOut, kernelSize, order);
-    const yOut = new Float64Array(Module.HEAPF64.buffer, Module.yOut, N).slice();
+// Fields of FittingSummary in gsl_wrapper.cc, in order
+const FittingSummaryFields = ["status", "stopReason", "iterations", "functionEvaluations", "jacobianEvaluations", "initialCost", "chiSquared", "condition", "residualVariance", "numFreeParameters", "numData", "elapsedTime", "warmStarted"];
 
-    Module._free(Module.xIn);
-    Module._free(Module.yIn);
-    Module._free(Module.yOut);
-    return yOut;
+// Fitting context used by Module.fitting when no session is given, created on the first fit
+Module.fittingContext = 0;
+
+// Creates a fitting session for repeated fits, e.g. while initial guesses are adjusted or regions are stepped through. The session keeps the solver
+// workspace between fits with the same number of samples and free parameters, and can warm-start each fit from its previous solution. Fits stop
+// after maxIterations, or once they have taken timeLimit ms if it is positive. The session must be released with freeFittingSession
+Module.createFittingSession = function (maxIterations: number = 200, timeLimit: number = 0) {
+    const ptr = Module.fittingContextCreate();
+    Module.fittingContextSetLimits(ptr, maxIterations, timeLimit);
+    return {ptr};
+};
+
+Module.freeFittingSession = function (session: {ptr: number}) {
+    if (session && session.ptr) {
+        Module.fittingContextFree(session.ptr);
+        session.ptr = 0;
+    }
 };
 
+// Stops the fit started in the session with startFitting. The next call to continueFitting finishes it with the CANCELLED stop reason. Fits run
+// with Module.fitting block the thread until they finish (the module is built without pthreads), so they are bounded with the time limit instead
+Module.cancelFitting = function (session: {ptr: number}) {
+    if (session && session.ptr) {
+        Module.fittingContextCancel(session.ptr);
+    }
+};
+
+// Copies the profile, the initial guesses and the locked flags of a fit into the module heap, as the arguments of fittingContextFit and fittingContextBegin
+function profileFitArguments(xIn: Float64Array | Float32Array, yIn: Float64Array | Float32Array, inputData: number[], lockedInputData: number[], orderInputData: number[], lockedOrderInputData: number[]) {
+    const dataN = xIn.length;
+    const componentN = inputData.length / 3;
+    const P = 3 * componentN + 2;
+    const x = scratchBuffer("profileFitX", dataN * 8);
+    const y = scratchBuffer("profileFitY", dataN * 8);
+    const inputs = scratchBuffer("profileFitInputs", P * 8);
+    const locked = scratchBuffer("profileFitLocked", P * 4);
+    Module.HEAPF64.set(xIn, x / 8);
+    Module.HEAPF64.set(yIn, y / 8);
+    Module.HEAPF64.set(inputData.concat(orderInputData), inputs / 8);
+    Module.HEAP32.set(lockedInputData.concat(lockedOrderInputData), locked / 4);
+    return {x, y, dataN, inputs, locked, componentN};
+}
+
+// Reads the results of the last fit of a context, as returned by Module.fitting
+function profileFitResult(context: number, componentN: number, dataN: number, withLog: boolean) {
+    const P = 3 * componentN + 2;
+    const summaryValues = new Float64Array(Module.HEAPF64.buffer, Module.fittingContextSummary(context), FittingSummaryFields.length).slice();
+    const parameters = new Float64Array(Module.HEAPF64.buffer, Module.fittingContextParameters(context), P).slice();
+    const errors = new Float64Array(Module.HEAPF64.buffer, Module.fittingContextErrors(context), P).slice();
+    const result: any = {
+        parameters,
+        errors,
+        covariance: new Float64Array(Module.HEAPF64.buffer, Module.fittingContextCovariance(context), P * P).slice(),
+        integral: new Float64Array(Module.HEAPF64.buffer, Module.fittingContextIntegrals(context), componentN * 2).slice(), // [integral1, integral1Error, integral2, integral2Error, ...]
+        residual: new Float64Array(Module.HEAPF64.buffer, Module.fittingContextResidual(context), dataN).slice(),
+        yIntercept: parameters[P - 2],
+        yInterceptError: errors[P - 2],
+        slope: parameters[P - 1],
+        slopeError: errors[P - 1],
+        amp: new Float64Array(componentN * 2), // [amp1, amp1Error, amp2, amp2Error, ...]
+        center: new Float64Array(componentN * 2), // [center1, center1Error, center2, center2Error, ...]
+        fwhm: new Float64Array(componentN * 2), // [fwhm1, fwhm1Error, fwhm2, fwhm2Error, ...]
+        log: withLog ? Module.fittingContextLog(context) : ""
+    };
+    for (let i = 0; i < FittingSummaryFields.length; i++) {
+        result[FittingSummaryFields[i]] = summaryValues[i];
+    }
+    for (let i = 0; i < componentN; i++) {
+        result.amp.set([parameters[3 * i], errors[3 * i]], 2 * i);
+        result.center.set([parameters[3 * i + 1], errors[3 * i + 1]], 2 * i);
+        result.fwhm.set([parameters[3 * i + 2], errors[3 * i + 2]], 2 * i);
+    }
+    return result;
+}
+
 // functionType = 0, using Gaussian. functionType = 1, using Lorentzian.
 // inputData stores initial guesses as [amp1, center1, fwhm1, amp2, center2, fwhm2, ...]
 // lockedInputdData stores which initial guesses are locked as [1(amp1), 0(center1), 0(fwhm1), 0(amp2), 1(center2), 0(fwhm2), ...]. 1 as locked, 0 as unlocked.
 // orderInputData stores initial guesses as [yIntercept, slope]
 // lockedOrderInputData stores which initial guesses are locked as [0(yIntercept), 1(slope)]. 1 as locked, 0 as unlocked..
-Module.fitting = function (functionType: number, xIn: Float64Array | Float32Array, yIn: Float64Array | Float32Array, inputData: number[], lockedInputData: number[], orderInputData: number[], lockedOrderInputData: number[]) {
+// Fits with analytic derivatives. Geodesic acceleration is used by default, which usually takes fewer iterations for multi-component fits.
+// Besides the values and errors of each parameter, the result has the summary of the fit (status, stopReason, iterations, chiSquared, ...),
+// and parameters, errors and the covariance in the layout [amp1, center1, fwhm1, amp2, ..., yIntercept, slope]. The log is only formatted if withLog is set.
+// Fits run in the given session if there is one, starting from its previous solution if warmStart is set
+Module.fitting = function (
+    functionType: number,
+    xIn: Float64Array | Float32Array,
+    yIn: Float64Array | Float32Array,
+    inputData: number[],
+    lockedInputData: number[],
+    orderInputData: number[],
+    lockedOrderInputData: number[],
+    geodesicAcceleration: boolean = true,
+    withLog: boolean = true,
+    session: {ptr: number} = null,
+    warmStart: boolean = false
+) {
     if (!xIn || !yIn || !inputData || !lockedInputData) {
         return null;
     }
+    if (!Module.fittingContext) {
+        Module.fittingContext = Module.fittingContextCreate();
+    }
+    const context = session && session.ptr ? session.ptr : Module.fittingContext;
+    const args = profileFitArguments(xIn, yIn, inputData, lockedInputData, orderInputData, lockedOrderInputData);
+    Module.fittingContextFit(context, functionType, args.x, args.y, args.dataN, args.inputs, args.locked, args.componentN, geodesicAcceleration ? 1 : 0, warmStart ? 1 : 0);
+    return profileFitResult(context, args.componentN, args.dataN, withLog);
+};
 
-    const dataN = xIn.length;
-    Module.xIn = Module._malloc(dataN * 8);
-    Module.yIn = Module._malloc(dataN * 8);
-    Module.HEAPF64.set(new Float64Array(xIn), Module.xIn / 8);
-    Module.HEAPF64.set(new Float64Array(yIn), Module.yIn / 8);
+// Starts a fit in a session with the same arguments as Module.fitting, without iterating. The fit is advanced with continueFitting, so that the
+// caller can yield between chunks of iterations and cancel the fit with cancelFitting. Returns false if the arguments are invalid
+Module.startFitting = function (
+    session: {ptr: number; componentN?: number; dataN?: number},
+    functionType: number,
+    xIn: Float64Array | Float32Array,
+    yIn: Float64Array | Float32Array,
+    inputData: number[],
+    lockedInputData: number[],
+    orderInputData: number[],
+    lockedOrderInputData: number[],
+    geodesicAcceleration: boolean = true,
+    warmStart: boolean = false
+) {
+    if (!session || !session.ptr || !xIn || !yIn || !inputData || !lockedInputData) {
+        return false;
+    }
+    const args = profileFitArguments(xIn, yIn, inputData, lockedInputData, orderInputData, lockedOrderInputData);
+    Module.fittingContextBegin(session.ptr, functionType, args.x, args.y, args.dataN, args.inputs, args.locked, args.componentN, geodesicAcceleration ? 1 : 0, warmStart ? 1 : 0);
+    session.componentN = args.componentN;
+    session.dataN = args.dataN;
+    return true;
+};
 
-    const componentN = inputData.length / 3;
+// Runs at most maxSteps iterations of the fit started in the session. Returns null while the fit is unfinished, and the result, as returned by
+// Module.fitting, once it has converged, failed, run out of time or been cancelled
+Module.continueFitting = function (session: {ptr: number; componentN?: number; dataN?: number}, maxSteps: number = 10, withLog: boolean = true) {
+    if (!session || !session.ptr) {
+        return null;
+    }
+    if (Module.fittingContextIterate(session.ptr, maxSteps)) {
+        return null;
+    }
+    return profileFitResult(session.ptr, session.componentN, session.dataN, withLog);
+};
+
+// Fits the same model to a block of M spectra sharing the x values, stored pixel by pixel in raster order with the given width.
+// initialInputs and lockedInputs are [amp1, center1, fwhm1, amp2, ..., yIntercept, slope], so that each pixel has P = 3 * componentN + 2
+// parameters and errors. integrals holds [integral1, integral1Error, integral2, ...] per pixel, and converged is the convergence mask.
+// If seedFromNeighbour is set, each pixel starts from the fitted parameters of its left or upper neighbour
+Module.fitBatch = function (functionType: number, xIn: Float64Array | Float32Array | number[], spectra: Float64Array | Float32Array, width: number, initialInputs: number[], lockedInputs: number[], seedFromNeighbour: boolean = true) {
+    if (!xIn || !spectra || !initialInputs || !lockedInputs || initialInputs.length !== lockedInputs.length) {
+        return null;
+    }
 
-    Module.orderValues = Module._malloc(2 * 8);
-    Module.lockedOrderValues = Module._malloc(2 * 4);
-    Module.HEAPF64.set(new Float64Array(orderInputData), Module.orderValues / 8);
-    Module.HEAP32.set(new Int32Array(lockedOrderInputData), Module.lockedOrderValues / 4);
+    const N = xIn.length;
+    const M = Math.floor(spectra.length / N);
+    const P = initialInputs.length;
+    const componentN = (P - 2) / 3;
+    const x = scratchBuffer("fitX", N * 8);
+    const y = scratchBuffer("fitSpectra", M * N * 8);
+    const initial = scratchBuffer("fitInitial", P * 8);
+    const locked = scratchBuffer("fitLocked", P * 4);
+    const parameters = scratchBuffer("fitParameters", M * P * 8);
+    const errors = scratchBuffer("fitErrors", M * P * 8);
+    const integrals = scratchBuffer("fitIntegrals", M * componentN * 2 * 8);
+    const converged = scratchBuffer("fitConverged", M);
+    Module.HEAPF64.set(xIn, x / 8);
+    Module.HEAPF64.set(spectra.length === M * N ? spectra : spectra.subarray(0, M * N), y / 8);
+    Module.HEAPF64.set(initialInputs, initial / 8);
+    Module.HEAP32.set(lockedInputs, locked / 4);
+
+    const numConverged = Module.fittingBatch(functionType, x, y, N, M, width, initial, locked, componentN, seedFromNeighbour ? 1 : 0, parameters, errors, integrals, converged);
+    return {
+        parameters: new Float64Array(Module.HEAPF64.buffer, parameters, M * P).slice(),
+        errors: new Float64Array(Module.HEAPF64.buffer, errors, M * P).slice(),
+        integrals: new Float64Array(Module.HEAPF64.buffer, integrals, M * componentN * 2).slice(),
+        converged: new Uint8Array(Module.HEAPU8.buffer, converged, M).slice(),
+        numConverged
+    };
+};
 
-    Module.inputData = Module._malloc(componentN * 3 * 8); // 2-dimensional array: double inputData[][3]
-    Module.HEAPF64.set(new Float64Array(inputData), Module.inputData / 8);
-    const inputArray: number[] = [];
-    for (let i = 0; i < componentN; i++) {
-        inputArray.push(Module.inputData + i * 3 * 8);
+// Creates a feature detector for repeated calls to autoDetect, e.g. over the pixels of a region, which keeps its buffers between detections.
+// The detector must be released with freeFeatureDetector
+Module.createFeatureDetector = function () {
+    return {ptr: Module.featureDetectorCreate()};
+};
+
+Module.freeFeatureDetector = function (detector: {ptr: number}) {
+    if (detector && detector.ptr) {
+        Module.featureDetectorFree(detector.ptr);
+        detector.ptr = 0;
+    }
+};
+
+// Guesses the components and baseline of a profile for fitting, from the features detected in the profile. The baseline is estimated,
+// with order -1 for none, 0 for a constant and 1 for a line, unless given. Each component has the amp, center and fwhm of a feature.
+// Uses the given detector, or one created for this call
+Module.autoDetect = function (
+    xIn: Float64Array | Float32Array | number[],
+    yIn: Float64Array | Float32Array | number[],
+    baseline: {order: number; yIntercept: number; slope: number} = null,
+    detector: {ptr: number} = null
+) {
+    if (!xIn || !yIn || xIn.length !== yIn.length) {
+        return null;
     }
-    Module.inputArray = Module._malloc(componentN * 4);
-    Module.HEAPU32.set(new Uint32Array(inputArray), Module.inputArray / 4);
+    const callDetector = detector && detector.ptr ? null : Module.createFeatureDetector();
+    const detectorPtr = callDetector ? callDetector.ptr : detector.ptr;
 
-    Module.lockedInputData = Module._malloc(componentN * 3 * 4); // 2-dimensional array: int lockedInputData [][3]
-    Module.HEAP32.set(new Int32Array(lockedInputData), Module.lockedInputData / 4);
-    const lockedInputArray: number[] = [];
+    const N = xIn.length;
+    const x = scratchBuffer("autoDetectX", N * 8);
+    const y = scratchBuffer("autoDetectY", N * 8);
+    const baselineIn = scratchBuffer("autoDetectBaselineIn", 3 * 8);
+    const baselineOut = scratchBuffer("autoDetectBaselineOut", 3 * 8);
+    Module.HEAPF64.set(xIn, x / 8);
+    Module.HEAPF64.set(yIn, y / 8);
+    if (baseline) {
+        Module.HEAPF64.set([baseline.order, baseline.yIntercept, baseline.slope], baselineIn / 8);
+    }
+
+    let maxComponents = 16;
+    let components = scratchBuffer("autoDetectComponents", maxComponents * 3 * 8);
+    let componentN = Module.autoDetectComponents(detectorPtr, x, y, N, baseline ? baselineIn : 0, components, maxComponents, baselineOut);
+    if (componentN > maxComponents) {
+        maxComponents = componentN;
+        components = scratchBuffer("autoDetectComponents", maxComponents * 3 * 8);
+        componentN = Module.autoDetectComponents(detectorPtr, x, y, N, baseline ? baselineIn : 0, components, maxComponents, baselineOut);
+    }
+    Module.freeFeatureDetector(callDetector);
+
+    const values = new Float64Array(Module.HEAPF64.buffer, components, componentN * 3);
+    const baselineValues = new Float64Array(Module.HEAPF64.buffer, baselineOut, 3);
+    const result = {components: [], order: baselineValues[0], yIntercept: baselineValues[1], slope: baselineValues[2]};
     for (let i = 0; i < componentN; i++) {
-        lockedInputArray.push(Module.lockedInputData + i * 3 * 4);
-    }
-    Module.lockedInputArray = Module._malloc(componentN * 4);
-    Module.HEAPU32.set(new Uint32Array(lockedInputArray), Module.lockedInputArray / 4);
-
-    Module.resultOrderValues = Module._malloc(4 * 8); // yIntercept, yInterceptError, slope, slopeError
-    Module.resultAmp = Module._malloc(componentN * 8 * 2); // amp with error.
-    Module.resultCenter = Module._malloc(componentN * 8 * 2); // center with error.
-    Module.resultFwhm = Module._malloc(componentN * 8 * 2); // fwhm with error.
-    Module.resultIntegral = Module._malloc(componentN * 8 * 2); // integral with error.
-    Module.resultResidual = Module._malloc(dataN * 8);
-
-    const log = Module.fittingGaussian(
-        Module.xIn, Module.yIn, dataN,
-        Module.inputArray, Module.lockedInputArray, componentN,
-        functionType, Module.orderValues, Module.lockedOrderValues,
-        Module.resultAmp, Module.resultCenter, Module.resultFwhm, Module.resultOrderValues, Module.resultIntegral, Module.resultResidual
-    );
-
-    const orderValuesOut = new Float64Array(Module.HEAPF64.buffer, Module.resultOrderValues, 4).slice(); // [yIntercept, yInterceptError, slope, slopeError]
-    const centerOut = new Float64Array(Module.HEAPF64.buffer, Module.resultCenter, componentN * 2).slice(); // [amp1, amp1Error, amp2, amp2Error, ...]
-    const ampOut = new Float64Array(Module.HEAPF64.buffer, Module.resultAmp, componentN * 2).slice(); // [center1, center1Error, center2, center2Error, ...]
-    const fwhmOut = new Float64Array(Module.HEAPF64.buffer, Module.resultFwhm, componentN * 2).slice(); // [fwhm1, fwhm1Error, fwhm2, fwhmError2, ...]
-    const integralOut = new Float64Array(Module.HEAPF64.buffer, Module.resultIntegral, componentN * 2).slice(); // [integral1, integral1Error, integral2, integral2Error, ...]
-    const residualOut = new Float64Array(Module.HEAPF64.buffer, Module.resultResidual, dataN).slice();
-    const result = {yIntercept: orderValuesOut[0], yInterceptError: orderValuesOut[1], slope: orderValuesOut[2], slopeError: orderValuesOut[3], center: centerOut, amp: ampOut, fwhm: fwhmOut, log: log, integral: integralOut, residual: residualOut};
+        result.components.push({amp: values[3 * i], center: values[3 * i + 1], fwhm: values[3 * i + 2]});
+    }
+    return result;
+};
 
-    Module._free(Module.xIn);
-    Module._free(Module.yIn);
-    Module._free(Module.orderValues);
-    Module._free(Module.lockedOrderValues);
-    Module._free(Module.inputArray);
-    Module._free(Module.inputData);
-    Module._free(Module.lockedInputArray);
-    Module._free(Module.lockedInputData);
-    Module._free(Module.resultOrderValues);
-    Module._free(Module.resultCenter);
-    Module._free(Module.resultAmp);
-    Module._free(Module.resultFwhm);
-    Module._free(Module.resultIntegral);
-    Module._free(Module.resultResidual);
+// Image fitting context used by Module.fitImage, created on the first fit
+Module.imageFittingContext = 0;
+
+// Fits 2D Gaussians and a background offset to a width x height block of image pixels in raster order, whose first pixel is at the given image
+// pixel coordinates. initialInputs and lockedInputs are [centerX1, centerY1, amp1, fwhmX1, fwhmY1, pa1, centerX2, ..., offset], in the order of
+// the image fitting requests to the backend. NaN pixels, and pixels where the mask is 0 if given, are left out. Fits stop once they have taken
+// timeLimit ms if it is positive. Returns the parameters and errors in the same layout, and the summary of the fit
+Module.fitImage = function (
+    data: Float32Array,
+    width: number,
+    height: number,
+    origin: {x: number; y: number},
+    initialInputs: number[],
+    lockedInputs: number[],
+    mask: Uint8Array = null,
+    timeLimit: number = 0
+) {
+    if (!data || !origin || !initialInputs || !lockedInputs || initialInputs.length !== lockedInputs.length || data.length < width * height || (mask && mask.length < width * height)) {
+        return null;
+    }
+    if (!Module.imageFittingContext) {
+        Module.imageFittingContext = Module.imageFittingContextCreate();
+    }
+    const context = Module.imageFittingContext;
+    Module.imageFittingContextSetLimits(context, 200, timeLimit);
+
+    const numPixels = width * height;
+    const P = initialInputs.length;
+    const componentN = (P - 1) / 6;
+    const pixels = scratchBuffer("imageFitData", numPixels * 4);
+    const maskBuffer = mask ? scratchBuffer("imageFitMask", numPixels) : 0;
+    const inputs = scratchBuffer("imageFitInputs", P * 8);
+    const locked = scratchBuffer("imageFitLocked", P * 4);
+    Module.HEAPF32.set(data.length === numPixels ? data : data.subarray(0, numPixels), pixels / 4);
+    if (mask) {
+        Module.HEAPU8.set(mask.length === numPixels ? mask : mask.subarray(0, numPixels), maskBuffer);
+    }
+    Module.HEAPF64.set(initialInputs, inputs / 8);
+    Module.HEAP32.set(lockedInputs, locked / 4);
+
+    Module.imageFittingContextFit(context, pixels, width, height, origin.x, origin.y, maskBuffer, inputs, locked, componentN);
+
+    const summaryValues = new Float64Array(Module.HEAPF64.buffer, Module.imageFittingContextSummary(context), FittingSummaryFields.length).slice();
+    const result: any = {
+        parameters: new Float64Array(Module.HEAPF64.buffer, Module.imageFittingContextParameters(context), P).slice(),
+        errors: new Float64Array(Module.HEAPF64.buffer, Module.imageFittingContextErrors(context), P).slice()
+    };
+    for (let i = 0; i < FittingSummaryFields.length; i++) {
+        result[FittingSummaryFields[i]] = summaryValues[i];
+    }
     return result;
 };
 
+// When loaded as a web worker, the module fits blocks of spectra, or image blocks, posted by the main thread
+if (typeof ENVIRONMENT_IS_WORKER !== "undefined" && ENVIRONMENT_IS_WORKER) {
+    const ctx: Worker = self as any;
+    addOnPostRun(() => {
+        ctx.postMessage(["ready"]);
+    });
+
+    ctx.onmessage = (event: MessageEvent) => {
+        if (event.data[0] === "fit batch") {
+            const args = event.data[2];
+            const spectra = args.isFloat32 ? new Float32Array(event.data[1]) : new Float64Array(event.data[1]);
+            const result = Module.fitBatch(args.functionType, args.x, spectra, args.width, args.initialInputs, args.lockedInputs, args.seedFromNeighbour);
+            if (result) {
+                ctx.postMessage(["fit batch", result, {requestId: args.requestId, blockIndex: args.blockIndex}], [result.parameters.buffer, result.errors.buffer, result.integrals.buffer, result.converged.buffer]);
+            } else {
+                ctx.postMessage(["fit batch", null, {requestId: args.requestId, blockIndex: args.blockIndex}]);
+            }
+        } else if (event.data[0] === "fit image") {
+            const args = event.data[2];
+            const result = Module.fitImage(new Float32Array(event.data[1]), args.width, args.height, args.origin, args.initialInputs, args.lockedInputs, args.mask ? new Uint8Array(args.mask) : null, args.timeLimit);
+            if (result) {
+                ctx.postMessage(["fit image", result, {requestId: args.requestId}], [result.parameters.buffer, result.errors.buffer]);
+            } else {
+                ctx.postMessage(["fit image", null, {requestId: args.requestId}]);
+            }
+        }
+    };
+}
+
 module.exports = Module;
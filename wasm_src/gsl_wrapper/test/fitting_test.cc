@@ -0,0 +1,207 @@
+/*
+ * Checks of the batch fitting of cubes used by the cube fitting service: recovery of the parameters of a synthetic
+ * Gaussian cube, and seeding from neighbouring pixels. Also checks fits of single profiles run in chunks of iterations.
+ * Built with emcc and run with node by test_gsl_wrapper.sh. Exits with a non-zero status if any check fails
+ */
+#include "../gsl_wrapper.cc"
+
+static int failures = 0;
+
+static void check(const bool condition, const char* format, ...) {
+    if (!condition) {
+        va_list args;
+        va_start(args, format);
+        printf("FAILED: ");
+        vprintf(format, args);
+        printf("\n");
+        va_end(args);
+        failures++;
+    }
+}
+
+const int COMPONENT_N = 2;
+const int P = 3 * COMPONENT_N + 2;
+
+/*
+ * Cube of width x height pixels of N channels, with two Gaussians on a sloped baseline and a little noise. The
+ * component centers drift towards each other by centerDrift per pixel in x. The true parameters are laid out as the
+ * fitting outputs
+ */
+struct TestCube {
+    int width, height, N;
+    std::vector<double> x, spectra, truth;
+
+    TestCube(const int width, const int height, const int N, const double centerDrift) : width(width), height(height), N(N) {
+        const int M = width * height;
+        x.resize(N);
+        spectra.resize((size_t)M * N);
+        truth.resize((size_t)M * P);
+        for (int i = 0; i < N; i++) {
+            x[i] = -50 + i * 100.0 / N;
+        }
+        srand(3);
+        for (int m = 0; m < M; m++) {
+            const int px = m % width;
+            const int py = m / width;
+            const double t[P] = {4 + 0.05 * py, -15 + centerDrift * px, 6 + 0.1 * py, 2.5, 15 - centerDrift * px, 8, 0.3, 0.002};
+            std::copy(t, t + P, truth.begin() + (size_t)m * P);
+            for (int i = 0; i < N; i++) {
+                double value = t[6] + t[7] * x[i];
+                for (int c = 0; c < COMPONENT_N; c++) {
+                    const double dx = x[i] - t[3 * c + 1];
+                    value += t[3 * c] * exp(-4 * log(2.0) * dx * dx / (t[3 * c + 2] * t[3 * c + 2]));
+                }
+                spectra[(size_t)m * N + i] = value + ((double)rand() / RAND_MAX - 0.5) * 0.2;
+            }
+        }
+    }
+
+    int M() const {
+        return width * height;
+    }
+};
+
+struct BatchResult {
+    std::vector<double> parameters, errors, integrals;
+    std::vector<unsigned char> converged;
+    int numConverged;
+};
+
+static BatchResult fitCube(const TestCube& cube, const double* initialInputs, const bool seedFromNeighbour) {
+    const int lockedInputs[P] = {0};
+    BatchResult result;
+    result.parameters.resize((size_t)cube.M() * P);
+    result.errors.resize((size_t)cube.M() * P);
+    result.integrals.resize((size_t)cube.M() * 2 * COMPONENT_N);
+    result.converged.resize(cube.M());
+    result.numConverged = fittingBatch(FITTING_GAUSSIAN, cube.x.data(), cube.spectra.data(), cube.N, cube.M(), cube.width, initialInputs, lockedInputs,
+                                       COMPONENT_N, seedFromNeighbour, result.parameters.data(), result.errors.data(), result.integrals.data(),
+                                       result.converged.data());
+    return result;
+}
+
+/* Number of converged pixels whose amp, center or fwhm are further than tolerance from the truth */
+static int countWrongPixels(const TestCube& cube, const BatchResult& result, const double tolerance) {
+    int wrong = 0;
+    for (int m = 0; m < cube.M(); m++) {
+        if (!result.converged[m]) {
+            continue;
+        }
+        for (int k = 0; k < 3 * COMPONENT_N; k++) {
+            /* the sign of the fwhm is not constrained */
+            const double value = k % 3 == 2 ? fabs(result.parameters[(size_t)m * P + k]) : result.parameters[(size_t)m * P + k];
+            if (fabs(value - cube.truth[(size_t)m * P + k]) > tolerance) {
+                wrong++;
+                break;
+            }
+        }
+    }
+    return wrong;
+}
+
+/* With initial inputs close to the truth, every pixel converges to the true parameters, with or without seeding */
+static void testParameterRecovery() {
+    const TestCube cube(12, 8, 256, 0.1);
+    const double initialInputs[P] = {3, -14, 5, 2, 14, 6, 0, 0};
+    for (const bool seed : {false, true}) {
+        const BatchResult result = fitCube(cube, initialInputs, seed);
+        check(result.numConverged == cube.M(), "recovery seed=%d: %d of %d pixels converged", seed, result.numConverged, cube.M());
+        const int wrong = countWrongPixels(cube, result, 0.2);
+        check(wrong == 0, "recovery seed=%d: %d pixels differ from the truth", seed, wrong);
+
+        /* the integral of a Gaussian is amp * fwhm * sqrt(pi / (4 ln 2)) */
+        const int m = cube.M() - 1;
+        const double integral = cube.truth[(size_t)m * P] * cube.truth[(size_t)m * P + 2] * sqrt(M_PI / (4 * log(2.0)));
+        check(fabs(result.integrals[(size_t)m * 2 * COMPONENT_N] - integral) < 0.02 * integral, "recovery seed=%d: integral %g, expected %g", seed,
+              result.integrals[(size_t)m * 2 * COMPONENT_N], integral);
+    }
+}
+
+/*
+ * The component centers drift by almost 10 across each row, so initial inputs that suit the first column are far from
+ * the truth in the last. Seeding from the neighbours follows the drift and recovers every pixel, and does no worse than
+ * starting each fit from the initial inputs
+ */
+static void testNeighbourSeeding() {
+    const TestCube cube(25, 4, 256, 0.4);
+    const double initialInputs[P] = {3, -14, 5, 2, 14, 6, 0, 0};
+    const BatchResult seeded = fitCube(cube, initialInputs, true);
+    const BatchResult unseeded = fitCube(cube, initialInputs, false);
+    const int seededWrong = countWrongPixels(cube, seeded, 0.2);
+    const int unseededWrong = countWrongPixels(cube, unseeded, 0.2);
+    check(seeded.numConverged == cube.M() && seededWrong == 0, "seeding: %d of %d pixels converged, %d differ from the truth", seeded.numConverged, cube.M(),
+          seededWrong);
+    check(seeded.numConverged - seededWrong >= unseeded.numConverged - unseededWrong, "seeding: %d correct pixels, %d without seeding",
+          seeded.numConverged - seededWrong, unseeded.numConverged - unseededWrong);
+    printf("Drifting cube: %d of %d pixels correct with seeding, %d without\n", seeded.numConverged - seededWrong, cube.M(),
+           unseeded.numConverged - unseededWrong);
+}
+
+/* Pixels without enough finite channels are not fitted and are flagged, and their neighbours start from the initial inputs instead */
+static void testFailedNeighbours() {
+    TestCube cube(6, 3, 256, 0.1);
+    const int emptyPixel = 7;
+    std::fill(cube.spectra.begin() + (size_t)emptyPixel * cube.N, cube.spectra.begin() + (size_t)(emptyPixel + 1) * cube.N, NAN);
+    /* a few NaN channels are left out of the fit */
+    for (int i = 100; i < 110; i++) {
+        cube.spectra[(size_t)2 * cube.N + i] = NAN;
+    }
+    const double initialInputs[P] = {3, -14, 5, 2, 14, 6, 0, 0};
+    const BatchResult result = fitCube(cube, initialInputs, true);
+    check(!result.converged[emptyPixel], "failed neighbours: empty pixel flagged as converged");
+    check(isnan(result.parameters[(size_t)emptyPixel * P]), "failed neighbours: empty pixel has parameters");
+    check(result.numConverged == cube.M() - 1, "failed neighbours: %d of %d pixels converged", result.numConverged, cube.M() - 1);
+    check(countWrongPixels(cube, result, 0.2) == 0, "failed neighbours: converged pixels differ from the truth");
+}
+
+/* A fit run in chunks of iterations gives the same result as a fit run in one go, and can be cancelled between chunks */
+static void testChunkedFit() {
+    const TestCube cube(1, 1, 256, 0);
+    const double initialInputs[P] = {3, -14, 5, 2, 14, 6, 0, 0};
+    const int lockedInputs[P] = {0};
+    FittingContext* context = fittingContextCreate();
+
+    const int status = fittingContextFit(context, FITTING_GAUSSIAN, cube.x.data(), cube.spectra.data(), cube.N, initialInputs, lockedInputs, COMPONENT_N, 1, 0);
+    const std::vector<double> expected = context->parameters;
+    const double iterations = context->summary.iterations;
+    check(status == GSL_SUCCESS, "chunked: fit in one go did not converge");
+
+    check(fittingContextBegin(context, FITTING_GAUSSIAN, cube.x.data(), cube.spectra.data(), cube.N, initialInputs, lockedInputs, COMPONENT_N, 1, 0) == GSL_CONTINUE,
+          "chunked: fit did not start");
+    int chunks = 0;
+    while (fittingContextIterate(context, 1)) {
+        chunks++;
+    }
+    check(context->summary.status == GSL_SUCCESS && context->summary.iterations == iterations, "chunked: status %g after %g iterations, expected %g iterations",
+          context->summary.status, context->summary.iterations, iterations);
+    check(chunks + 1 >= iterations, "chunked: %d chunks of one iteration for %g iterations", chunks, iterations);
+    check(context->parameters == expected, "chunked: parameters differ from the fit in one go");
+
+    fittingContextBegin(context, FITTING_GAUSSIAN, cube.x.data(), cube.spectra.data(), cube.N, initialInputs, lockedInputs, COMPONENT_N, 1, 0);
+    check(fittingContextIterate(context, 1) == 1, "cancelled: fit finished after one iteration");
+    fittingContextCancel(context);
+    check(fittingContextIterate(context, 1) == 0, "cancelled: fit still running");
+    check(context->summary.status == GSL_CONTINUE && context->summary.stopReason == FITTING_STOP_CANCELLED && context->summary.iterations == 1,
+          "cancelled: status %g, stop reason %g after %g iterations", context->summary.status, context->summary.stopReason, context->summary.iterations);
+
+    /* the session fits normally after a cancelled fit, and a warm start from the converged solution takes fewer iterations */
+    fittingContextFit(context, FITTING_GAUSSIAN, cube.x.data(), cube.spectra.data(), cube.N, initialInputs, lockedInputs, COMPONENT_N, 1, 0);
+    check(context->summary.status == GSL_SUCCESS && context->parameters == expected, "cancelled: next fit differs");
+    fittingContextFit(context, FITTING_GAUSSIAN, cube.x.data(), cube.spectra.data(), cube.N, initialInputs, lockedInputs, COMPONENT_N, 1, 1);
+    check(context->summary.warmStarted == 1 && context->summary.iterations < iterations, "warm start: %g iterations, %g from the initial inputs",
+          context->summary.iterations, iterations);
+    fittingContextFree(context);
+}
+
+int main() {
+    testParameterRecovery();
+    testNeighbourSeeding();
+    testFailedNeighbours();
+    testChunkedFit();
+    if (failures) {
+        printf("%d fitting checks failed\n", failures);
+        return 1;
+    }
+    printf("All fitting checks passed\n");
+    return 0;
+}
@@ -0,0 +1,286 @@
+/*
+ * Checks of the smoothing filters against GSL's own filters, and timings of boxcar smoothing against the previous
+ * implementation. Built with emcc and run with node by test_gsl_wrapper.sh. Exits with a non-zero status if any check fails
+ */
+#include "../gsl_wrapper.cc"
+#include <chrono>
+
+static int failures = 0;
+
+static void check(const bool condition, const char* format, ...) {
+    if (!condition) {
+        va_list args;
+        va_start(args, format);
+        printf("FAILED: ");
+        vprintf(format, args);
+        printf("\n");
+        va_end(args);
+        failures++;
+    }
+}
+
+/* Test profile: a slow continuum with narrow features and noise, offset from zero so that rounding errors scale with it */
+static std::vector<double> testProfile(const size_t N) {
+    std::vector<double> y(N);
+    srand(1);
+    for (size_t i = 0; i < N; i++) {
+        y[i] = 1e3 + 100 * sin(i * 0.01) + 20 * exp(-0.5 * pow((i % 5000 - 2500.0) / 30, 2)) + (double)rand() / RAND_MAX;
+    }
+    return y;
+}
+
+/* Previous implementation of filterGaussian, calling gsl_filter_gaussian directly */
+static void referenceGaussian(double* yInArray, const int N, double* yOutArray, const int kernel, const double alpha) {
+    gsl_vector_view yIn = gsl_vector_view_array(yInArray, N);
+    gsl_vector_view yOut = gsl_vector_view_array(yOutArray, N);
+    gsl_filter_gaussian_workspace* w = gsl_filter_gaussian_alloc(kernel);
+    gsl_filter_gaussian(GSL_FILTER_END_PADZERO, alpha, 0, &yIn.vector, &yOut.vector, w);
+    for (size_t i = 0; i < (kernel - 1) / 2; i++) {
+        yOutArray[i] = NAN;
+        yOutArray[N - 1 - i] = NAN;
+    }
+    gsl_filter_gaussian_free(w);
+}
+
+/*
+ * Kernels just below the FFT threshold use the direct convolution, kernels from the threshold up use the FFT. Both must
+ * match gsl_filter_gaussian to within 1e-10 of max |y|, with NaNs in the same places
+ */
+static void testGaussianAgainstGsl() {
+    const double tolerance = 1e-10;
+    const int kernels[] = {(int)FFT_KERNEL_THRESHOLD - 1, (int)FFT_KERNEL_THRESHOLD + 1, 1001, 4001};
+    for (const size_t N : {3000, 100000}) {
+        std::vector<double> y = testProfile(N);
+        double maxY = 0;
+        for (const double val : y) {
+            maxY = std::max(maxY, fabs(val));
+        }
+        for (const int kernel : kernels) {
+            for (const double alpha : {1.0, 2.0, 4.0}) {
+                std::vector<double> expected(N), actual(N);
+                referenceGaussian(y.data(), N, expected.data(), kernel, alpha);
+                filterGaussian(y.data(), N, actual.data(), kernel, alpha);
+                double worst = 0;
+                bool nansMatch = true;
+                for (size_t i = 0; i < N; i++) {
+                    if (isnan(expected[i]) || isnan(actual[i])) {
+                        nansMatch = nansMatch && isnan(expected[i]) && isnan(actual[i]);
+                    } else {
+                        worst = std::max(worst, fabs(expected[i] - actual[i]));
+                    }
+                }
+                check(nansMatch, "Gaussian N=%zu kernel=%d alpha=%g: NaN edges differ", N, kernel, alpha);
+                check(worst <= tolerance * maxY, "Gaussian N=%zu kernel=%d alpha=%g: error %g of max |y|", N, kernel, alpha, worst / maxY);
+            }
+        }
+    }
+}
+
+/* NaNs in the input disable the FFT, so wide kernels must still match GSL's direct filter */
+static void testGaussianWithNaNs() {
+    const size_t N = 5000;
+    std::vector<double> y = testProfile(N);
+    y[1234] = NAN;
+    const int kernel = FFT_KERNEL_THRESHOLD + 1;
+    std::vector<double> expected(N), actual(N);
+    referenceGaussian(y.data(), N, expected.data(), kernel, 2.0);
+    filterGaussian(y.data(), N, actual.data(), kernel, 2.0);
+    bool matches = true;
+    for (size_t i = 0; i < N; i++) {
+        matches = matches && ((isnan(expected[i]) && isnan(actual[i])) || fabs(expected[i] - actual[i]) <= 1e-10 * 1e3);
+    }
+    check(matches, "Gaussian with NaN input differs from gsl_filter_gaussian");
+}
+
+/* Previous implementation of filterBoxcar, averaging each window filled by gsl_movstat_fill. Windows with NaNs give NaN */
+static void referenceBoxcar(double* yInArray, const int N, double* yOutArray, const int kernel) {
+    gsl_vector_view yIn = gsl_vector_view_array(yInArray, N);
+    double* window = new double[kernel];
+    size_t H, J;
+    if (kernel % 2 == 0) {
+        H = kernel / 2 - 1;
+        J = kernel - H - 1;
+    } else {
+        H = (kernel - 1) / 2;
+        J = (kernel - 1) / 2;
+    }
+    for (size_t i = 0; i < N; ++i) {
+        if (i < H || i > N - 1 - J) {
+            yOutArray[i] = NAN;
+            continue;
+        }
+        size_t wsize = gsl_movstat_fill(GSL_MOVSTAT_END_PADZERO, &yIn.vector, i, H, J, window);
+        yOutArray[i] = gsl_stats_mean(window, 1, wsize);
+    }
+    delete[] window;
+}
+
+/* Mean of the finite values in each full window, or NaN if there are none */
+static void referenceBoxcarSkipNaN(const double* yInArray, const int N, double* yOutArray, const int kernel) {
+    const size_t H = kernel % 2 == 0 ? kernel / 2 - 1 : (kernel - 1) / 2;
+    const size_t J = kernel - H - 1;
+    for (size_t i = 0; i < N; ++i) {
+        yOutArray[i] = NAN;
+        if (i < H || i + J >= N) {
+            continue;
+        }
+        long double sum = 0;
+        size_t count = 0;
+        for (size_t j = i - H; j <= i + J; j++) {
+            if (isfinite(yInArray[j])) {
+                sum += yInArray[j];
+                count++;
+            }
+        }
+        if (count) {
+            yOutArray[i] = (double)(sum / count);
+        }
+    }
+}
+
+/* Relative error of actual against expected, or infinity if their NaNs or infinite values are not in the same places */
+static double compareOutputs(const std::vector<double>& expected, const std::vector<double>& actual) {
+    double worst = 0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (isnan(expected[i]) || isnan(actual[i])) {
+            if (!(isnan(expected[i]) && isnan(actual[i]))) {
+                return INFINITY;
+            }
+        } else if (isinf(expected[i]) || isinf(actual[i])) {
+            if (expected[i] != actual[i]) {
+                return INFINITY;
+            }
+        } else {
+            worst = std::max(worst, fabs(expected[i] - actual[i]) / std::max(fabs(expected[i]), 1e-300));
+        }
+    }
+    return worst;
+}
+
+const int BOXCAR_KERNELS[] = {1, 2, 3, 4, 5, 10, 11, 51, 100, 101, 501, 1001};
+
+/*
+ * Without NaNs, both NaN modes must match the previous implementation, including its NaN edges. With NaNs, mode 0 must
+ * give NaN for exactly the windows that the previous implementation did, and mode 1 the mean of the finite values
+ */
+static void testBoxcarNaNModes() {
+    const size_t N = 20000;
+    const double tolerance = 1e-12;
+    std::vector<double> y = testProfile(N);
+    std::vector<double> yNaN = y;
+    for (size_t i = 500; i < N; i += 3777) {
+        yNaN[i] = NAN;
+    }
+    // a run of NaNs longer than the small kernels, so that some windows have no finite values
+    for (size_t i = 9000; i < 9020; i++) {
+        yNaN[i] = NAN;
+    }
+
+    for (const int kernel : BOXCAR_KERNELS) {
+        std::vector<double> expected(N), actual(N);
+        referenceBoxcar(y.data(), N, expected.data(), kernel);
+        for (const int nanMode : {0, 1}) {
+            filterBoxcar(y.data(), N, actual.data(), kernel, nanMode);
+            const double error = compareOutputs(expected, actual);
+            check(error <= tolerance, "boxcar kernel=%d nanMode=%d without NaNs: relative error %g", kernel, nanMode, error);
+        }
+
+        referenceBoxcar(yNaN.data(), N, expected.data(), kernel);
+        filterBoxcar(yNaN.data(), N, actual.data(), kernel, 0);
+        double error = compareOutputs(expected, actual);
+        check(error <= tolerance, "boxcar kernel=%d nanMode=0 with NaNs: relative error %g", kernel, error);
+
+        referenceBoxcarSkipNaN(yNaN.data(), N, expected.data(), kernel);
+        filterBoxcar(yNaN.data(), N, actual.data(), kernel, 1);
+        error = compareOutputs(expected, actual);
+        check(error <= tolerance, "boxcar kernel=%d nanMode=1 with NaNs: relative error %g", kernel, error);
+    }
+}
+
+/* Windows containing infinite values must give the same result as averaging each window directly, in both NaN modes without NaNs */
+static void testBoxcarInfinities() {
+    const size_t N = 2000;
+    std::vector<double> y = testProfile(N);
+    y[300] = INFINITY;
+    y[1000] = -INFINITY;
+    // an infinite value at the end of a window gives an infinite mean, otherwise the direct mean is NaN
+    y[1500] = INFINITY;
+    y[1510] = -INFINITY;
+    for (const int kernel : BOXCAR_KERNELS) {
+        std::vector<double> expected(N), actual(N);
+        referenceBoxcar(y.data(), N, expected.data(), kernel);
+        filterBoxcar(y.data(), N, actual.data(), kernel, 0);
+        const double error = compareOutputs(expected, actual);
+        check(error <= 1e-12, "boxcar kernel=%d with infinite values: relative error %g", kernel, error);
+    }
+}
+
+/*
+ * A smoothing context reused across filters must give exactly the same output as a temporary context, whatever filter
+ * was applied before. The wide Gaussian kernels go through the FFT convolution
+ */
+static void testSmoothingContextReuse() {
+    const int N = 4000;
+    std::vector<double> y = testProfile(N);
+    std::vector<double> x(N);
+    for (int i = 0; i < N; i++) {
+        x[i] = 1e9 + 1e4 * i;
+    }
+    const struct {
+        int filter;
+        int kernel;
+        double param;
+    } filters[] = {
+        {SMOOTHING_GAUSSIAN, 301, 2.0}, {SMOOTHING_GAUSSIAN, 301, 3.0}, {SMOOTHING_HANNING, 11, 0}, {SMOOTHING_SAVITZKY_GOLAY, 7, 2},
+        {SMOOTHING_SAVITZKY_GOLAY, 7, 3}, {SMOOTHING_GAUSSIAN, 21, 2.0}, {SMOOTHING_HANNING, 5, 0}, {SMOOTHING_GAUSSIAN, 301, 2.0},
+    };
+    SmoothingContext* context = smoothingContextCreate();
+    for (const auto& f : filters) {
+        std::vector<double> expected(N), actual(N);
+        filterBatch(NULL, f.filter, y.data(), 0, N, 1, expected.data(), f.kernel, f.param, x.data());
+        filterBatch(context, f.filter, y.data(), 0, N, 1, actual.data(), f.kernel, f.param, x.data());
+        check(compareOutputs(expected, actual) == 0, "filter=%d kernel=%d param=%g differs with a reused context", f.filter, f.kernel, f.param);
+    }
+    smoothingContextFree(context);
+}
+
+/* Median time of the given runs, in ms */
+template <typename F>
+static double medianTime(F run, const int runs) {
+    std::vector<double> times;
+    for (int i = 0; i < runs; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+/* Timings only: the running sum should take about the same time for all kernels, and the previous implementation grow with the kernel */
+static void benchmarkBoxcar() {
+    const size_t N = 100000;
+    std::vector<double> y = testProfile(N);
+    std::vector<double> output(N);
+    printf("Boxcar smoothing of %zu points (median of 5 runs):\n", N);
+    for (const int kernel : {3, 5, 11, 51, 101, 201, 501, 1001}) {
+        const double previous = medianTime([&]() { referenceBoxcar(y.data(), N, output.data(), kernel); }, 5);
+        const double current = medianTime([&]() { filterBoxcar(y.data(), N, output.data(), kernel, 0); }, 5);
+        printf("  kernel %4d: previous %8.2f ms, running sum %6.2f ms\n", kernel, previous, current);
+    }
+}
+
+int main() {
+    testGaussianAgainstGsl();
+    testGaussianWithNaNs();
+    testBoxcarNaNModes();
+    testBoxcarInfinities();
+    testSmoothingContextReuse();
+    benchmarkBoxcar();
+    if (failures) {
+        printf("%d smoothing checks failed\n", failures);
+        return 1;
+    }
+    printf("All smoothing checks passed\n");
+    return 0;
+}
@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+command -v emcc >/dev/null 2>&1 || { echo "Script requires emcc but it's not installed or in PATH.Aborting." >&2; exit 1; }
+command -v node >/dev/null 2>&1 || { echo "Script requires node but it's not installed or in PATH.Aborting." >&2; exit 1; }
+cd "${0%/*}"
+cd gsl_wrapper
+mkdir -p build/test
+# Each test includes gsl_wrapper.cc, so that it can also check the internal kernels, and is run with node
+status=0
+for test in test/*_test.cc; do
+    name=$(basename "${test}" .cc)
+    printf "Building ${name}..."
+    if ! emcc -o build/test/${name}.js ${test} -I ../../wasm_libs/built/include \
+        -L../../wasm_libs/built/lib -lm -lgsl -lm -lgslcblas -g0 -O2 -std=c++11 \
+        -s WASM=1 -s ALLOW_MEMORY_GROWTH=1 -s EXIT_RUNTIME=1; then
+        echo "Failed!"
+        status=1
+        continue
+    fi
+    echo "Done"
+    node build/test/${name}.js || status=1
+done
+exit ${status}
@@ -2,69 +2,175 @@ declare var Module: any;
 declare var addOnPostRun: any;
 const ctx: Worker = self as any;
 const FLT_MAX = 3.402823466e+38;
+// Must match TileCodec in zfp_wrapper.c
+const TILE_CODEC_ZSTD = 1;
 // Allocate a 4 MB uncompressed buffer and 1 MB uncompressed buffer
 Module.nDataBytes = 4e6;
 Module.nDataBytesCompressed = 1e6;
 Module.dataPtr = null;
-Module.dataHeap = null;
-Module.resultFloat = null;
 Module.dataPtrUint = null;
-Module.dataHeapUint = null;
 Module.debugOutput = false;
 Module.id = -1;
+Module.ready = false;
+Module.pendingCacheBudget = null;
 
 const zfpDecompress = Module.cwrap("zfpDecompress", "number", ["number", "number", "number", "number", "number", "number"]);
+const zfpDecompress3d = Module.cwrap("zfpDecompress3d", "number", ["number", "number", "number", "number", "number", "number", "number"]);
+const losslessDecompress = Module.cwrap("losslessDecompress", "number", ["number", "number", "number", "number", "number", "number"]);
+const tileCacheDecompress = Module.cwrap("tileCacheDecompress", "number", ["number", "number", "number"]);
+const tileCacheSetBudget = Module.cwrap("tileCacheSetBudget", null, ["number"]);
+const tileCacheInsert = Module.cwrap("tileCacheInsert", "number", ["number", "number", "number", "number", "number", "number", "number", "number"]);
+const tileCacheRemove = Module.cwrap("tileCacheRemove", null, ["number", "number"]);
+const tileCacheRemoveFile = Module.cwrap("tileCacheRemoveFile", null, ["number"]);
+const tileCacheNumEvicted = Module.cwrap("tileCacheNumEvicted", "number", []);
+const tileCacheEvicted = Module.cwrap("tileCacheEvicted", "number", []);
+const tileCacheClearEvicted = Module.cwrap("tileCacheClearEvicted", null, []);
 
 addOnPostRun(() => {
     // Allocate a 4 MB uncompressed buffer and 1 MB uncompressed buffer
     Module.nDataBytes = 4e6;
     Module.nDataBytesCompressed = 1e6;
     Module.dataPtr = Module._malloc(Module.nDataBytes);
-    Module.dataHeap = new Uint8Array(Module.HEAPU8.buffer, Module.dataPtr, Module.nDataBytes);
-    Module.resultFloat = new Float32Array(Module.dataHeap.buffer, Module.dataHeap.byteOffset, Module.nDataBytes / 4);
     Module.dataPtrUint = Module._malloc(Module.nDataBytesCompressed);
-    Module.dataHeapUint = new Uint8Array(Module.HEAPU8.buffer, Module.dataPtrUint, Module.nDataBytesCompressed);
+    Module.ready = true;
+    // The cache budget may be set before the runtime is ready
+    if (Module.pendingCacheBudget !== null) {
+        tileCacheSetBudget(Module.pendingCacheBudget);
+    }
 
     ctx.postMessage(["ready"]);
 });
 
-Module.zfpDecompressUint8WASM = function (u8: Uint8Array, compressedSize: number, nx: number, ny: number, precision: number) {
-    let newNumDataBytes = nx * ny * 4;
-    if (!Module.dataPtr || newNumDataBytes > Module.nDataBytes) {
-        if (Module.dataHeap) {
-            Module._free(Module.dataHeap.byteOffset);
+// Heap views are created on demand from pointers, as views created before a memory growth (e.g. a new tile cache slab) are detached
+function resizeDataBuffer(numDataBytes: number) {
+    if (!Module.dataPtr || numDataBytes > Module.nDataBytes) {
+        if (Module.dataPtr) {
+            Module._free(Module.dataPtr);
         }
-        Module.nDataBytes = newNumDataBytes;
+        Module.nDataBytes = numDataBytes;
         Module.dataPtr = Module._malloc(Module.nDataBytes);
-        Module.dataHeap = new Uint8Array(Module.HEAPU8.buffer, Module.dataPtr, Module.nDataBytes);
         if (Module.debugOutput) {
             console.log(`ZFP Worker ${Module.id} allocating new uncompressed buffer (${Module.nDataBytes / 1000} KB)`);
         }
-        Module.resultFloat = new Float32Array(Module.dataHeap.buffer, Module.dataHeap.byteOffset, nx * ny);
     }
+}
 
+function copyCompressedData(u8: Uint8Array, compressedSize: number) {
     let newNumDataBytesCompressed = u8.length;
     if (!Module.dataPtrUint || newNumDataBytesCompressed > Module.nDataBytesCompressed) {
-        if (Module.dataHeapUint) {
-            Module._free(Module.dataHeapUint.byteOffset);
+        if (Module.dataPtrUint) {
+            Module._free(Module.dataPtrUint);
         }
         Module.nDataBytesCompressed = newNumDataBytesCompressed;
         Module.dataPtrUint = Module._malloc(Module.nDataBytesCompressed);
-        Module.dataHeapUint = new Uint8Array(Module.HEAPU8.buffer, Module.dataPtrUint, Module.nDataBytesCompressed);
         if (Module.debugOutput) {
             console.log(`ZFP Worker ${Module.id} allocating new compressed buffer (${Module.nDataBytesCompressed / 1000} KB)`);
         }
     }
 
-    Module.dataHeapUint.set(new Uint8Array(u8.buffer, u8.byteOffset, compressedSize));
+    Module.HEAPU8.set(new Uint8Array(u8.buffer, u8.byteOffset, compressedSize), Module.dataPtrUint);
+}
+
+// Decodes a ZFP tile, or a lossless tile, in which case the precision argument selects the delta filter
+Module.decompressUint8WASM = function (u8: Uint8Array, compressedSize: number, nx: number, ny: number, precision: number, codec: number) {
+    resizeDataBuffer(nx * ny * 4);
+    copyCompressedData(u8, compressedSize);
     // Call function and get result
-    zfpDecompress(Math.floor(precision), Module.dataHeap.byteOffset, nx, ny, Module.dataHeapUint.byteOffset, compressedSize);
+    if (codec === TILE_CODEC_ZSTD) {
+        losslessDecompress(Math.floor(precision), Module.dataPtr, nx, ny, Module.dataPtrUint, compressedSize);
+    } else {
+        zfpDecompress(Math.floor(precision), Module.dataPtr, nx, ny, Module.dataPtrUint, compressedSize);
+    }
 
-    // Free memory
-    return new Float32Array(Module.resultFloat.buffer, Module.resultFloat.byteOffset, nx * ny);
+    return new Float32Array(Module.HEAPF32.buffer, Module.dataPtr, nx * ny);
     // END WASM
 };
 
+// Decodes a ZFP brick of nz channels of a tile into consecutive channel planes. Returns null if the brick could not be decoded
+Module.decompressBrickWASM = function (u8: Uint8Array, compressedSize: number, nx: number, ny: number, nz: number, precision: number) {
+    resizeDataBuffer(nx * ny * nz * 4);
+    copyCompressedData(u8, compressedSize);
+    if (zfpDecompress3d(Math.floor(precision), Module.dataPtr, nx, ny, nz, Module.dataPtrUint, compressedSize) !== 0) {
+        return null;
+    }
+    return new Float32Array(Module.HEAPF32.buffer, Module.dataPtr, nx * ny * nz);
+};
+
+// Copies a compressed tile into the tile cache. Returns false if the tile could not be cached within the cache budget
+Module.cacheTile = function (u8: Uint8Array, compressedSize: number, nanEncodings: Int32Array, eventArgs: any) {
+    const slotPtr = tileCacheInsert(eventArgs.fileId, eventArgs.tileCoordinate, compressedSize, nanEncodings.length, eventArgs.width, eventArgs.subsetHeight, eventArgs.codec ?? 0, Math.floor(eventArgs.compression));
+    if (!slotPtr) {
+        return false;
+    }
+    Module.HEAP32.set(nanEncodings, slotPtr / 4);
+    Module.HEAPU8.set(new Uint8Array(u8.buffer, u8.byteOffset, compressedSize), slotPtr + nanEncodings.length * 4);
+    return true;
+};
+
+// Decodes a tile directly from the tile cache, with NaNs already in place. Returns null if the tile is no longer cached or could not be decoded
+Module.decompressCachedWASM = function (fileId: number, tileCoordinate: number, nx: number, ny: number) {
+    resizeDataBuffer(nx * ny * 4);
+    if (tileCacheDecompress(fileId, tileCoordinate, Module.dataPtr) !== 0) {
+        return null;
+    }
+    return new Float32Array(Module.HEAPF32.buffer, Module.dataPtr, nx * ny);
+};
+
+// Notify the main thread of tiles evicted from the cache, so that they are requested from the backend again
+function postEvictedTiles() {
+    const numEvicted = tileCacheNumEvicted();
+    if (numEvicted) {
+        const evicted = new Int32Array(Module.HEAP32.buffer, tileCacheEvicted(), numEvicted * 2).slice();
+        tileCacheClearEvicted();
+        ctx.postMessage(["evicted", evicted.buffer], [evicted.buffer]);
+    }
+}
+
+// Absolute timestamps, comparable with those of the main thread
+function timestamp() {
+    return performance.timeOrigin + performance.now();
+}
+
+// Puts NaNs back into the data, using the run lengths of alternating valid and NaN values
+function fillNans(outputView: Float32Array, nanEncodings: Int32Array) {
+    let decodedIndex = 0;
+    let fillVal = false;
+
+    for (let L of nanEncodings) {
+        if (fillVal) {
+            // Some shader compilers have trouble with NaN checks, so we instead use a dummy value of -FLT_MAX
+            outputView.fill(-FLT_MAX, decodedIndex, decodedIndex + L);
+        }
+        fillVal = !fillVal;
+        decodedIndex += L;
+    }
+}
+
+function tileResultArgs(eventArgs: any, decompressStart?: number, decompressEnd?: number, cachedBytes?: number) {
+    return {
+        width: eventArgs.width,
+        subsetHeight: eventArgs.subsetHeight,
+        subsetLength: eventArgs.subsetLength,
+        requestId: eventArgs.requestId,
+        tileCoordinate: eventArgs.tileCoordinate,
+        layer: eventArgs.layer,
+        compression: eventArgs.compression,
+        codec: eventArgs.codec,
+        fileId: eventArgs.fileId,
+        channel: eventArgs.channel,
+        stokes: eventArgs.stokes,
+        previewId: eventArgs.previewId,
+        oldAspectRatio: eventArgs.oldAspectRatio,
+        oldHeight: eventArgs.oldHeight,
+        oldWidth: eventArgs.oldWidth,
+        syncId: eventArgs.syncId,
+        depth: eventArgs.depth,
+        decompressStart,
+        decompressEnd,
+        cachedBytes
+    };
+}
+
 ctx.onmessage = (event => {
     if (event.data && Array.isArray(event.data) && event.data.length > 1) {
         let eventName = event.data[0];
@@ -74,58 +180,87 @@ ctx.onmessage = (event => {
         }
         if (eventName === "setid") {
             Module.id = event.data[1];
+        } else if (eventName === "cache budget") {
+            if (Module.ready) {
+                tileCacheSetBudget(event.data[1]);
+                postEvictedTiles();
+            } else {
+                Module.pendingCacheBudget = event.data[1];
+            }
+        } else if (eventName === "clear cache") {
+            tileCacheRemoveFile(event.data[1]);
+        } else if (eventName === "remove cached") {
+            tileCacheRemove(event.data[1], event.data[2]);
+        } else if (eventName === "decompress cached") {
+            const eventArgs = event.data[2];
+            const decompressStart = timestamp();
+            const imageData = Module.decompressCachedWASM(eventArgs.fileId, eventArgs.tileCoordinate, eventArgs.width, eventArgs.subsetHeight);
+            const decompressEnd = timestamp();
+            if (imageData) {
+                const outputView = new Float32Array(event.data[1], 0, eventArgs.width * eventArgs.subsetHeight);
+                outputView.set(imageData);
+                ctx.postMessage(["decompress", event.data[1], tileResultArgs(eventArgs, decompressStart, decompressEnd)], [event.data[1]]);
+            } else {
+                ctx.postMessage(["cache miss", tileResultArgs(eventArgs)]);
+            }
+        } else if (eventName === "read cached") {
+            // Reads a cached tile back for use on the main thread (e.g. after its data has been uploaded to the GPU), without updating the tile stream.
+            // The buffer is returned empty (null) if the tile is no longer cached
+            const eventArgs = event.data[2];
+            const imageData = Module.decompressCachedWASM(eventArgs.fileId, eventArgs.tileCoordinate, eventArgs.width, eventArgs.subsetHeight);
+            if (imageData) {
+                const outputView = new Float32Array(event.data[1], 0, eventArgs.width * eventArgs.subsetHeight);
+                outputView.set(imageData);
+                ctx.postMessage(["read cached", event.data[1], tileResultArgs(eventArgs)], [event.data[1]]);
+            } else {
+                ctx.postMessage(["read cached", null, tileResultArgs(eventArgs)]);
+            }
         } else if (eventName === "decompress" || eventName === "preview decompress") {
             const eventArgs = event.data[2];
             const compressedView = new Uint8Array(event.data[1], 0, eventArgs.subsetLength);
-            if (Module.debugOutput) {
-                performance.mark("decompressStart");
+            const decompressStart = timestamp();
+            // Cached tiles are decoded straight from the tile cache, which also restores the NaNs. The main thread only adds the tile to
+            // its cache map once the number of cached bytes is returned
+            let imageData: Float32Array | null = null;
+            let cachedBytes: number | undefined = undefined;
+            if (eventArgs.cache) {
+                cachedBytes = 0;
+                if (Module.cacheTile(compressedView, eventArgs.subsetLength, eventArgs.nanEncodings, eventArgs)) {
+                    cachedBytes = eventArgs.subsetLength + eventArgs.nanEncodings.length * 4;
+                    postEvictedTiles();
+                    imageData = Module.decompressCachedWASM(eventArgs.fileId, eventArgs.tileCoordinate, eventArgs.width, eventArgs.subsetHeight);
+                }
             }
-            let imageData = Module.zfpDecompressUint8WASM(compressedView, eventArgs.subsetLength, eventArgs.width, eventArgs.subsetHeight, eventArgs.compression);
-            if (Module.debugOutput) {
-                performance.mark("decompressEnd");
+            const nansApplied = imageData !== null;
+            if (!imageData) {
+                imageData = Module.decompressUint8WASM(compressedView, eventArgs.subsetLength, eventArgs.width, eventArgs.subsetHeight, eventArgs.compression, eventArgs.codec);
             }
             let outputView = new Float32Array(event.data[1], 0, eventArgs.width * eventArgs.subsetHeight);
             outputView.set(imageData);
 
-            // put NaNs back into data
-            let decodedIndex = 0;
-            let fillVal = false;
-
-            for (let L of eventArgs.nanEncodings) {
-                if (fillVal) {
-                    // Some shader compilers have trouble with NaN checks, so we instead use a dummy value of -FLT_MAX
-                    outputView.fill(-FLT_MAX, decodedIndex, decodedIndex + L);
-                }
-                fillVal = !fillVal;
-                decodedIndex += L;
+            if (!nansApplied) {
+                fillNans(outputView, eventArgs.nanEncodings);
             }
 
-            ctx.postMessage([eventName, event.data[1], {
-                width: eventArgs.width,
-                subsetHeight: eventArgs.subsetHeight,
-                subsetLength: eventArgs.subsetLength,
-                requestId: eventArgs.requestId,
-                tileCoordinate: eventArgs.tileCoordinate,
-                layer: eventArgs.layer,
-                fileId: eventArgs.fileId,
-                channel: eventArgs.channel,
-                stokes: eventArgs.stokes,
-                previewId: eventArgs.previewId,
-                oldAspectRatio: eventArgs.oldAspectRatio,
-                oldHeight: eventArgs.oldHeight,
-                oldWidth: eventArgs.oldWidth,
-                syncId: eventArgs.syncId
-            }, event.data[3]], [event.data[1]]);
-
-            if (Module.debugOutput) {
-                performance.measure("dtDecompress", "decompressStart", "decompressEnd");
-                const dt = performance.getEntriesByName("dtDecompress")[0].duration;
-                performance.clearMarks();
-                performance.clearMeasures();
-                const eventSize = (4e-6 * eventArgs.width * eventArgs.subsetHeight);
-                setTimeout(() => {
-                    console.log(`ZFP Worker ${Module.id} decompressed ${eventSize.toFixed(2)} MB in ${dt.toFixed(2)} ms at ${(1e3 * eventSize / dt).toFixed(2)} MB/s (${(1e3 * eventSize / dt / 4).toFixed(2)} Mpix/s)`);
-                }, 100);
+            // The decompression end includes restoring NaNs
+            const decompressEnd = timestamp();
+            ctx.postMessage([eventName, event.data[1], tileResultArgs(eventArgs, decompressStart, decompressEnd, cachedBytes), event.data[3]], [event.data[1]]);
+        } else if (eventName === "decompress brick") {
+            // Decodes a brick of eventArgs.depth channels into consecutive planes. The NaN encodings cover the whole brick. Bricks are not
+            // cached, and there is no tile message carrying them until the protocol defines one, so the buffer is returned empty (null) on failure
+            const eventArgs = event.data[2];
+            const length = eventArgs.width * eventArgs.subsetHeight * eventArgs.depth;
+            const compressedView = new Uint8Array(event.data[1], 0, eventArgs.subsetLength);
+            const decompressStart = timestamp();
+            const imageData = Module.decompressBrickWASM(compressedView, eventArgs.subsetLength, eventArgs.width, eventArgs.subsetHeight, eventArgs.depth, eventArgs.compression);
+            if (imageData) {
+                const outputView = new Float32Array(event.data[1], 0, length);
+                outputView.set(imageData);
+                fillNans(outputView, eventArgs.nanEncodings);
+                const decompressEnd = timestamp();
+                ctx.postMessage([eventName, event.data[1], tileResultArgs(eventArgs, decompressStart, decompressEnd)], [event.data[1]]);
+            } else {
+                ctx.postMessage([eventName, null, tileResultArgs(eventArgs)]);
             }
         }
     }
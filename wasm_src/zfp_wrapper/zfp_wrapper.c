@@ -1,14 +1,32 @@
 #include <emscripten/emscripten.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "zfp.h"
 
-int EMSCRIPTEN_KEEPALIVE zfpDecompress(int precision, float* array, int nx, int ny, unsigned char* buffer, int compressedSize) {
+extern size_t ZSTD_decompress(void* dst, size_t dstCapacity, const void* src, size_t srcSize);
+extern unsigned ZSTD_isError(size_t code);
+
+typedef enum {
+    TILE_CODEC_ZFP = 0,
+    TILE_CODEC_ZSTD = 1
+} TileCodec;
+
+typedef enum {
+    LOSSLESS_FILTER_NONE = 0,
+    LOSSLESS_FILTER_XOR_DELTA = 1,
+    LOSSLESS_FILTER_BYTE_DELTA = 2
+} LosslessFilter;
+
+static unsigned char* losslessBuffer = NULL;
+static size_t losslessBufferSize = 0;
+
+static int decompressField(int precision, zfp_field* field, unsigned char* buffer, int compressedSize) {
     int status = 0;    /* return value: 0 = success */
-    zfp_type type;     /* array scalar type */
-    zfp_field* field;  /* array meta data */
     zfp_stream* zfp;   /* compressed stream */
     bitstream* stream; /* bit stream to write to or read from */
-    type = zfp_type_float;
-    field = zfp_field_2d(array, type, nx, ny);
     zfp = zfp_stream_open(NULL);
 
     zfp_stream_set_precision(zfp, precision);
@@ -25,4 +43,457 @@ int EMSCRIPTEN_KEEPALIVE zfpDecompress(int precision, float* array, int nx, int
     stream_close(stream);
 
     return status;
-}
\ No newline at end of file
+}
+
+int EMSCRIPTEN_KEEPALIVE zfpDecompress(int precision, float* array, int nx, int ny, unsigned char* buffer, int compressedSize) {
+    return decompressField(precision, zfp_field_2d(array, zfp_type_float, nx, ny), buffer, compressedSize);
+}
+
+/*
+ * Decodes a brick of nz consecutive channels of a tile, compressed as a single 3D field. ZFP's 3D transform also
+ * decorrelates along the spectral axis, so a brick is much smaller than the same channels compressed one by one.
+ * Channel planes are written consecutively, each with the same layout as a 2D tile.
+ * Returns 0 on success, 1 if decoding failed
+ */
+int EMSCRIPTEN_KEEPALIVE zfpDecompress3d(int precision, float* array, int nx, int ny, int nz, unsigned char* buffer, int compressedSize) {
+    return decompressField(precision, zfp_field_3d(array, zfp_type_float, nx, ny, nz), buffer, compressedSize);
+}
+
+/*
+ * Lossless float tiles are Zstd-compressed. Within each block of four values, the bytes are shuffled so that the
+ * first bytes of all four values come first, then the second bytes, and so on (the same layout as decodeArray in
+ * carta_computation). Trailing values that don't fill a block are not shuffled. An optional delta filter is applied
+ * before compression: byte deltas over the shuffled byte stream, or XOR deltas between the 32-bit words of consecutive
+ * values. NaNs are replaced with -FLT_MAX, as with ZFP tiles.
+ * Returns 0 on success, 1 if decoding failed
+ */
+int EMSCRIPTEN_KEEPALIVE losslessDecompress(int filter, float* array, int nx, int ny, unsigned char* buffer, int compressedSize) {
+    const int N = nx * ny;
+    const size_t numBytes = (size_t) N * sizeof(float);
+    if (N <= 0) {
+        return 1;
+    }
+
+    if (numBytes > losslessBufferSize) {
+        unsigned char* newBuffer = (unsigned char*) realloc(losslessBuffer, numBytes);
+        if (!newBuffer) {
+            return 1;
+        }
+        losslessBuffer = newBuffer;
+        losslessBufferSize = numBytes;
+    }
+
+    const size_t decodedBytes = ZSTD_decompress(losslessBuffer, numBytes, buffer, compressedSize);
+    if (ZSTD_isError(decodedBytes) || decodedBytes != numBytes) {
+        return 1;
+    }
+
+    if (filter == LOSSLESS_FILTER_BYTE_DELTA) {
+        unsigned char last = 0;
+        for (size_t i = 0; i < numBytes; i++) {
+            last += losslessBuffer[i];
+            losslessBuffer[i] = last;
+        }
+    }
+
+    // Un-shuffle data
+    uint32_t* words = (uint32_t*) array;
+    const int blockedLength = 4 * (N / 4);
+    int v = 0;
+    for (; v < blockedLength; v += 4) {
+        const unsigned char* block = losslessBuffer + 4 * v;
+        for (int j = 0; j < 4; j++) {
+            words[v + j] = (uint32_t) block[j] | ((uint32_t) block[j + 4] << 8) | ((uint32_t) block[j + 8] << 16) | ((uint32_t) block[j + 12] << 24);
+        }
+    }
+    if (v < N) {
+        memcpy(words + v, losslessBuffer + 4 * v, (N - v) * sizeof(uint32_t));
+    }
+
+    if (filter == LOSSLESS_FILTER_XOR_DELTA) {
+        for (int i = 1; i < N; i++) {
+            words[i] ^= words[i - 1];
+        }
+    }
+
+    // Some shader compilers have trouble with NaN checks, so we instead use a dummy value of -FLT_MAX
+    for (int i = 0; i < N; i++) {
+        if (isnan(array[i])) {
+            array[i] = -FLT_MAX;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Compressed tile cache, held in the worker's linear memory.
+ *
+ * Tiles are stored in fixed-size slots carved out of 1 MB slabs, with power-of-two slot classes from 4 KB up to a full slab.
+ * The byte budget applies to the total size of allocated slabs, so it tracks the memory actually used by the cache. A slab
+ * is released as soon as all of its slots are free. Entries are evicted in least-recently-used order until a new entry fits,
+ * and the keys of evicted entries are recorded so that the main thread can update its index of cached tiles.
+ *
+ * Each slot holds the tile's NaN encodings (int32) followed by the compressed ZFP or lossless stream, so a cached tile can
+ * be decoded directly from its slot.
+ */
+
+#define TILE_CACHE_SLAB_SHIFT 20
+#define TILE_CACHE_SLAB_SIZE (1 << TILE_CACHE_SLAB_SHIFT)
+#define TILE_CACHE_MIN_SLOT_SHIFT 12
+#define TILE_CACHE_MAX_SLABS 4096
+#define TILE_CACHE_NUM_BUCKETS 4096
+#define TILE_CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+/* slot class used for entries larger than a slab, which are allocated individually */
+#define TILE_CACHE_LARGE_CLASS -1
+
+typedef struct TileCacheEntry {
+    int fileId;
+    int tileCoordinate;
+    int width;
+    int height;
+    int codec;
+    int precision; /* delta filter for lossless tiles */
+    int nanLength;
+    int compressedSize;
+    int slotClass;
+    int slabIndex;
+    size_t allocatedBytes;
+    unsigned char* data;
+    struct TileCacheEntry* prev; /* towards most recently used */
+    struct TileCacheEntry* next; /* towards least recently used */
+    struct TileCacheEntry* bucketNext;
+} TileCacheEntry;
+
+typedef struct {
+    unsigned char* memory;
+    int slotClass;
+    int numSlots;
+    int usedSlots;
+    void* freeList;
+} TileCacheSlab;
+
+static TileCacheSlab slabs[TILE_CACHE_MAX_SLABS];
+static int numSlabs = 0;
+static TileCacheEntry* buckets[TILE_CACHE_NUM_BUCKETS];
+static TileCacheEntry* lruHead = NULL;
+static TileCacheEntry* lruTail = NULL;
+static size_t allocatedBytes = 0;
+static size_t budgetBytes = TILE_CACHE_DEFAULT_BUDGET;
+
+static int* evictedKeys = NULL;
+static int numEvicted = 0;
+static int evictedCapacity = 0;
+
+static unsigned int hashKey(int fileId, int tileCoordinate) {
+    unsigned int h = (unsigned int) tileCoordinate * 2654435761u;
+    h ^= (unsigned int) fileId * 2246822519u;
+    return (h ^ (h >> 16)) % TILE_CACHE_NUM_BUCKETS;
+}
+
+static int slotClassForSize(size_t size) {
+    if (size > TILE_CACHE_SLAB_SIZE) {
+        return TILE_CACHE_LARGE_CLASS;
+    }
+    int slotClass = 0;
+    while (((size_t) 1 << (TILE_CACHE_MIN_SLOT_SHIFT + slotClass)) < size) {
+        slotClass++;
+    }
+    return slotClass;
+}
+
+static void* popSlot(int slotClass, int* slabIndex) {
+    for (int i = 0; i < numSlabs; i++) {
+        TileCacheSlab* slab = &slabs[i];
+        if (slab->memory && slab->slotClass == slotClass && slab->freeList) {
+            void* slot = slab->freeList;
+            slab->freeList = *(void**) slot;
+            slab->usedSlots++;
+            *slabIndex = i;
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+static void* newSlabSlot(int slotClass, int* slabIndex) {
+    int index = -1;
+    for (int i = 0; i < numSlabs; i++) {
+        if (!slabs[i].memory) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        if (numSlabs >= TILE_CACHE_MAX_SLABS) {
+            return NULL;
+        }
+        index = numSlabs++;
+    }
+
+    unsigned char* memory = (unsigned char*) malloc(TILE_CACHE_SLAB_SIZE);
+    if (!memory) {
+        return NULL;
+    }
+
+    TileCacheSlab* slab = &slabs[index];
+    const size_t slotSize = (size_t) 1 << (TILE_CACHE_MIN_SLOT_SHIFT + slotClass);
+    slab->memory = memory;
+    slab->slotClass = slotClass;
+    slab->numSlots = TILE_CACHE_SLAB_SIZE / slotSize;
+    slab->usedSlots = 1;
+    slab->freeList = NULL;
+    // First slot is returned, remaining slots are threaded onto the free list
+    for (int i = slab->numSlots - 1; i >= 1; i--) {
+        void* slot = memory + i * slotSize;
+        *(void**) slot = slab->freeList;
+        slab->freeList = slot;
+    }
+    allocatedBytes += TILE_CACHE_SLAB_SIZE;
+    *slabIndex = index;
+    return memory;
+}
+
+/* Returns a slot to its slab's free list, or frees it if it was allocated individually */
+static void releaseSlot(void* slot, int slotClass, int slabIndex, size_t slotBytes) {
+    if (slotClass == TILE_CACHE_LARGE_CLASS) {
+        free(slot);
+        allocatedBytes -= slotBytes;
+        return;
+    }
+
+    TileCacheSlab* slab = &slabs[slabIndex];
+    *(void**) slot = slab->freeList;
+    slab->freeList = slot;
+    slab->usedSlots--;
+    if (slab->usedSlots == 0) {
+        free(slab->memory);
+        slab->memory = NULL;
+        slab->freeList = NULL;
+        allocatedBytes -= TILE_CACHE_SLAB_SIZE;
+    }
+}
+
+static void lruUnlink(TileCacheEntry* entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        lruHead = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        lruTail = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void lruPushFront(TileCacheEntry* entry) {
+    entry->prev = NULL;
+    entry->next = lruHead;
+    if (lruHead) {
+        lruHead->prev = entry;
+    }
+    lruHead = entry;
+    if (!lruTail) {
+        lruTail = entry;
+    }
+}
+
+static TileCacheEntry* findEntry(int fileId, int tileCoordinate) {
+    TileCacheEntry* entry = buckets[hashKey(fileId, tileCoordinate)];
+    while (entry && (entry->fileId != fileId || entry->tileCoordinate != tileCoordinate)) {
+        entry = entry->bucketNext;
+    }
+    return entry;
+}
+
+static void removeEntry(TileCacheEntry* entry) {
+    TileCacheEntry** link = &buckets[hashKey(entry->fileId, entry->tileCoordinate)];
+    while (*link && *link != entry) {
+        link = &(*link)->bucketNext;
+    }
+    if (*link) {
+        *link = entry->bucketNext;
+    }
+    lruUnlink(entry);
+    releaseSlot(entry->data, entry->slotClass, entry->slabIndex, entry->allocatedBytes);
+    free(entry);
+}
+
+static void recordEviction(int fileId, int tileCoordinate) {
+    if (numEvicted + 2 > evictedCapacity) {
+        int newCapacity = evictedCapacity ? evictedCapacity * 2 : 256;
+        int* newKeys = (int*) realloc(evictedKeys, newCapacity * sizeof(int));
+        if (!newKeys) {
+            return;
+        }
+        evictedKeys = newKeys;
+        evictedCapacity = newCapacity;
+    }
+    evictedKeys[numEvicted++] = fileId;
+    evictedKeys[numEvicted++] = tileCoordinate;
+}
+
+static void evictLeastRecentlyUsed() {
+    TileCacheEntry* entry = lruTail;
+    if (entry) {
+        recordEviction(entry->fileId, entry->tileCoordinate);
+        removeEntry(entry);
+    }
+}
+
+static void fillNanEncodings(float* array, const int* nanEncodings, int nanLength, int N) {
+    // Some shader compilers have trouble with NaN checks, so we instead use a dummy value of -FLT_MAX
+    int decodedIndex = 0;
+    int fillVal = 0;
+    for (int i = 0; i < nanLength && decodedIndex < N; i++) {
+        const int L = nanEncodings[i];
+        if (L < 0) {
+            break;
+        }
+        if (fillVal) {
+            const int end = decodedIndex + L < N ? decodedIndex + L : N;
+            for (int j = decodedIndex; j < end; j++) {
+                array[j] = -FLT_MAX;
+            }
+        }
+        fillVal = !fillVal;
+        decodedIndex += L;
+    }
+}
+
+void EMSCRIPTEN_KEEPALIVE tileCacheSetBudget(int budget) {
+    budgetBytes = budget > 0 ? (size_t) budget : 0;
+    while (allocatedBytes > budgetBytes && lruTail) {
+        evictLeastRecentlyUsed();
+    }
+}
+
+/* Reserves space for a tile and returns a pointer to its slot, which the caller fills with the NaN encodings followed by the
+   compressed data. Any existing entry for the same tile is replaced. Returns NULL if the tile cannot be cached within the budget */
+unsigned char* EMSCRIPTEN_KEEPALIVE tileCacheInsert(int fileId, int tileCoordinate, int compressedSize, int nanLength, int width, int height, int codec, int precision) {
+    TileCacheEntry* existing = findEntry(fileId, tileCoordinate);
+    if (existing) {
+        removeEntry(existing);
+    }
+
+    const size_t requiredBytes = (size_t) nanLength * sizeof(int) + compressedSize;
+    const int slotClass = slotClassForSize(requiredBytes);
+    const size_t newAllocationBytes = slotClass == TILE_CACHE_LARGE_CLASS ? requiredBytes : TILE_CACHE_SLAB_SIZE;
+    if (newAllocationBytes > budgetBytes) {
+        return NULL;
+    }
+
+    void* slot = NULL;
+    int slabIndex = -1;
+    if (slotClass != TILE_CACHE_LARGE_CLASS) {
+        slot = popSlot(slotClass, &slabIndex);
+    }
+
+    // Evict entries until a free slot of the right class appears, or there is room for a new slab
+    while (!slot && allocatedBytes + newAllocationBytes > budgetBytes && lruTail) {
+        evictLeastRecentlyUsed();
+        if (slotClass != TILE_CACHE_LARGE_CLASS) {
+            slot = popSlot(slotClass, &slabIndex);
+        }
+    }
+
+    if (!slot) {
+        if (allocatedBytes + newAllocationBytes > budgetBytes) {
+            return NULL;
+        }
+        if (slotClass == TILE_CACHE_LARGE_CLASS) {
+            slot = malloc(requiredBytes);
+            if (slot) {
+                allocatedBytes += requiredBytes;
+            }
+        } else {
+            slot = newSlabSlot(slotClass, &slabIndex);
+        }
+    }
+
+    if (!slot) {
+        return NULL;
+    }
+
+    TileCacheEntry* entry = (TileCacheEntry*) malloc(sizeof(TileCacheEntry));
+    if (!entry) {
+        releaseSlot(slot, slotClass, slabIndex, slotClass == TILE_CACHE_LARGE_CLASS ? requiredBytes : 0);
+        return NULL;
+    }
+    entry->fileId = fileId;
+    entry->tileCoordinate = tileCoordinate;
+    entry->width = width;
+    entry->height = height;
+    entry->codec = codec;
+    entry->precision = precision;
+    entry->nanLength = nanLength;
+    entry->compressedSize = compressedSize;
+    entry->slotClass = slotClass;
+    entry->slabIndex = slabIndex;
+    entry->allocatedBytes = slotClass == TILE_CACHE_LARGE_CLASS ? requiredBytes : 0;
+    entry->data = (unsigned char*) slot;
+
+    const unsigned int bucket = hashKey(fileId, tileCoordinate);
+    entry->bucketNext = buckets[bucket];
+    buckets[bucket] = entry;
+    lruPushFront(entry);
+
+    return entry->data;
+}
+
+void EMSCRIPTEN_KEEPALIVE tileCacheRemove(int fileId, int tileCoordinate) {
+    TileCacheEntry* entry = findEntry(fileId, tileCoordinate);
+    if (entry) {
+        removeEntry(entry);
+    }
+}
+
+/* Removes all tiles of the given file, or all tiles if fileId is -1 */
+void EMSCRIPTEN_KEEPALIVE tileCacheRemoveFile(int fileId) {
+    TileCacheEntry* entry = lruHead;
+    while (entry) {
+        TileCacheEntry* next = entry->next;
+        if (fileId == -1 || entry->fileId == fileId) {
+            removeEntry(entry);
+        }
+        entry = next;
+    }
+}
+
+int EMSCRIPTEN_KEEPALIVE tileCacheNumEvicted() {
+    return numEvicted / 2;
+}
+
+/* (fileId, tileCoordinate) pairs of entries evicted since the last call to tileCacheClearEvicted */
+int* EMSCRIPTEN_KEEPALIVE tileCacheEvicted() {
+    return evictedKeys;
+}
+
+void EMSCRIPTEN_KEEPALIVE tileCacheClearEvicted() {
+    numEvicted = 0;
+}
+
+/* Decodes a cached tile directly from its slot, and marks it as most recently used.
+   Returns 0 on success, 1 if decoding failed and 2 if the tile is not in the cache */
+int EMSCRIPTEN_KEEPALIVE tileCacheDecompress(int fileId, int tileCoordinate, float* array) {
+    TileCacheEntry* entry = findEntry(fileId, tileCoordinate);
+    if (!entry) {
+        return 2;
+    }
+
+    lruUnlink(entry);
+    lruPushFront(entry);
+
+    const int* nanEncodings = (const int*) entry->data;
+    unsigned char* compressedData = entry->data + entry->nanLength * sizeof(int);
+    const int status = entry->codec == TILE_CODEC_ZSTD ? losslessDecompress(entry->precision, array, entry->width, entry->height, compressedData, entry->compressedSize)
+                                                       : zfpDecompress(entry->precision, array, entry->width, entry->height, compressedData, entry->compressedSize);
+    if (status) {
+        return 1;
+    }
+    fillNanEncodings(array, nanEncodings, entry->nanLength, entry->width * entry->height);
+    return 0;
+}